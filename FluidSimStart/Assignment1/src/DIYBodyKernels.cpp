@@ -0,0 +1,373 @@
+#include "DIYBodyKernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BODY_KERNELS_X86
+#endif
+
+#ifdef BODY_KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(BODY_KERNELS_X86) && !defined(_MSC_VER)
+#define BODY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BODY_TARGET_AVX2
+#endif
+
+//sin and cos over [-pi/4, pi/4] after taking out the nearest multiple of pi/4 in three parts,
+//from cephes' sinf and cosf
+static const float FOUR_OVER_PI = 1.27323954473516f;
+static const float PI_4_PART1 = 0.78515625f;
+static const float PI_4_PART2 = 2.4187564849853515625e-4f;
+static const float PI_4_PART3 = 3.77489497744594108e-8f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+
+//whole turns come out of a rotation in two parts too. TWO_PI_HI has few enough bits that
+//turns * TWO_PI_HI is exact for any number of turns a step could add. ROUND_MAGIC rounds
+//to the nearest whole number when added and taken off again, without a float to int cast
+static const float INV_TWO_PI = 0.159154943091895336f;
+static const float TWO_PI_HI = 6.28125f;
+static const float TWO_PI_LO = 1.9353071795864769e-3f;
+static const float ROUND_MAGIC = 12582912.0f;
+static const float PI = 3.14159265358979f;
+static const double TWO_PI = 6.283185307179586477;
+
+static inline unsigned int FloatBits(float f)
+{
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static inline float BitsFloat(unsigned int bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+float WrapBodyAngle(float angle)
+{
+    if (angle >= -PI && angle <= PI)
+    {
+        return angle;
+    }
+    return (float)remainder((double)angle, TWO_PI);
+}
+
+static inline float WrapAngle(float angle)
+{
+    float turns = (angle * INV_TWO_PI + ROUND_MAGIC) - ROUND_MAGIC;
+    return (angle - turns * TWO_PI_HI) - turns * TWO_PI_LO;
+}
+
+//for angles in [-pi, pi], or close enough that the octant is at most 4
+static inline void SinCos(float angle, float* cos_out, float* sin_out)
+{
+    unsigned int sin_sign = FloatBits(angle) & 0x80000000u;
+    float x = fabsf(angle);
+
+    //octant, rounded up to even so x ends up in [-pi/4, pi/4]
+    int octant = (int)(x * FOUR_OVER_PI);
+    octant = (octant + 1) & ~1;
+    float y = (float)octant;
+
+    sin_sign ^= ((unsigned int)octant & 4u) << 29;
+    unsigned int cos_sign = (~(unsigned int)(octant - 2) & 4u) << 29;
+    bool swap = (octant & 2) != 0;
+
+    x = ((x - y * PI_4_PART1) - y * PI_4_PART2) - y * PI_4_PART3;
+    float z = x * x;
+
+    float c = ((COS_P0 * z + COS_P1) * z + COS_P2) * z * z - z * 0.5f + 1.0f;
+    float s = ((SIN_P0 * z + SIN_P1) * z + SIN_P2) * z * x + x;
+
+    *sin_out = BitsFloat(FloatBits(swap ? c : s) ^ sin_sign);
+    *cos_out = BitsFloat(FloatBits(swap ? s : c) ^ cos_sign);
+}
+
+void BodySinCos(float angle, float* cos_out, float* sin_out)
+{
+    SinCos(WrapBodyAngle(angle), cos_out, sin_out);
+}
+
+static inline void IntegrateBody(const BodyStreams& bodies, int b, float dt, float gravity_x, float gravity_y)
+{
+    const float mass = bodies.mass[b];
+    const float dynamic = bodies.dynamic[b];
+
+    //gravity and friction are forces too, added in the order applyForce used to add them
+    float friction = -mass * bodies.dynamic_friction[b];
+    float total_x = (bodies.force_x[b] + gravity_x * mass) + friction * bodies.velocity_x[b];
+    float total_y = (bodies.force_y[b] + gravity_y * mass) + friction * bodies.velocity_y[b];
+    float total_torque = bodies.torque[b] + (-bodies.moment_of_inertia[b] * bodies.dynamic_friction[b]) * bodies.angular_velocity[b];
+
+    //static bodies have inverses of 0, so a static body with no mass stays finite
+    float delta_vx = (total_x * bodies.inverse_mass[b]) * dt;
+    float delta_vy = (total_y * bodies.inverse_mass[b]) * dt;
+    float delta_w = (total_torque * bodies.inverse_moment[b]) * dt;
+
+    bodies.velocity_x[b] += delta_vx * dynamic;
+    bodies.velocity_y[b] += delta_vy * dynamic;
+    bodies.position_x[b] += bodies.velocity_x[b] * dt * dynamic;
+    bodies.position_y[b] += bodies.velocity_y[b] * dt * dynamic;
+
+    bodies.rotation[b] = WrapAngle(bodies.rotation[b] + bodies.angular_velocity[b] * dt * dynamic);
+    bodies.angular_velocity[b] += delta_w * dynamic;
+
+    bodies.force_x[b] = 0;
+    bodies.force_y[b] = 0;
+    bodies.torque[b] = 0;
+
+    SinCos(bodies.rotation[b], bodies.rotation_cos + b, bodies.rotation_sin + b);
+}
+
+static void IntegrateScalar(const BodyStreams& bodies, int begin, int end, float dt, float gravity_x, float gravity_y)
+{
+    for (int b = begin; b < end; ++b)
+    {
+        IntegrateBody(bodies, b, dt, gravity_x, gravity_y);
+    }
+}
+
+#ifdef BODY_KERNELS_X86
+
+//sse2
+
+static inline void SinCosSSE2(__m128 angle, __m128* cos_out, __m128* sin_out)
+{
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i four = _mm_set1_epi32(4);
+
+    __m128 sin_sign = _mm_and_ps(angle, sign_mask);
+    __m128 x = _mm_andnot_ps(sign_mask, angle);
+
+    __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+    octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(octant);
+
+    sin_sign = _mm_xor_ps(sin_sign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, four), 29)));
+    __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, two), four), 29));
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, two), two));
+
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_PART1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_PART2)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(PI_4_PART3)));
+    __m128 z = _mm_mul_ps(x, x);
+
+    __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+    c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_P2));
+    c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+    c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+    s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_P2));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+    *sin_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)), sin_sign);
+    *cos_out = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c)), cos_sign);
+}
+
+static inline __m128 WrapAngleSSE2(__m128 angle)
+{
+    const __m128 magic = _mm_set1_ps(ROUND_MAGIC);
+    __m128 turns = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(angle, _mm_set1_ps(INV_TWO_PI)), magic), magic);
+    angle = _mm_sub_ps(angle, _mm_mul_ps(turns, _mm_set1_ps(TWO_PI_HI)));
+    return _mm_sub_ps(angle, _mm_mul_ps(turns, _mm_set1_ps(TWO_PI_LO)));
+}
+
+static void IntegrateSSE2(const BodyStreams& bodies, int begin, int end, float dt, float gravity_x, float gravity_y)
+{
+    const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    const __m128 v_dt = _mm_set1_ps(dt);
+    const __m128 v_gravity_x = _mm_set1_ps(gravity_x);
+    const __m128 v_gravity_y = _mm_set1_ps(gravity_y);
+    const __m128 zero = _mm_setzero_ps();
+
+    int b = begin;
+    for (; b + 4 <= end; b += 4)
+    {
+        __m128 mass = _mm_loadu_ps(bodies.mass + b);
+        __m128 moment = _mm_loadu_ps(bodies.moment_of_inertia + b);
+        __m128 dynamic_friction = _mm_loadu_ps(bodies.dynamic_friction + b);
+        __m128 dynamic = _mm_loadu_ps(bodies.dynamic + b);
+        __m128 vx = _mm_loadu_ps(bodies.velocity_x + b);
+        __m128 vy = _mm_loadu_ps(bodies.velocity_y + b);
+        __m128 w = _mm_loadu_ps(bodies.angular_velocity + b);
+
+        __m128 friction = _mm_mul_ps(_mm_xor_ps(mass, sign_mask), dynamic_friction);
+        __m128 total_x = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(bodies.force_x + b), _mm_mul_ps(v_gravity_x, mass)), _mm_mul_ps(friction, vx));
+        __m128 total_y = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(bodies.force_y + b), _mm_mul_ps(v_gravity_y, mass)), _mm_mul_ps(friction, vy));
+        __m128 total_torque = _mm_add_ps(_mm_loadu_ps(bodies.torque + b),
+                                         _mm_mul_ps(_mm_mul_ps(_mm_xor_ps(moment, sign_mask), dynamic_friction), w));
+
+        __m128 inverse_mass = _mm_loadu_ps(bodies.inverse_mass + b);
+        __m128 delta_vx = _mm_mul_ps(_mm_mul_ps(total_x, inverse_mass), v_dt);
+        __m128 delta_vy = _mm_mul_ps(_mm_mul_ps(total_y, inverse_mass), v_dt);
+        __m128 delta_w = _mm_mul_ps(_mm_mul_ps(total_torque, _mm_loadu_ps(bodies.inverse_moment + b)), v_dt);
+
+        vx = _mm_add_ps(vx, _mm_mul_ps(delta_vx, dynamic));
+        vy = _mm_add_ps(vy, _mm_mul_ps(delta_vy, dynamic));
+        __m128 px = _mm_add_ps(_mm_loadu_ps(bodies.position_x + b), _mm_mul_ps(_mm_mul_ps(vx, v_dt), dynamic));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(bodies.position_y + b), _mm_mul_ps(_mm_mul_ps(vy, v_dt), dynamic));
+
+        __m128 rotation = WrapAngleSSE2(_mm_add_ps(_mm_loadu_ps(bodies.rotation + b), _mm_mul_ps(_mm_mul_ps(w, v_dt), dynamic)));
+        w = _mm_add_ps(w, _mm_mul_ps(delta_w, dynamic));
+
+        __m128 c, s;
+        SinCosSSE2(rotation, &c, &s);
+
+        _mm_storeu_ps(bodies.velocity_x + b, vx);
+        _mm_storeu_ps(bodies.velocity_y + b, vy);
+        _mm_storeu_ps(bodies.position_x + b, px);
+        _mm_storeu_ps(bodies.position_y + b, py);
+        _mm_storeu_ps(bodies.rotation + b, rotation);
+        _mm_storeu_ps(bodies.angular_velocity + b, w);
+        _mm_storeu_ps(bodies.rotation_cos + b, c);
+        _mm_storeu_ps(bodies.rotation_sin + b, s);
+        _mm_storeu_ps(bodies.force_x + b, zero);
+        _mm_storeu_ps(bodies.force_y + b, zero);
+        _mm_storeu_ps(bodies.torque + b, zero);
+    }
+
+    IntegrateScalar(bodies, b, end, dt, gravity_x, gravity_y);
+}
+
+//avx2
+
+static inline BODY_TARGET_AVX2 void SinCosAVX2(__m256 angle, __m256* cos_out, __m256* sin_out)
+{
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i four = _mm256_set1_epi32(4);
+
+    __m256 sin_sign = _mm256_and_ps(angle, sign_mask);
+    __m256 x = _mm256_andnot_ps(sign_mask, angle);
+
+    __m256i octant = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+    octant = _mm256_and_si256(_mm256_add_epi32(octant, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(octant);
+
+    sin_sign = _mm256_xor_ps(sin_sign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(octant, four), 29)));
+    __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(octant, two), four), 29));
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(octant, two), two));
+
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PI_4_PART1)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PI_4_PART2)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(PI_4_PART3)));
+    __m256 z = _mm256_mul_ps(x, x);
+
+    __m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0), z), _mm256_set1_ps(COS_P1));
+    c = _mm256_add_ps(_mm256_mul_ps(c, z), _mm256_set1_ps(COS_P2));
+    c = _mm256_mul_ps(_mm256_mul_ps(c, z), z);
+    c = _mm256_add_ps(_mm256_sub_ps(c, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0), z), _mm256_set1_ps(SIN_P1));
+    s = _mm256_add_ps(_mm256_mul_ps(s, z), _mm256_set1_ps(SIN_P2));
+    s = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s, z), x), x);
+
+    *sin_out = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sin_sign);
+    *cos_out = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cos_sign);
+}
+
+static inline BODY_TARGET_AVX2 __m256 WrapAngleAVX2(__m256 angle)
+{
+    const __m256 magic = _mm256_set1_ps(ROUND_MAGIC);
+    __m256 turns = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(angle, _mm256_set1_ps(INV_TWO_PI)), magic), magic);
+    angle = _mm256_sub_ps(angle, _mm256_mul_ps(turns, _mm256_set1_ps(TWO_PI_HI)));
+    return _mm256_sub_ps(angle, _mm256_mul_ps(turns, _mm256_set1_ps(TWO_PI_LO)));
+}
+
+static BODY_TARGET_AVX2 void IntegrateAVX2(const BodyStreams& bodies, int begin, int end, float dt, float gravity_x, float gravity_y)
+{
+    const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+    const __m256 v_dt = _mm256_set1_ps(dt);
+    const __m256 v_gravity_x = _mm256_set1_ps(gravity_x);
+    const __m256 v_gravity_y = _mm256_set1_ps(gravity_y);
+    const __m256 zero = _mm256_setzero_ps();
+
+    int b = begin;
+    for (; b + 8 <= end; b += 8)
+    {
+        __m256 mass = _mm256_loadu_ps(bodies.mass + b);
+        __m256 moment = _mm256_loadu_ps(bodies.moment_of_inertia + b);
+        __m256 dynamic_friction = _mm256_loadu_ps(bodies.dynamic_friction + b);
+        __m256 dynamic = _mm256_loadu_ps(bodies.dynamic + b);
+        __m256 vx = _mm256_loadu_ps(bodies.velocity_x + b);
+        __m256 vy = _mm256_loadu_ps(bodies.velocity_y + b);
+        __m256 w = _mm256_loadu_ps(bodies.angular_velocity + b);
+
+        __m256 friction = _mm256_mul_ps(_mm256_xor_ps(mass, sign_mask), dynamic_friction);
+        __m256 total_x = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(bodies.force_x + b), _mm256_mul_ps(v_gravity_x, mass)), _mm256_mul_ps(friction, vx));
+        __m256 total_y = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(bodies.force_y + b), _mm256_mul_ps(v_gravity_y, mass)), _mm256_mul_ps(friction, vy));
+        __m256 total_torque = _mm256_add_ps(_mm256_loadu_ps(bodies.torque + b),
+                                            _mm256_mul_ps(_mm256_mul_ps(_mm256_xor_ps(moment, sign_mask), dynamic_friction), w));
+
+        __m256 inverse_mass = _mm256_loadu_ps(bodies.inverse_mass + b);
+        __m256 delta_vx = _mm256_mul_ps(_mm256_mul_ps(total_x, inverse_mass), v_dt);
+        __m256 delta_vy = _mm256_mul_ps(_mm256_mul_ps(total_y, inverse_mass), v_dt);
+        __m256 delta_w = _mm256_mul_ps(_mm256_mul_ps(total_torque, _mm256_loadu_ps(bodies.inverse_moment + b)), v_dt);
+
+        vx = _mm256_add_ps(vx, _mm256_mul_ps(delta_vx, dynamic));
+        vy = _mm256_add_ps(vy, _mm256_mul_ps(delta_vy, dynamic));
+        __m256 px = _mm256_add_ps(_mm256_loadu_ps(bodies.position_x + b), _mm256_mul_ps(_mm256_mul_ps(vx, v_dt), dynamic));
+        __m256 py = _mm256_add_ps(_mm256_loadu_ps(bodies.position_y + b), _mm256_mul_ps(_mm256_mul_ps(vy, v_dt), dynamic));
+
+        __m256 rotation = WrapAngleAVX2(_mm256_add_ps(_mm256_loadu_ps(bodies.rotation + b), _mm256_mul_ps(_mm256_mul_ps(w, v_dt), dynamic)));
+        w = _mm256_add_ps(w, _mm256_mul_ps(delta_w, dynamic));
+
+        __m256 c, s;
+        SinCosAVX2(rotation, &c, &s);
+
+        _mm256_storeu_ps(bodies.velocity_x + b, vx);
+        _mm256_storeu_ps(bodies.velocity_y + b, vy);
+        _mm256_storeu_ps(bodies.position_x + b, px);
+        _mm256_storeu_ps(bodies.position_y + b, py);
+        _mm256_storeu_ps(bodies.rotation + b, rotation);
+        _mm256_storeu_ps(bodies.angular_velocity + b, w);
+        _mm256_storeu_ps(bodies.rotation_cos + b, c);
+        _mm256_storeu_ps(bodies.rotation_sin + b, s);
+        _mm256_storeu_ps(bodies.force_x + b, zero);
+        _mm256_storeu_ps(bodies.force_y + b, zero);
+        _mm256_storeu_ps(bodies.torque + b, zero);
+    }
+
+    IntegrateScalar(bodies, b, end, dt, gravity_x, gravity_y);
+}
+
+#endif
+
+static const BodyKernels body_kernel_sets[] =
+{
+    { SIMD_SCALAR, "scalar", IntegrateScalar },
+#ifdef BODY_KERNELS_X86
+    { SIMD_SSE2, "sse2", IntegrateSSE2 },
+    { SIMD_AVX2, "avx2", IntegrateAVX2 },
+#endif
+};
+
+const BodyKernels* SelectBodyKernels()
+{
+    return body_kernel_sets + SupportedSimdLevel();
+}
+
+const BodyKernels* GetBodyKernels(SimdLevel simd)
+{
+    const BodyKernels* best = SelectBodyKernels();
+
+    if (simd > best->simd)
+    {
+        return best;
+    }
+    return body_kernel_sets + simd;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SimdSupport.h"
+
+//vectorized integration of DIYPhysicScene's bodies, 4 at a time with sse2 and 8 with avx2.
+//
+//sines and cosines come from the same cephes style polynomial in every version, and the
+//rest is the same adds, multiplies and divides in the same order, so all of them give
+//bit-for-bit the same results. rotations are kept within [-pi, pi] by taking out whole turns
+//after every step, so the sines and cosines stay accurate however long a body spins
+
+//the body arrays the kernels read and write, one entry per body
+struct BodyStreams
+{
+    float* position_x;
+    float* position_y;
+    float* velocity_x;
+    float* velocity_y;
+    float* rotation;
+    float* rotation_cos;
+    float* rotation_sin;
+    float* angular_velocity;
+    float* force_x;
+    float* force_y;
+    float* torque;
+    const float* mass;
+    const float* moment_of_inertia;
+    const float* dynamic_friction;
+    const float* dynamic;
+    const float* inverse_mass;      //0 for static bodies
+    const float* inverse_moment;
+};
+
+struct BodyKernels
+{
+    SimdLevel simd;
+    const char* name;
+
+    //one semi-implicit euler step of bodies [begin, end): gravity, friction and the forces and
+    //torques they have built up go into the velocities, which move them on. the forces are then
+    //zeroed, each new rotation wrapped into [-pi, pi] and its cos/sin stored
+    void (*integrate)(const BodyStreams& bodies, int begin, int end,
+                      float dt, float gravity_x, float gravity_y);
+};
+
+//widest kernel set this cpu and os support
+const BodyKernels* SelectBodyKernels();
+
+//a specific kernel set, falls back to the widest supported one if simd isn't available
+const BodyKernels* GetBodyKernels(SimdLevel simd);
+
+//the angle moved into [-pi, pi] by whole turns, worked out in double so it is right for any
+//finite angle, for setting a body's rotation outside of the kernels
+float WrapBodyAngle(float angle);
+
+//the cos and sin the kernels give for an angle, good to a couple of ulps. angles outside
+//[-pi, pi] are wrapped with WrapBodyAngle first
+void BodySinCos(float angle, float* cos_out, float* sin_out);
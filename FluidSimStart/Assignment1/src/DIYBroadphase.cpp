@@ -0,0 +1,544 @@
+#include "DIYBroadphase.h"
+
+#include <algorithm>
+#include <cmath>
+
+static inline BroadphaseBox BoxUnion(const BroadphaseBox& a, const BroadphaseBox& b)
+{
+    BroadphaseBox result;
+    result.min = glm::min(a.min, b.min);
+    result.max = glm::max(a.max, b.max);
+    return result;
+}
+
+static inline bool BoxContains(const BroadphaseBox& outer, const BroadphaseBox& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+static inline float BoxPerimeter(const BroadphaseBox& box)
+{
+    glm::vec2 size = box.max - box.min;
+    return 2 * (size.x + size.y);
+}
+
+static inline BroadphasePair OrderedPair(int a, int b)
+{
+    BroadphasePair pair = { glm::min(a, b), glm::max(a, b) };
+    return pair;
+}
+
+//spatial hash functions
+
+SpatialHashBroadphase::SpatialHashBroadphase(float cell_size)
+{
+    this->cell_size = cell_size;
+}
+
+static inline int CellCoord(float v, float inv_cell_size)
+{
+    return (int)floorf(v * inv_cell_size);
+}
+
+static inline unsigned long long CellKey(int x, int y)
+{
+    return ((unsigned long long)(unsigned int)x << 32) | (unsigned int)y;
+}
+
+void SpatialHashBroadphase::findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs)
+{
+    pairs.clear();
+    entries.clear();
+    oversized.clear();
+
+    int box_count = (int)boxes.size();
+    if (box_count < 2)
+    {
+        return;
+    }
+
+    float size = cell_size;
+    if (size <= 0)
+    {
+        float total = 0;
+        for (int b = 0; b < box_count; ++b)
+        {
+            glm::vec2 extent = boxes[b].max - boxes[b].min;
+            total += glm::max(extent.x, extent.y);
+        }
+        size = total / box_count;
+    }
+    //written so nan fails too
+    if (!(size > 0))
+    {
+        size = 1;
+    }
+    float inv_size = 1.0f / size;
+
+    for (int b = 0; b < box_count; ++b)
+    {
+        int x_begin = CellCoord(boxes[b].min.x, inv_size);
+        int x_end = CellCoord(boxes[b].max.x, inv_size) + 1;
+        int y_begin = CellCoord(boxes[b].min.y, inv_size);
+        int y_end = CellCoord(boxes[b].max.y, inv_size) + 1;
+
+        if (x_end - x_begin > MAX_CELLS_PER_BOX || y_end - y_begin > MAX_CELLS_PER_BOX ||
+            (x_end - x_begin) * (y_end - y_begin) > MAX_CELLS_PER_BOX)
+        {
+            oversized.push_back(b);
+            continue;
+        }
+
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            for (int x = x_begin; x < x_end; ++x)
+            {
+                CellEntry entry = { CellKey(x, y), b };
+                entries.push_back(entry);
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const CellEntry& a, const CellEntry& b)
+    {
+        return a.cell < b.cell || (a.cell == b.cell && a.box < b.box);
+    });
+
+    int entry_count = (int)entries.size();
+    for (int run_begin = 0; run_begin < entry_count;)
+    {
+        unsigned long long cell = entries[run_begin].cell;
+
+        int run_end = run_begin + 1;
+        while (run_end < entry_count && entries[run_end].cell == cell)
+        {
+            ++run_end;
+        }
+
+        for (int a = run_begin; a < run_end; ++a)
+        {
+            const BroadphaseBox& first = boxes[entries[a].box];
+
+            for (int b = a + 1; b < run_end; ++b)
+            {
+                const BroadphaseBox& second = boxes[entries[b].box];
+                if (!BoxesOverlap(first, second))
+                {
+                    continue;
+                }
+
+                //the corner where the overlap starts is in both boxes' cells, only that cell reports them
+                int x = CellCoord(glm::max(first.min.x, second.min.x), inv_size);
+                int y = CellCoord(glm::max(first.min.y, second.min.y), inv_size);
+                if (CellKey(x, y) == cell)
+                {
+                    BroadphasePair pair = { entries[a].box, entries[b].box };
+                    pairs.push_back(pair);
+                }
+            }
+        }
+
+        run_begin = run_end;
+    }
+
+    //oversized boxes against everything, each pair of them once
+    for (int o = 0; o < (int)oversized.size(); ++o)
+    {
+        int big = oversized[o];
+        for (int b = 0; b < box_count; ++b)
+        {
+            if (b == big || (b < big && std::binary_search(oversized.begin(), oversized.end(), b)))
+            {
+                continue;
+            }
+            if (BoxesOverlap(boxes[big], boxes[b]))
+            {
+                pairs.push_back(OrderedPair(big, b));
+            }
+        }
+    }
+}
+
+//sweep and prune functions
+
+void SweepAndPruneBroadphase::findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs)
+{
+    pairs.clear();
+
+    int box_count = (int)boxes.size();
+
+    //a different count means actors came or went, start again from scratch
+    if ((int)order.size() != box_count)
+    {
+        order.resize(box_count);
+        for (int b = 0; b < box_count; ++b)
+        {
+            order[b] = b;
+        }
+        std::sort(order.begin(), order.end(), [&](int a, int b)
+        {
+            return boxes[a].min.x < boxes[b].min.x;
+        });
+    }
+    else
+    {
+        for (int k = 1; k < box_count; ++k)
+        {
+            int box = order[k];
+            float x = boxes[box].min.x;
+
+            int m = k - 1;
+            while (m >= 0 && boxes[order[m]].min.x > x)
+            {
+                order[m + 1] = order[m];
+                --m;
+            }
+            order[m + 1] = box;
+        }
+    }
+
+    //every box against the ones that start along x before it ends
+    for (int k = 0; k < box_count; ++k)
+    {
+        const BroadphaseBox& first = boxes[order[k]];
+
+        for (int m = k + 1; m < box_count && boxes[order[m]].min.x <= first.max.x; ++m)
+        {
+            const BroadphaseBox& second = boxes[order[m]];
+            if (first.min.y <= second.max.y && second.min.y <= first.max.y)
+            {
+                pairs.push_back(OrderedPair(order[k], order[m]));
+            }
+        }
+    }
+}
+
+//aabb tree functions
+
+AABBTreeBroadphase::AABBTreeBroadphase(float margin)
+{
+    this->margin = margin;
+    this->root = -1;
+    this->free_list = -1;
+}
+
+int AABBTreeBroadphase::allocateNode()
+{
+    int node;
+    if (free_list == -1)
+    {
+        node = (int)nodes.size();
+        nodes.push_back(TreeNode());
+    }
+    else
+    {
+        node = free_list;
+        free_list = nodes[node].parent;
+    }
+
+    nodes[node].parent = -1;
+    nodes[node].child1 = -1;
+    nodes[node].child2 = -1;
+    nodes[node].height = 0;
+    nodes[node].box_index = -1;
+    return node;
+}
+
+void AABBTreeBroadphase::freeNode(int node)
+{
+    nodes[node].parent = free_list;
+    nodes[node].height = -1;
+    free_list = node;
+}
+
+void AABBTreeBroadphase::insertLeaf(int leaf)
+{
+    if (root == -1)
+    {
+        root = leaf;
+        nodes[root].parent = -1;
+        return;
+    }
+
+    //walk down to the node that costs least to pair the leaf with, by the perimeter it adds to the tree
+    BroadphaseBox leaf_box = nodes[leaf].box;
+    int index = root;
+    while (nodes[index].height > 0)
+    {
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+
+        float perimeter = BoxPerimeter(nodes[index].box);
+        float combined_perimeter = BoxPerimeter(BoxUnion(nodes[index].box, leaf_box));
+
+        //a new parent for this node and the leaf, or pushing the leaf further down
+        float cost = 2 * combined_perimeter;
+        float inheritance_cost = 2 * (combined_perimeter - perimeter);
+
+        float cost1 = BoxPerimeter(BoxUnion(leaf_box, nodes[child1].box)) + inheritance_cost;
+        if (nodes[child1].height > 0)
+        {
+            cost1 -= BoxPerimeter(nodes[child1].box);
+        }
+        float cost2 = BoxPerimeter(BoxUnion(leaf_box, nodes[child2].box)) + inheritance_cost;
+        if (nodes[child2].height > 0)
+        {
+            cost2 -= BoxPerimeter(nodes[child2].box);
+        }
+
+        if (cost < cost1 && cost < cost2)
+        {
+            break;
+        }
+        index = cost1 < cost2 ? child1 : child2;
+    }
+
+    int sibling = index;
+    int old_parent = nodes[sibling].parent;
+    int new_parent = allocateNode();
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].box = BoxUnion(leaf_box, nodes[sibling].box);
+    nodes[new_parent].height = nodes[sibling].height + 1;
+    nodes[new_parent].child1 = sibling;
+    nodes[new_parent].child2 = leaf;
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent == -1)
+    {
+        root = new_parent;
+    }
+    else if (nodes[old_parent].child1 == sibling)
+    {
+        nodes[old_parent].child1 = new_parent;
+    }
+    else
+    {
+        nodes[old_parent].child2 = new_parent;
+    }
+
+    //grow the boxes above it and rebalance on the way back up
+    for (index = nodes[leaf].parent; index != -1; index = nodes[index].parent)
+    {
+        index = balance(index);
+
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+        nodes[index].height = 1 + glm::max(nodes[child1].height, nodes[child2].height);
+        nodes[index].box = BoxUnion(nodes[child1].box, nodes[child2].box);
+    }
+}
+
+void AABBTreeBroadphase::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = -1;
+        return;
+    }
+
+    //the leaf's sibling takes its parent's place
+    int parent = nodes[leaf].parent;
+    int grand_parent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+    freeNode(parent);
+
+    if (grand_parent == -1)
+    {
+        root = sibling;
+        nodes[sibling].parent = -1;
+        return;
+    }
+
+    if (nodes[grand_parent].child1 == parent)
+    {
+        nodes[grand_parent].child1 = sibling;
+    }
+    else
+    {
+        nodes[grand_parent].child2 = sibling;
+    }
+    nodes[sibling].parent = grand_parent;
+
+    for (int index = grand_parent; index != -1; index = nodes[index].parent)
+    {
+        index = balance(index);
+
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+        nodes[index].height = 1 + glm::max(nodes[child1].height, nodes[child2].height);
+        nodes[index].box = BoxUnion(nodes[child1].box, nodes[child2].box);
+    }
+}
+
+//if one child of a is more than a level taller than the other, rotates it up to take a's place.
+//returns the node now where a was
+int AABBTreeBroadphase::balance(int a)
+{
+    if (nodes[a].height < 2)
+    {
+        return a;
+    }
+
+    int b = nodes[a].child1;
+    int c = nodes[a].child2;
+    int difference = nodes[c].height - nodes[b].height;
+
+    if (difference > 1)
+    {
+        //c goes up, a takes whichever of c's children is shorter
+        int f = nodes[c].child1;
+        int g = nodes[c].child2;
+
+        nodes[c].child1 = a;
+        nodes[c].parent = nodes[a].parent;
+        nodes[a].parent = c;
+
+        if (nodes[c].parent == -1)
+        {
+            root = c;
+        }
+        else if (nodes[nodes[c].parent].child1 == a)
+        {
+            nodes[nodes[c].parent].child1 = c;
+        }
+        else
+        {
+            nodes[nodes[c].parent].child2 = c;
+        }
+
+        if (nodes[f].height > nodes[g].height)
+        {
+            std::swap(f, g);
+        }
+        //g is the taller, it stays under c
+        nodes[c].child2 = g;
+        nodes[a].child2 = f;
+        nodes[f].parent = a;
+        nodes[a].box = BoxUnion(nodes[b].box, nodes[f].box);
+        nodes[c].box = BoxUnion(nodes[a].box, nodes[g].box);
+        nodes[a].height = 1 + glm::max(nodes[b].height, nodes[f].height);
+        nodes[c].height = 1 + glm::max(nodes[a].height, nodes[g].height);
+
+        return c;
+    }
+
+    if (difference < -1)
+    {
+        //b goes up, the same the other way round
+        int d = nodes[b].child1;
+        int e = nodes[b].child2;
+
+        nodes[b].child1 = a;
+        nodes[b].parent = nodes[a].parent;
+        nodes[a].parent = b;
+
+        if (nodes[b].parent == -1)
+        {
+            root = b;
+        }
+        else if (nodes[nodes[b].parent].child1 == a)
+        {
+            nodes[nodes[b].parent].child1 = b;
+        }
+        else
+        {
+            nodes[nodes[b].parent].child2 = b;
+        }
+
+        if (nodes[d].height > nodes[e].height)
+        {
+            std::swap(d, e);
+        }
+        nodes[b].child2 = e;
+        nodes[a].child1 = d;
+        nodes[d].parent = a;
+        nodes[a].box = BoxUnion(nodes[c].box, nodes[d].box);
+        nodes[b].box = BoxUnion(nodes[a].box, nodes[e].box);
+        nodes[a].height = 1 + glm::max(nodes[c].height, nodes[d].height);
+        nodes[b].height = 1 + glm::max(nodes[a].height, nodes[e].height);
+
+        return b;
+    }
+
+    return a;
+}
+
+void AABBTreeBroadphase::findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs)
+{
+    pairs.clear();
+
+    int box_count = (int)boxes.size();
+    glm::vec2 grow(margin, margin);
+
+    //leaves for boxes that have gone, then for new ones
+    while ((int)leaves.size() > box_count)
+    {
+        removeLeaf(leaves.back());
+        freeNode(leaves.back());
+        leaves.pop_back();
+    }
+
+    for (int b = 0; b < box_count; ++b)
+    {
+        int leaf;
+        if (b < (int)leaves.size())
+        {
+            leaf = leaves[b];
+            if (BoxContains(nodes[leaf].box, boxes[b]))
+            {
+                continue;
+            }
+            removeLeaf(leaf);
+        }
+        else
+        {
+            leaf = allocateNode();
+            nodes[leaf].box_index = b;
+            leaves.push_back(leaf);
+        }
+
+        nodes[leaf].box.min = boxes[b].min - grow;
+        nodes[leaf].box.max = boxes[b].max + grow;
+        insertLeaf(leaf);
+    }
+
+    if (root == -1)
+    {
+        return;
+    }
+
+    //each box against the tree. a leaf's box holds its real one, so the real boxes decide
+    for (int b = 0; b < box_count; ++b)
+    {
+        stack.clear();
+        stack.push_back(root);
+
+        while (!stack.empty())
+        {
+            int node = stack.back();
+            stack.pop_back();
+
+            if (!BoxesOverlap(nodes[node].box, boxes[b]))
+            {
+                continue;
+            }
+
+            if (nodes[node].height == 0)
+            {
+                int other = nodes[node].box_index;
+                if (other > b && BoxesOverlap(boxes[b], boxes[other]))
+                {
+                    BroadphasePair pair = { b, other };
+                    pairs.push_back(pair);
+                }
+            }
+            else
+            {
+                stack.push_back(nodes[node].child1);
+                stack.push_back(nodes[node].child2);
+            }
+        }
+    }
+}
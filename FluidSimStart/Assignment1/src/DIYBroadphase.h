@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+//axis aligned bounds of an actor
+struct BroadphaseBox
+{
+    glm::vec2 min;
+    glm::vec2 max;
+};
+
+//two boxes that overlap, by index into the boxes handed to findPairs, first < second
+struct BroadphasePair
+{
+    int first;
+    int second;
+};
+
+inline bool BoxesOverlap(const BroadphaseBox& a, const BroadphaseBox& b)
+{
+    return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+           a.min.y <= b.max.y && b.min.y <= a.max.y;
+}
+
+//finds the pairs of actors that might be touching, so the narrow phase only runs on those.
+//DIYPhysicScene hands over the bounds of every actor that has any each update and tests the
+//unbounded ones, the planes, itself. implementations can keep what they like from one call to
+//the next, but a box's index isn't tied to an actor, removeActor shifts the ones after it down
+class Broadphase
+{
+public:
+    virtual ~Broadphase() {}
+
+    //every pair of overlapping boxes goes into pairs exactly once, in any order. pairs is cleared first
+    virtual void findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs) = 0;
+};
+
+//uniform grid. every box goes into the cells it covers, then the boxes sharing a cell are tested,
+//each pair only in the cell holding the corner where their overlap starts so it is found once.
+//the cells are sorted rather than hashed into buckets, which keeps the results in a fixed order
+class SpatialHashBroadphase : public Broadphase
+{
+public:
+    //cell_size of 0 sizes the cells to the average box on every call
+    SpatialHashBroadphase(float cell_size = 0);
+
+    virtual void findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs);
+
+    float cell_size;
+
+    //boxes covering more cells than this are kept out of the grid and tested against every box
+    static const int MAX_CELLS_PER_BOX = 16;
+
+private:
+    struct CellEntry
+    {
+        unsigned long long cell;
+        int box;
+    };
+
+    std::vector<CellEntry> entries;
+    std::vector<int> oversized;
+};
+
+//sort and sweep along x. the sorted order is kept from one call to the next and brought up to date
+//with an insertion sort, which is close to linear while bodies only move a little between updates
+class SweepAndPruneBroadphase : public Broadphase
+{
+public:
+    virtual void findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs);
+
+private:
+    std::vector<int> order;     //box indices by min.x as of the last call
+};
+
+//dynamic bounding volume tree. each box has a leaf holding a copy of it grown by margin on every side,
+//and only goes back into the tree when it moves out of that. insertion picks the sibling that adds the
+//least perimeter and rotations keep the tree balanced, as in box2d's b2DynamicTree
+class AABBTreeBroadphase : public Broadphase
+{
+public:
+    AABBTreeBroadphase(float margin = 0.5f);
+
+    virtual void findPairs(const std::vector<BroadphaseBox>& boxes, std::vector<BroadphasePair>& pairs);
+
+    float margin;
+
+private:
+    struct TreeNode
+    {
+        BroadphaseBox box;
+        int parent;         //next free node while it's on the free list
+        int child1, child2;
+        int height;         //0 for leaves, -1 for free nodes
+        int box_index;      //leaves only
+    };
+
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+
+    std::vector<TreeNode> nodes;
+    int root;
+    int free_list;
+
+    std::vector<int> leaves;    //leaf node of each box
+    std::vector<int> stack;     //findPairs' traversal
+};
@@ -0,0 +1,122 @@
+#include "DIYContactCache.h"
+
+static const int INITIAL_CAPACITY = 64;
+
+ContactCache::ContactCache()
+{
+    for (Table& table : tables)
+    {
+        table.entries.resize(INITIAL_CAPACITY);
+        for (CachedContact& entry : table.entries)
+        {
+            entry.stamp = 0;
+        }
+    }
+
+    current = &tables[0];
+    previous = &tables[1];
+}
+
+void ContactCache::beginUpdate()
+{
+    Table* swap = previous;
+    previous = current;
+    current = swap;
+
+    current->count = 0;
+    ++current->stamp;
+
+    //every stamp an entry could still hold has been used, start them over
+    if (current->stamp == 0)
+    {
+        for (CachedContact& entry : current->entries)
+        {
+            entry.stamp = 0;
+        }
+        current->stamp = 1;
+    }
+}
+
+//the high bits of a multiplicative hash, after folding the two ids together so both count
+unsigned int ContactCache::slotFor(unsigned long long key, unsigned int mask)
+{
+    key ^= key >> 29;
+    key *= 0x9E3779B97F4A7C15ull;
+    return (unsigned int)(key >> 32) & mask;
+}
+
+const CachedContact* ContactCache::findPrevious(unsigned long long key) const
+{
+    const std::vector<CachedContact>& entries = previous->entries;
+    unsigned int mask = (unsigned int)entries.size() - 1;
+
+    for (unsigned int slot = slotFor(key, mask);; slot = (slot + 1) & mask)
+    {
+        const CachedContact& entry = entries[slot];
+        if (entry.stamp != previous->stamp)
+        {
+            return nullptr;
+        }
+        if (entry.key == key)
+        {
+            return &entry;
+        }
+    }
+}
+
+CachedContact& ContactCache::store(unsigned long long key)
+{
+    if ((current->count + 1) * 2 > (int)current->entries.size())
+    {
+        grow(*current);
+    }
+
+    std::vector<CachedContact>& entries = current->entries;
+    unsigned int mask = (unsigned int)entries.size() - 1;
+
+    for (unsigned int slot = slotFor(key, mask);; slot = (slot + 1) & mask)
+    {
+        CachedContact& entry = entries[slot];
+        if (entry.stamp != current->stamp)
+        {
+            entry = CachedContact();
+            entry.key = key;
+            entry.stamp = current->stamp;
+            ++current->count;
+            return entry;
+        }
+        if (entry.key == key)
+        {
+            return entry;
+        }
+    }
+}
+
+//twice the size, with the current entries put back in their new slots
+void ContactCache::grow(Table& table)
+{
+    std::vector<CachedContact> old_entries;
+    old_entries.swap(table.entries);
+
+    table.entries.resize(old_entries.size() * 2);
+    for (CachedContact& entry : table.entries)
+    {
+        entry.stamp = 0;
+    }
+
+    unsigned int mask = (unsigned int)table.entries.size() - 1;
+    for (const CachedContact& entry : old_entries)
+    {
+        if (entry.stamp != table.stamp)
+        {
+            continue;
+        }
+
+        unsigned int slot = slotFor(entry.key, mask);
+        while (table.entries[slot].stamp == table.stamp)
+        {
+            slot = (slot + 1) & mask;
+        }
+        table.entries[slot] = entry;
+    }
+}
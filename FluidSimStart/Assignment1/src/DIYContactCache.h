@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+//what is kept of a contact from one update to the next
+struct CachedContact
+{
+    unsigned long long key;         //see ContactCache::pairKey
+    unsigned int generation1;       //of the two bodies, so a contact isn't carried over to a body
+    unsigned int generation2;       //that has since taken a removed one's slot
+    int feature;                    //which part of the shapes touched, a box corner say
+
+    glm::vec2 point;
+    glm::vec2 normal;
+
+    float normal_impulse;
+    float tangent_impulse;
+
+    unsigned int stamp;             //of the update it was stored in, see ContactCache
+};
+
+//the contacts of the last update and this one, by pair of ids. each update's contacts go in a flat
+//open addressed table, and the two tables swap places every update, so the last update's contacts are
+//dropped by moving on rather than by clearing anything. an entry only counts if it has its table's
+//current stamp. tables grow when they get half full and are never shrunk, so once a scene has had its
+//busiest update nothing is allocated
+class ContactCache
+{
+public:
+    ContactCache();
+
+    //the contacts stored so far become the last update's, and this update's start out empty
+    void beginUpdate();
+
+    //the last update's contact for the key, 0 if there wasn't one
+    const CachedContact* findPrevious(unsigned long long key) const;
+
+    //this update's contact for the key, made with everything past the key zeroed if it isn't there yet
+    CachedContact& store(unsigned long long key);
+
+    int size() const { return current->count; }
+
+    //a key for a pair of ids. they are packed whole, in order, so it is unique to the pair
+    static unsigned long long pairKey(int id1, int id2)
+    {
+        return ((unsigned long long)(unsigned int)id1 << 32) | (unsigned int)id2;
+    }
+
+private:
+    struct Table
+    {
+        std::vector<CachedContact> entries;     //a power of two of them
+        unsigned int stamp = 1;
+        int count = 0;
+    };
+
+    static unsigned int slotFor(unsigned long long key, unsigned int mask);
+    void grow(Table& table);
+
+    Table tables[2];
+    Table* current;
+    Table* previous;
+};
@@ -1,20 +1,36 @@
 #include "DIYFluid.h"
+#include "FluidWorkers.h"
 
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#ifndef DIYFLUID_HEADLESS
 #include "gl_core_4_4.h"
 #include "Utilities.h"
+#endif
+
+//milliseconds since some fixed point, only used to time the update stages
+static double FluidTimeMS()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(high_resolution_clock::now().time_since_epoch()).count();
+}
 
 void DIYFluid::SwapColors()
 {
-	glm::vec3 *tmp = this->front_cells.dye_colour;
-	this->front_cells.dye_colour = this->back_cells.dye_colour;
-	this->back_cells.dye_colour = tmp;
+	std::swap(this->front_cells.dye_r, this->back_cells.dye_r);
+	std::swap(this->front_cells.dye_g, this->back_cells.dye_g);
+	std::swap(this->front_cells.dye_b, this->back_cells.dye_b);
+	std::swap(this->front_cells.dye_half_r, this->back_cells.dye_half_r);
+	std::swap(this->front_cells.dye_half_g, this->back_cells.dye_half_g);
+	std::swap(this->front_cells.dye_half_b, this->back_cells.dye_half_b);
 }
 
 void DIYFluid::SwapVelocities()
 {
-	glm::vec2 *tmp = this->front_cells.velocity;
-	this->front_cells.velocity = this->back_cells.velocity;
-	this->back_cells.velocity = tmp;
+	std::swap(this->front_cells.velocity_x, this->back_cells.velocity_x);
+	std::swap(this->front_cells.velocity_y, this->back_cells.velocity_y);
 }
 
 void DIYFluid::SwapPressures()
@@ -24,362 +40,3270 @@ void DIYFluid::SwapPressures()
 	this->back_cells.pressure = tmp;
 }
 
-DIYFluid::DIYFluid(int _width, int _height, float _viscosity, float _cell_dist)
+DIYFluid::DIYFluid(int _width, int _height, float _viscosity, float _cell_dist, int _thread_count)
 {
 	this->width = _width;
 	this->height = _height;
 	this->viscosity = _viscosity;
 	this ->cell_dist = _cell_dist;
 
-	int cell_count = _width * _height;
+	//room for the extra column of u faces GRID_STAGGERED needs
+	this->pitch = FluidRowPitch(_width + 1);
 
-	this->front_cells.velocity = new glm::vec2[cell_count];
-	this->front_cells.dye_colour = new glm::vec3[cell_count];
-	this->front_cells.pressure = new float[cell_count];
-
-	this->back_cells.velocity = new glm::vec2[cell_count];
-	this->back_cells.dye_colour = new glm::vec3[cell_count];
-	this->back_cells.pressure = new float[cell_count];
+	FluidCells* both_cells[2] = { &this->front_cells, &this->back_cells };
+	for (int i = 0; i < 2; ++i)
+	{
+		both_cells[i]->pressure = AllocFluidPlane(this->pitch, _height);
+		both_cells[i]->velocity_x = AllocFluidPlane(this->pitch, _height + 1);
+		both_cells[i]->velocity_y = AllocFluidPlane(this->pitch, _height + 1);
+		both_cells[i]->dye_r = AllocFluidPlane(this->pitch, _height);
+		both_cells[i]->dye_g = AllocFluidPlane(this->pitch, _height);
+		both_cells[i]->dye_b = AllocFluidPlane(this->pitch, _height);
+		both_cells[i]->dye_half_r = 0;
+		both_cells[i]->dye_half_g = 0;
+		both_cells[i]->dye_half_b = 0;
+	}
 
-	this->divergence = new float[cell_count];
+	this->divergence = AllocFluidPlane(this->pitch, _height);
+	this->diffuse_source_x = AllocFluidPlane(this->pitch, _height + 1);
+	this->diffuse_source_y = AllocFluidPlane(this->pitch, _height + 1);
 
-	memset(this->front_cells.velocity, 0, sizeof(glm::vec2) * cell_count);
-	memset(this->front_cells.dye_colour, 0, sizeof(glm::vec3) * cell_count);
-	memset(this->front_cells.pressure, 0, sizeof(float) * cell_count);
+	for (int y = 0; y < this->height; y++)
+	{
+		for (int x = 0; x < this->width; x++)
+		{
+			int i = x + y * this->pitch;
+			front_cells.dye_r[i] = (float)x;
+			front_cells.dye_g[i] = (float)y;
+			front_cells.pressure[i] = 1;
+		}
+	}
 
-	memset(this->back_cells.velocity, 0, sizeof(glm::vec2) * cell_count);
-	memset(this->back_cells.dye_colour, 0, sizeof(glm::vec3) * cell_count);
-	memset(this->back_cells.pressure, 0, sizeof(float)* cell_count);
+	this->vorticity_confinement = 0;
+	this->curl = 0;
+
+	this->layout = GRID_COLLOCATED;
+	this->advection = ADVECT_SEMI_LAGRANGIAN;
+	memset(&this->advect_cells, 0, sizeof(FluidCells));
+
+	this->dye_format = DYE_FLOAT32;
+	this->dye_storage = DYE_FLOAT32;
+
+	this->fixed_dt = 1.0f / 60.0f;
+	this->cfl_number = 1.0f;
+	this->max_substeps = 4;
+	this->max_frame_updates = 8;
+	this->step_accumulator = 0;
+	this->step_dt = this->fixed_dt;
+	this->frame_steps = 0;
+	this->frame_updates = 0;
+	this->frame_dropped_time = 0;
+
+	this->smoother = SMOOTH_JACOBI;
+	this->diffuse_omega = 1.0f;
+	this->pressure_omega = 1.8f;
+
+	this->tile_size = 256;
+	this->tile_sweeps = 16;
+	this->tile_scratch = 0;
+	this->tile_scratch_floats = 0;
+
+	this->diffuse_tolerance = 1e-3f;
+	this->max_diffuse_iterations = 50;
+	this->diffuse_iterations_used = 0;
+	this->diffuse_iterations_needed = 0;
+	this->diffuse_residual = 0;
+
+	this->pressure_solver = PRESSURE_JACOBI;
+	this->pressure_tolerance = 1e-3f;
+	this->max_pressure_iterations = 60;
+	this->max_vcycles = 10;
+	this->max_pcg_iterations = 200;
+	this->pressure_iterations_used = 0;
+	this->pressure_iterations_needed = 0;
+	this->pressure_residual = 0;
+
+	//build the multigrid hierarchy, halving while the grid divides evenly and is
+	//still big enough to be worth coarsening
+	this->level_count = 1;
+	for (int w = _width, h = _height; w >= 8 && h >= 8 && w % 2 == 0 && h % 2 == 0; w /= 2, h /= 2)
+	{
+		this->level_count++;
+	}
 
-	memset(this->divergence, 0, sizeof(float) * cell_count);
+	this->levels = new FluidGridLevel[this->level_count];
 
-	for (int i = 0; i < this->width * this->height; i++)
+	for (int level = 0; level < this->level_count; ++level)
 	{
-		float x = (float)(i % width);
-		float y = (float)(i / width);
-		front_cells.dye_colour[i] = glm::vec3(x, y, 0);
-		front_cells.pressure[i] = 1;
-	}
+		FluidGridLevel* grid = this->levels + level;
+
+		if (level == 0)
+		{
+			grid->width = _width;
+			grid->height = _height;
+			grid->pitch = this->pitch;
+			grid->cell_dist = _cell_dist;
+
+			//level 0 solves straight into front_cells.pressure against divergence
+			grid->pressure = 0;
+			grid->rhs = 0;
+		}
+		else
+		{
+			grid->width = this->levels[level - 1].width / 2;
+			grid->height = this->levels[level - 1].height / 2;
+			grid->pitch = FluidRowPitch(grid->width);
+			grid->cell_dist = this->levels[level - 1].cell_dist * 2.0f;
 
+			grid->pressure = AllocFluidPlane(grid->pitch, grid->height);
+			grid->rhs = AllocFluidPlane(grid->pitch, grid->height);
+		}
 
+		grid->residual = AllocFluidPlane(grid->pitch, grid->height);
+	}
 
+	this->pcg_precon = 0;
+	this->pcg_residual = 0;
+	this->pcg_aux = 0;
+	this->pcg_search = 0;
+	this->pcg_tau = 0.97f;
+	this->pcg_precon_dirty = true;
+
+	//everything starts as fluid, which gives the plain edge and interior spans
+	this->cell_types = new unsigned char[this->pitch * _height];
+	this->span_types = new unsigned char[this->pitch * _height];
+	memset(this->cell_types, CELL_FLUID, this->pitch * _height);
+	this->obstacle_velocity_x = AllocFluidPlane(this->pitch, _height);
+	this->obstacle_velocity_y = AllocFluidPlane(this->pitch, _height);
+	this->inflow_dye = glm::vec3(1, 1, 1);
+	this->cell_types_changed = false;
+	BuildSpans();
+
+	//every tile starts live, so the first sparse frame runs everywhere and finds out what's quiet
+	this->sparse_tiles = false;
+	this->activity_threshold = 1e-3f;
+	this->sparse_running = false;
+	this->tiles_x = (_width + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+	this->tiles_y = (_height + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+	this->tile_active.assign(this->tiles_x * this->tiles_y, 1);
+	this->tile_live.assign(this->tiles_x * this->tiles_y, 1);
+	this->tile_row_live.assign(this->tiles_y, this->tiles_x);
+	this->live_tile_count = this->tiles_x * this->tiles_y;
+
+	this->stage_spans = &this->spans;
+	this->stage_row_spans = &this->row_spans;
+	this->stage_cell_count = _width * _height;
+
+	this->workers = new FluidWorkers(_thread_count);
+	this->kernels = SelectFluidKernels();
+
+	memset(&this->timings, 0, sizeof(FluidStageTimings));
+	this->program = 0;
+	this->texture = 0;
+	this->quad_vao = 0;
+	this->upload_buffers[0] = 0;
+	this->upload_buffers[1] = 0;
+	this->upload_index = 0;
+
+#ifndef DIYFLUID_HEADLESS
 	LoadShader("./shaders/simple_vertex.vs", 0, "./shaders/simple_texture.fs", &this->program);
+
+	//storage only, RenderFluid fills it in with glTexSubImage2D. uploads are RGBA since 4 byte
+	//pixels are what the conversion kernels write and what the driver wants anyway
+	this->texture = CreateGLTextureBasic(0, _width, _height, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	this->quad_vao = BuildQuadGLVAO(5.0f);
+
+	glGenBuffers(2, this->upload_buffers);
+	for (int i = 0; i < 2; ++i)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->upload_buffers[i]);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, _width * _height * 4, 0, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
 }
 
 DIYFluid::~DIYFluid()
 {
-	delete[] this->divergence;
+	FreeFluidPlane(this->divergence);
+	FreeFluidPlane(this->diffuse_source_x);
+	FreeFluidPlane(this->diffuse_source_y);
 
-	//front cells
-	delete[] this->front_cells.dye_colour;
-	delete[] this->front_cells.velocity;
-	delete[] this->front_cells.pressure;
+	FluidCells* both_cells[2] = { &this->front_cells, &this->back_cells };
+	for (int i = 0; i < 2; ++i)
+	{
+		FreeFluidPlane(both_cells[i]->pressure);
+		FreeFluidPlane(both_cells[i]->velocity_x);
+		FreeFluidPlane(both_cells[i]->velocity_y);
+	}
 
-	//back cells
-	delete[] this->back_cells.dye_colour;
-	delete[] this->back_cells.velocity;
-	delete[] this->back_cells.pressure;
-}
+	FluidCells* dye_cells[3] = { &this->front_cells, &this->back_cells, &this->advect_cells };
+	for (int i = 0; i < 3; ++i)
+	{
+		if (dye_cells[i]->dye_r)
+		{
+			FreeFluidPlane(dye_cells[i]->dye_r);
+			FreeFluidPlane(dye_cells[i]->dye_g);
+			FreeFluidPlane(dye_cells[i]->dye_b);
+		}
+		if (dye_cells[i]->dye_half_r)
+		{
+			FreeHalfPlane(dye_cells[i]->dye_half_r);
+			FreeHalfPlane(dye_cells[i]->dye_half_g);
+			FreeHalfPlane(dye_cells[i]->dye_half_b);
+		}
+	}
 
-void DIYFluid::UpdateFluid(float dt)
-{
-	Advect(dt);
-	SwapVelocities();
-	SwapColors();
+	if (this->advect_cells.velocity_x)
+	{
+		FreeFluidPlane(this->advect_cells.velocity_x);
+		FreeFluidPlane(this->advect_cells.velocity_y);
+	}
 
-	for (int diffuse_step = 0; diffuse_step < 50; ++diffuse_step)
+	for (int level = 0; level < this->level_count; ++level)
 	{
-		Diffuse(dt);
-		SwapVelocities();
+		if (level > 0)
+		{
+			FreeFluidPlane(this->levels[level].pressure);
+			FreeFluidPlane(this->levels[level].rhs);
+		}
+		FreeFluidPlane(this->levels[level].residual);
 	}
+	delete[] this->levels;
 
-	Divergence(dt);
+	if (this->pcg_precon)
+	{
+		FreeFluidPlane(this->pcg_precon);
+		FreeFluidPlane(this->pcg_residual);
+		FreeFluidPlane(this->pcg_aux);
+		FreeFluidPlane(this->pcg_search);
+	}
 
-	for (int diffuse_step = 0; diffuse_step < 60; ++diffuse_step)
+	if (this->tile_scratch)
 	{
-		UpdatePressure(dt);
-		SwapPressures();
+		FreeFluidPlane(this->tile_scratch);
 	}
 
-	ApplyPressure(dt);
-	SwapVelocities();
+	if (this->curl)
+	{
+		FreeFluidPlane(this->curl);
+	}
 
-	UpdateBoundary();
+	delete[] this->cell_types;
+	delete[] this->span_types;
+	FreeFluidPlane(this->obstacle_velocity_x);
+	FreeFluidPlane(this->obstacle_velocity_y);
+
+	delete this->workers;
+
+#ifndef DIYFLUID_HEADLESS
+	//BuildQuadGLVAO doesn't hand back its vertex buffer, find it through the vao
+	GLint quad_vbo = 0;
+	glBindVertexArray(this->quad_vao);
+	glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &quad_vbo);
+	glBindVertexArray(0);
+
+	GLuint quad_buffer = (GLuint)quad_vbo;
+	glDeleteBuffers(1, &quad_buffer);
+	glDeleteVertexArrays(1, &this->quad_vao);
+	glDeleteBuffers(2, this->upload_buffers);
+	glDeleteTextures(1, &this->texture);
+#endif
+}
 
-	int box_size = 10;
-	int half_box_size = box_size / 2;
+void DIYFluid::SetThreadCount(int thread_count)
+{
+	delete this->workers;
+	this->workers = new FluidWorkers(thread_count);
+}
+
+void DIYFluid::SetSimd(FluidSimd simd)
+{
+	this->kernels = GetFluidKernels(simd);
+}
+
+void DIYFluid::StoreDye(FluidDyeFormat format)
+{
+	if (format == this->dye_storage)
+	{
+		return;
+	}
 
-	for (int x = width / 2 - half_box_size; x < width / 2 + half_box_size; ++x)
+	FluidCells* both_cells[2] = { &this->front_cells, &this->back_cells };
+	for (int i = 0; i < 2; ++i)
 	{
-		for (int y = 5; y < 5 + box_size; y++)
+		float** planes[3] = { &both_cells[i]->dye_r, &both_cells[i]->dye_g, &both_cells[i]->dye_b };
+		unsigned short** half_planes[3] = { &both_cells[i]->dye_half_r, &both_cells[i]->dye_half_g, &both_cells[i]->dye_half_b };
+
+		for (int c = 0; c < 3; ++c)
 		{
-			int cell_index = x + y * this->width;
-			this->front_cells.velocity[cell_index].y += 10 * dt;
+			if (format == DYE_FLOAT16)
+			{
+				*half_planes[c] = AllocHalfPlane(this->pitch, this->height);
+			}
+			else
+			{
+				*planes[c] = AllocFluidPlane(this->pitch, this->height);
+			}
+
+			this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+			{
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					int row = y * this->pitch;
+					if (format == DYE_FLOAT16)
+					{
+						this->kernels->float_to_half_row(*planes[c] + row, *half_planes[c] + row, this->width);
+					}
+					else
+					{
+						this->kernels->half_to_float_row(*half_planes[c] + row, *planes[c] + row, this->width);
+					}
+				}
+			});
+
+			if (format == DYE_FLOAT16)
+			{
+				FreeFluidPlane(*planes[c]);
+				*planes[c] = 0;
+			}
+			else
+			{
+				FreeHalfPlane(*half_planes[c]);
+				*half_planes[c] = 0;
+			}
 		}
 	}
+
+	//maccormack's scratch is remade in the new format the next time it's needed
+	if (this->advect_cells.dye_r)
+	{
+		FreeFluidPlane(this->advect_cells.dye_r);
+		FreeFluidPlane(this->advect_cells.dye_g);
+		FreeFluidPlane(this->advect_cells.dye_b);
+		this->advect_cells.dye_r = 0;
+		this->advect_cells.dye_g = 0;
+		this->advect_cells.dye_b = 0;
+	}
+	if (this->advect_cells.dye_half_r)
+	{
+		FreeHalfPlane(this->advect_cells.dye_half_r);
+		FreeHalfPlane(this->advect_cells.dye_half_g);
+		FreeHalfPlane(this->advect_cells.dye_half_b);
+		this->advect_cells.dye_half_r = 0;
+		this->advect_cells.dye_half_g = 0;
+		this->advect_cells.dye_half_b = 0;
+	}
+
+	this->dye_storage = format;
 }
 
-//update parts
-void DIYFluid::Advect(float dt)
+void DIYFluid::UpdateFluid(float dt)
 {
-	//loop over every cell
-	for (int y = 0; y < this->height; ++y)
+	double stage_start = FluidTimeMS();
+	double stage_end;
+
+	if (this->dye_format != this->dye_storage)
 	{
-		for (int x = 0; x < this->width; ++x)
+		StoreDye(this->dye_format);
+	}
+
+	//set and cleared cells can add up to no change, as when obstacles are redrawn where they were
+	if (this->cell_types_changed)
+	{
+		this->cell_types_changed = false;
+		if (memcmp(this->cell_types, this->span_types, this->pitch * this->height) != 0)
 		{
+			BuildSpans();
+		}
+	}
 
-			//find the point to sample for this cell
-			int cell_index = x + y * this->width;
+	if (this->sparse_tiles && SparseSupported())
+	{
+		if (!this->sparse_running)
+		{
+			std::fill(this->tile_active.begin(), this->tile_active.end(), 1);
+			std::fill(this->tile_live.begin(), this->tile_live.end(), 1);
+			std::fill(this->tile_row_live.begin(), this->tile_row_live.end(), this->tiles_x);
+			this->live_tile_count = this->tiles_x * this->tiles_y;
+			this->sparse_running = true;
+		}
 
-			glm::vec2 vel = this->front_cells.velocity[cell_index] * dt;
-			glm::vec2 sample_point = glm::vec2((float)x - vel.x / this->cell_dist, 
-											   (float)y - vel.y / this->cell_dist);
+		BuildLiveSpans();
+		this->stage_spans = &this->live_spans;
+		this->stage_row_spans = &this->live_row_spans;
+	}
+	else
+	{
+		this->sparse_running = false;
+		this->stage_spans = &this->spans;
+		this->stage_row_spans = &this->row_spans;
+		this->stage_cell_count = this->width * this->height;
+	}
 
-			sample_point.x = glm::clamp(sample_point.x, 0.0f, (float)this->width - 1);
-			sample_point.y = glm::clamp(sample_point.y, 0.0f, (float)this->height - 1);
+	Advect(dt);
+	SwapVelocities();
+	SwapColors();
 
-			//read each value from front_cells and store in back_cells
-				//computing bilerp for the points
-			glm::vec2 bl = glm::vec2(floorf(sample_point.x), floorf(sample_point.y));
-			glm::vec2 br = bl + glm::vec2(1, 0);
-			glm::vec2 tl = bl + glm::vec2(0, 1);
-			glm::vec2 tr = bl + glm::vec2(1, 1);
+	//both sets of velocities, the jacobi solves read fixed cells from either
+	ApplyObstacles(&this->front_cells);
+	ApplyObstacles(&this->back_cells);
 
-			//get indices
-			int bli = (int)bl.x + this->width * (int)bl.y;
-			int bri = (int)br.x + this->width * (int)br.y;
-			int tli = (int)tl.x + this->width * (int)tl.y;
-			int tri = (int)tr.x + this->width * (int)tr.y;
+	stage_end = FluidTimeMS();
+	this->timings.advect_ms = stage_end - stage_start;
+	stage_start = stage_end;
 
-			//get fract
-			glm::vec2 sample_fract = sample_point - bl;
+	SolveDiffusion(dt);
 
+	stage_end = FluidTimeMS();
+	this->timings.diffuse_ms = stage_end - stage_start;
+	stage_start = stage_end;
 
-			glm::vec3 dye_b = glm::mix(this->front_cells.dye_colour[bli], this->front_cells.dye_colour[bri], sample_fract.x);
-			glm::vec3 dye_t = glm::mix(this->front_cells.dye_colour[tli], this->front_cells.dye_colour[tri], sample_fract.x);
-					
-			glm::vec3 new_dye = glm::mix(dye_b, dye_t, sample_fract.y);
+	Divergence(dt);
 
-			this->back_cells.dye_colour[cell_index] = new_dye;
+	stage_end = FluidTimeMS();
+	this->timings.divergence_ms = stage_end - stage_start;
+	stage_start = stage_end;
 
-			//vel
+	SolvePressure(dt);
 
-			glm::vec2 vel_b = glm::mix(this->front_cells.velocity[bli], this->front_cells.velocity[bri], sample_fract.x);
-			glm::vec2 vel_t = glm::mix(this->front_cells.velocity[tli], this->front_cells.velocity[tri], sample_fract.x);
+	stage_end = FluidTimeMS();
+	this->timings.pressure_ms = stage_end - stage_start;
+	stage_start = stage_end;
 
-			glm::vec2 new_vel = glm::mix(vel_b, vel_t, sample_fract.y);
+	ApplyPressure(dt);
+	SwapVelocities();
 
-			this->back_cells.velocity[cell_index] = new_vel;
+	stage_end = FluidTimeMS();
+	this->timings.apply_pressure_ms = stage_end - stage_start;
+	stage_start = stage_end;
 
-		}
+	UpdateBoundary();
+	ApplyObstacles(&this->front_cells);
+
+	stage_end = FluidTimeMS();
+	this->timings.boundary_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	//ahead of the next frame's advection and projection
+	AddForces(dt);
+
+	stage_end = FluidTimeMS();
+	this->timings.forces_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	if (this->sparse_running)
+	{
+		UpdateTileActivity();
 	}
+
+	this->timings.tiles_ms = FluidTimeMS() - stage_start;
 }
 
-void DIYFluid::Diffuse(float dt)
+int DIYFluid::AdvanceFluid(float frame_dt)
 {
-	float inv_vdt = 1.0f / (this->viscosity * dt);
+	this->step_accumulator += glm::max(frame_dt, 0.0f);
+	this->frame_steps = 0;
+	this->frame_updates = 0;
+	this->frame_dropped_time = 0;
 
-	for (int y = 0; y < this->height; ++y)
+	int max_substeps = glm::clamp(this->max_substeps, 1, glm::max(this->max_frame_updates, 1));
+
+	while (this->step_accumulator >= this->fixed_dt)
 	{
-		for (int x = 0; x < this->width; ++x)
+		//enough substeps that nothing crosses more than cfl_number cells in one. written so that
+		//an infinite or nan speed takes the most substeps rather than overflowing the cast
+		float wanted = ceilf(MaxCellSpeed() * this->fixed_dt / this->cfl_number);
+		int substeps = wanted < max_substeps ? glm::max((int)wanted, 1) : max_substeps;
+
+		if (this->frame_updates + substeps > this->max_frame_updates)
+		{
+			break;
+		}
+
+		this->step_dt = this->fixed_dt / substeps;
+		for (int substep = 0; substep < substeps; ++substep)
 		{
-			int cell_index = x + y * this->width;
+			UpdateFluid(this->step_dt);
+		}
 
-			int xp1 = glm::clamp(x + 1, 0, this->width - 1);
-			int xm1 = glm::clamp(x - 1, 0, this->width - 1);
-			int yp1 = glm::clamp(y + 1, 0, this->height - 1);
-			int ym1 = glm::clamp(y + 1, 0, this->height - 1);
+		this->step_accumulator -= this->fixed_dt;
+		this->frame_steps += 1;
+		this->frame_updates += substeps;
+	}
 
-			//gather the 4 velocities around us
-			int up = x + yp1 * this->width;
-			int down = x + ym1 * this->width;
-			int right = xp1 + y * this->width;
-			int left = xm1 + y * this->width;
+	//out of budget, whatever is left over a partial step is let go
+	if (this->step_accumulator >= this->fixed_dt)
+	{
+		this->frame_dropped_time = this->step_accumulator - fmodf(this->step_accumulator, this->fixed_dt);
+		this->step_accumulator -= this->frame_dropped_time;
+	}
 
-			glm::vec2 vel_up = this->front_cells.velocity[up];
-			glm::vec2 vel_down = this->front_cells.velocity[down];
-			glm::vec2 vel_left = this->front_cells.velocity[left];
-			glm::vec2 vel_right = this->front_cells.velocity[right];
-			glm::vec2 vel_centre = this->front_cells.velocity[cell_index];
+	return this->frame_updates;
+}
 
-			//out in equation
-			float denom = 1.0f /(4 + inv_vdt);
+//runs a row kernel that returns a partial sum on every band, then adds the bands up in order
+//so the total comes out the same from run to run
+static float ParallelSum(FluidWorkers* workers, int row_count, const std::function<float(int, int)>& kernel)
+{
+	float band_sums[FluidWorkers::MAX_THREADS];
+	int bands = workers->BandCount(row_count);
 
-			glm::vec2 diffused_velocity = (vel_up + vel_right + vel_down + vel_left + vel_centre * inv_vdt) * denom;
+	workers->ParallelRows(row_count, [&](int y_begin, int y_end, int band)
+	{
+		band_sums[band] = kernel(y_begin, y_end);
+	});
 
-			this->back_cells.velocity[cell_index] = diffused_velocity;
-		}
+	float sum = 0;
+	for (int band = 0; band < bands; ++band)
+	{
+		sum += band_sums[band];
 	}
+	return sum;
 }
 
-void DIYFluid::Divergence(float dt)
+//the largest of what a row kernel returns on every band
+static float ParallelMax(FluidWorkers* workers, int row_count, const std::function<float(int, int)>& kernel)
 {
-	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+	float band_maxes[FluidWorkers::MAX_THREADS];
+	int bands = workers->BandCount(row_count);
 
-	for (int y = 0; y < this->height; ++y)
+	workers->ParallelRows(row_count, [&](int y_begin, int y_end, int band)
 	{
-		for (int x = 0; x < this->width; ++x)
-		{
-			int cell_index = x + y * this->width;
+		band_maxes[band] = kernel(y_begin, y_end);
+	});
 
-			int xp1 = glm::clamp(x + 1, 0, this->width - 1);
-			int xm1 = glm::clamp(x - 1, 0, this->width - 1);
-			int yp1 = glm::clamp(y + 1, 0, this->height - 1);
-			int ym1 = glm::clamp(y + 1, 0, this->height - 1);
+	float m = 0;
+	for (int band = 0; band < bands; ++band)
+	{
+		m = glm::max(m, band_maxes[band]);
+	}
+	return m;
+}
 
-			//gather the 4 velocities around us
-			int up = x + yp1 * this->width;
-			int down = x + ym1 * this->width;
-			int right = xp1 + y * this->width;
-			int left = xm1 + y * this->width;
+//sum of squares over the cells of a plane that the spans cover, whatever their kind
+static float SumSquares(FluidWorkers* workers, const float* values, const std::vector<FluidSpan>& spans, const std::vector<int>& row_spans, int height, int pitch)
+{
+	return ParallelSum(workers, height, [&](int y_begin, int y_end) -> float
+	{
+		float sum_sq = 0;
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			const float* row = values + y * pitch;
+			for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+			{
+				for (int x = spans[s].begin; x < spans[s].end; ++x)
+				{
+					sum_sq += row[x] * row[x];
+				}
+			}
+		}
+		return sum_sq;
+	});
+}
 
-			float vel_up = this->front_cells.velocity[up].y;
-			float vel_down = this->front_cells.velocity[down].y;
-			float vel_left = this->front_cells.velocity[left].x;
-			float vel_right = this->front_cells.velocity[right].x;
+//|u| + |v| bounds the speed of every cell, and of anything sampled between them, on either layout.
+//the staggered faces past the last row and column are walls and always 0 so they are left out
+float DIYFluid::MaxCellSpeed()
+{
+	float max_u = ParallelMax(this->workers, this->height, [&](int y_begin, int y_end) -> float
+	{
+		float m = 0;
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			m = glm::max(m, this->kernels->max_abs_row(this->front_cells.velocity_x + y * this->pitch, this->width));
+		}
+		return m;
+	});
+	float max_v = ParallelMax(this->workers, this->height, [&](int y_begin, int y_end) -> float
+	{
+		float m = 0;
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			m = glm::max(m, this->kernels->max_abs_row(this->front_cells.velocity_y + y * this->pitch, this->width));
+		}
+		return m;
+	});
 
-			float divergence = (vel_right - vel_left) + (vel_up - vel_down) * inv_cell_dist;
+	return (max_u + max_v) / this->cell_dist;
+}
 
-			this->divergence[cell_index] = divergence;
+//runs rows [y_begin, y_end) of a stencil stage span by span, see DIYFluid::BuildSpans. cells of
+//edge spans have neighbours off the grid or that aren't fluid and go through edge_cell(x, y) one at
+//a time, interior spans are handed to interior(y, x_begin, x_end) as one run, and fixed spans are left alone.
+//returns the sum of what they all return, added up in the same order whichever kernels are in use
+static float StencilRows(const std::vector<FluidSpan>& spans, const std::vector<int>& row_spans, int y_begin, int y_end,
+						 const std::function<float(int, int)>& edge_cell,
+						 const std::function<float(int, int, int)>& interior)
+{
+	float sum = 0;
 
+	for (int y = y_begin; y < y_end; ++y)
+	{
+		for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+		{
+			const FluidSpan& span = spans[s];
+
+			if (span.kind == SPAN_INTERIOR)
+			{
+				sum += interior(y, span.begin, span.end);
+			}
+			else if (span.kind == SPAN_EDGE)
+			{
+				for (int x = span.begin; x < span.end; ++x)
+				{
+					sum += edge_cell(x, y);
+				}
+			}
 		}
 	}
+
+	return sum;
 }
 
-void DIYFluid::UpdatePressure(float dt)
+//StencilRows for one colour of a red-black sweep, the cells whose x + y + colour is even. edge cells
+//of the colour go through edge_cell(x, y), and interior spans are handed to interior(y, x_begin, x_end)
+//from their first cell of the colour for the kernels to take every other cell from there
+static float ColourRows(const std::vector<FluidSpan>& spans, const std::vector<int>& row_spans, int y_begin, int y_end, int colour,
+						const std::function<float(int, int)>& edge_cell,
+						const std::function<float(int, int, int)>& interior)
 {
-	for (int y = 0; y < this->height; ++y)
+	float sum = 0;
+
+	for (int y = y_begin; y < y_end; ++y)
 	{
-		for (int x = 0; x < this->width; ++x)
+		for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
 		{
-			int cell_index = x + y * this->width;
+			const FluidSpan& span = spans[s];
+			int first = span.begin + ((span.begin + y + colour) & 1);
+
+			if (span.kind == SPAN_INTERIOR)
+			{
+				if (first < span.end)
+				{
+					sum += interior(y, first, span.end);
+				}
+			}
+			else if (span.kind == SPAN_EDGE)
+			{
+				for (int x = first; x < span.end; x += 2)
+				{
+					sum += edge_cell(x, y);
+				}
+			}
+		}
+	}
 
-			int xp1 = glm::clamp(x + 1, 0, this->width - 1);
-			int xm1 = glm::clamp(x - 1, 0, this->width - 1);
-			int yp1 = glm::clamp(y + 1, 0, this->height - 1);
-			int ym1 = glm::clamp(y + 1, 0, this->height - 1);
+	return sum;
+}
 
-			//gather the 4 velocities around us
-			int up = x + yp1 * this->width;
-			int down = x + ym1 * this->width;
-			int right = xp1 + y * this->width;
-			int left = xm1 + y * this->width;
+//which span a cell belongs in
+static FluidSpanKind CellSpanKind(const unsigned char* types, int x, int y, int width, int height, int pitch)
+{
+	int i = x + y * pitch;
 
-			float p_up = this->front_cells.pressure[up];
-			float p_down = this->front_cells.pressure[down];
-			float p_left = this->front_cells.pressure[left];
-			float p_right = this->front_cells.pressure[right];
+	if (types[i] & CELL_FIXED_VELOCITY)
+	{
+		return SPAN_FIXED;
+	}
+	if (types[i] != CELL_FLUID || x == 0 || y == 0 || x == width - 1 || y == height - 1)
+	{
+		return SPAN_EDGE;
+	}
+	if (types[i - 1] | types[i + 1] | types[i - pitch] | types[i + pitch])
+	{
+		return SPAN_EDGE;
+	}
+	return SPAN_INTERIOR;
+}
 
-			float d = this->divergence[cell_index];
+void DIYFluid::BuildSpans()
+{
+	this->spans.clear();
+	this->outflow_cells.clear();
+	this->row_spans.resize(this->height + 1);
+	this->has_obstacles = false;
 
-			float new_pressure = (p_up + p_down + p_left + p_right - d * this->cell_dist * this->cell_dist) * 0.25f;
+	for (int y = 0; y < this->height; ++y)
+	{
+		this->row_spans[y] = (int)this->spans.size();
 
-			this->back_cells.pressure[cell_index] = new_pressure;
+		for (int x = 0; x < this->width; ++x)
+		{
+			int i = x + y * this->pitch;
+			FluidSpanKind kind = CellSpanKind(this->cell_types, x, y, this->width, this->height, this->pitch);
+
+			if (this->cell_types[i] != CELL_FLUID)
+			{
+				this->has_obstacles = true;
+			}
+			if (this->cell_types[i] & CELL_OUTFLOW)
+			{
+				this->outflow_cells.push_back(i);
+			}
+
+			//spans never carry on from the row before
+			if ((int)this->spans.size() > this->row_spans[y] && this->spans.back().kind == kind)
+			{
+				this->spans.back().end = x + 1;
+			}
+			else
+			{
+				FluidSpan span = { x, x + 1, kind };
+				this->spans.push_back(span);
+			}
+		}
+	}
+	this->row_spans[this->height] = (int)this->spans.size();
 
+	this->has_outflow = !this->outflow_cells.empty();
+	memcpy(this->span_types, this->cell_types, this->pitch * this->height);
+	this->pcg_precon_dirty = true;
 
-		}
+	if (this->has_obstacles)
+	{
+		BuildRegions();
 	}
 }
-void DIYFluid::ApplyPressure(float dt)
+
+//flood fills the cells that aren't solid or inflow into connected groups
+void DIYFluid::BuildRegions()
 {
-	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+	this->cell_regions.assign(this->pitch * this->height, -1);
+	this->region_open.clear();
+
+	std::vector<int> stack;
 
 	for (int y = 0; y < this->height; ++y)
 	{
 		for (int x = 0; x < this->width; ++x)
 		{
-			int cell_index = x + y * this->width;
+			int seed = x + y * this->pitch;
+			if ((this->cell_types[seed] & CELL_FIXED_VELOCITY) || this->cell_regions[seed] >= 0)
+			{
+				continue;
+			}
+
+			int region = (int)this->region_open.size();
+			bool open = false;
+
+			this->cell_regions[seed] = region;
+			stack.push_back(seed);
+
+			while (!stack.empty())
+			{
+				int i = stack.back();
+				stack.pop_back();
+
+				int cx = i % this->pitch;
+				int cy = i / this->pitch;
+				open = open || (this->cell_types[i] & CELL_OUTFLOW) != 0;
+
+				int neighbours[4] = { i - 1, i + 1, i - this->pitch, i + this->pitch };
+				bool on_grid[4] = { cx > 0, cx < this->width - 1, cy > 0, cy < this->height - 1 };
+
+				for (int n = 0; n < 4; ++n)
+				{
+					int j = neighbours[n];
+					if (on_grid[n] && !(this->cell_types[j] & CELL_FIXED_VELOCITY) && this->cell_regions[j] < 0)
+					{
+						this->cell_regions[j] = region;
+						stack.push_back(j);
+					}
+				}
+			}
+
+			this->region_open.push_back(open);
+		}
+	}
+}
 
-			int xp1 = glm::clamp(x + 1, 0, this->width - 1);
-			int xm1 = glm::clamp(x - 1, 0, this->width - 1);
-			int yp1 = glm::clamp(y + 1, 0, this->height - 1);
-			int ym1 = glm::clamp(y + 1, 0, this->height - 1);
+void DIYFluid::SetCellType(int x, int y, unsigned char type, glm::vec2 velocity)
+{
+	int i = x + y * this->pitch;
+	this->cell_types[i] = type;
+	this->obstacle_velocity_x[i] = velocity.x;
+	this->obstacle_velocity_y[i] = velocity.y;
+	this->cell_types_changed = true;
+}
 
-			//gather the 4 velocities around us
-			int up = x + yp1 * this->width;
-			int down = x + ym1 * this->width;
-			int right = xp1 + y * this->width;
-			int left = xm1 + y * this->width;
+void DIYFluid::ClearCellTypes(unsigned char type)
+{
+	for (int y = 0; y < this->height; ++y)
+	{
+		unsigned char* row = this->cell_types + y * this->pitch;
+		for (int x = 0; x < this->width; ++x)
+		{
+			if (row[x] & type)
+			{
+				row[x] = CELL_FLUID;
+				this->cell_types_changed = true;
+			}
+		}
+	}
+}
 
-			float p_up = this->front_cells.pressure[up];
-			float p_down = this->front_cells.pressure[down];
-			float p_left = this->front_cells.pressure[left];
-			float p_right = this->front_cells.pressure[right];
+void DIYFluid::ApplyObstacles(FluidCells* cells)
+{
+	if (!this->has_obstacles)
+	{
+		return;
+	}
 
-			glm::vec2 delta_v = -glm::vec2(p_right - p_left, p_up - p_down) * inv_cell_dist;
+	float inflow[3] = { this->inflow_dye.r, this->inflow_dye.g, this->inflow_dye.b };
+	unsigned short inflow_half[3];
+	this->kernels->float_to_half_row(inflow, inflow_half, 3);
+	bool half_dye = this->dye_storage == DYE_FLOAT16;
 
-			this->back_cells.velocity[cell_index] = this->front_cells.velocity[cell_index] + delta_v;
+	for (int y = 0; y < this->height; ++y)
+	{
+		int row = y * this->pitch;
 
+		for (int s = this->row_spans[y]; s < this->row_spans[y + 1]; ++s)
+		{
+			const FluidSpan& span = this->spans[s];
+			if (span.kind != SPAN_FIXED)
+			{
+				continue;
+			}
+
+			if (this->layout == GRID_STAGGERED)
+			{
+				//every face of the run, the u face on its far side takes the last cell's velocity
+				for (int x = span.begin; x <= span.end; ++x)
+				{
+					cells->velocity_x[row + x] = this->obstacle_velocity_x[row + glm::min(x, span.end - 1)];
+				}
+				for (int x = span.begin; x < span.end; ++x)
+				{
+					cells->velocity_y[row + x] = this->obstacle_velocity_y[row + x];
+					cells->velocity_y[row + this->pitch + x] = this->obstacle_velocity_y[row + x];
+				}
+			}
+			else
+			{
+				size_t run_bytes = sizeof(float) * (span.end - span.begin);
+				memcpy(cells->velocity_x + row + span.begin, this->obstacle_velocity_x + row + span.begin, run_bytes);
+				memcpy(cells->velocity_y + row + span.begin, this->obstacle_velocity_y + row + span.begin, run_bytes);
+			}
+
+			for (int x = span.begin; x < span.end; ++x)
+			{
+				if (!(this->cell_types[row + x] & CELL_INFLOW))
+				{
+					continue;
+				}
+
+				if (half_dye)
+				{
+					cells->dye_half_r[row + x] = inflow_half[0];
+					cells->dye_half_g[row + x] = inflow_half[1];
+					cells->dye_half_b[row + x] = inflow_half[2];
+				}
+				else
+				{
+					cells->dye_r[row + x] = inflow[0];
+					cells->dye_g[row + x] = inflow[1];
+					cells->dye_b[row + x] = inflow[2];
+				}
+			}
 		}
 	}
 }
 
-void DIYFluid::UpdateBoundary()
+//the stages that solve across the whole grid at once, or that don't go by the spans, have
+//nothing to gain from skipping quiet tiles, so those settings run dense
+bool DIYFluid::SparseSupported()
 {
+	return this->layout == GRID_COLLOCATED &&
+		   this->advection == ADVECT_SEMI_LAGRANGIAN &&
+		   this->smoother == SMOOTH_JACOBI &&
+		   this->pressure_solver == PRESSURE_JACOBI &&
+		   this->vorticity_confinement <= 0;
+}
 
-	float* p = this->front_cells.pressure;
-	glm::vec2 *v = this->front_cells.velocity;
+//cuts every span down to the parts over live tiles. neighbouring live tiles are joined back
+//up so the interior runs handed to the kernels stay as long as they can
+void DIYFluid::BuildLiveSpans()
+{
+	this->live_spans.clear();
+	this->live_row_spans.resize(this->height + 1);
+	this->stage_cell_count = 0;
 
-	for (int x = 0; x < this->width; x++)
+	for (int y = 0; y < this->height; ++y)
 	{
+		this->live_row_spans[y] = (int)this->live_spans.size();
 
-		//first rows
-		int first_row_index = x;
-		int second_row_index = x + this->width;
-
-		p[first_row_index] = p[second_row_index];
-		v[first_row_index].x = v[second_row_index].x;
-		v[first_row_index].y = -v[second_row_index].y;
+		int tile_y = y / SPARSE_TILE_SIZE;
+		if (this->tile_row_live[tile_y] == 0)
+		{
+			continue;
+		}
 
-		//last rows
-		int last_row_index = x + (this->height - 1) * this->width;
-		int second_last_row_index = x + (this->height - 2) * this->width;
+		const unsigned char* live = this->tile_live.data() + tile_y * this->tiles_x;
 
-		p[last_row_index] =    p[second_last_row_index];
-		v[last_row_index].x =  v[second_last_row_index].x;
-		v[last_row_index].y = -v[second_last_row_index].y;
+		for (int s = this->row_spans[y]; s < this->row_spans[y + 1]; ++s)
+		{
+			const FluidSpan& span = this->spans[s];
+
+			for (int tile_x = span.begin / SPARSE_TILE_SIZE; tile_x * SPARSE_TILE_SIZE < span.end; ++tile_x)
+			{
+				if (!live[tile_x])
+				{
+					continue;
+				}
+
+				int begin = glm::max(span.begin, tile_x * SPARSE_TILE_SIZE);
+				int end = glm::min(span.end, (tile_x + 1) * SPARSE_TILE_SIZE);
+				this->stage_cell_count += end - begin;
+
+				if ((int)this->live_spans.size() > this->live_row_spans[y] &&
+					this->live_spans.back().kind == span.kind && this->live_spans.back().end == begin)
+				{
+					this->live_spans.back().end = end;
+				}
+				else
+				{
+					FluidSpan piece = { begin, end, span.kind };
+					this->live_spans.push_back(piece);
+				}
+			}
+		}
 	}
+	this->live_row_spans[this->height] = (int)this->live_spans.size();
+}
 
-	for (int y = 0; y < this->height; y++)
+//after a sparse frame. a live tile stays active while any of its velocities is over
+//activity_threshold, and next frame's live tiles are the active ones and their 8 neighbours.
+//a tile that drops out has its front_cells copied to back_cells, so both sets agree wherever
+//the stages don't write and it doesn't matter which one a swap leaves in front
+void DIYFluid::UpdateTileActivity()
+{
+	float threshold = this->activity_threshold;
+
+	//only the live tiles changed, so only they need looking at
+	this->workers->ParallelRows(this->tiles_y, [&](int tile_y_begin, int tile_y_end, int /*band*/)
 	{
-		int first_col_index = 0 + y * this->width;
-		int second_col_index = 1 + y * this->width;
+		for (int tile_y = tile_y_begin; tile_y < tile_y_end; ++tile_y)
+		{
+			int y_begin = tile_y * SPARSE_TILE_SIZE;
+			int y_end = glm::min(y_begin + SPARSE_TILE_SIZE, this->height);
+
+			for (int tile_x = 0; tile_x < this->tiles_x; ++tile_x)
+			{
+				int tile = tile_x + tile_y * this->tiles_x;
+				if (!this->tile_live[tile])
+				{
+					continue;
+				}
+
+				int x_begin = tile_x * SPARSE_TILE_SIZE;
+				int x_end = glm::min(x_begin + SPARSE_TILE_SIZE, this->width);
+
+				float speed = 0;
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					const float* vx = this->front_cells.velocity_x + y * this->pitch;
+					const float* vy = this->front_cells.velocity_y + y * this->pitch;
+					for (int x = x_begin; x < x_end; ++x)
+					{
+						speed = glm::max(speed, glm::max(fabsf(vx[x]), fabsf(vy[x])));
+					}
+				}
+				this->tile_active[tile] = speed > threshold;
+			}
+		}
+	});
 
-		p[first_col_index] = p[second_col_index];
-		v[first_col_index].x = -v[second_col_index].x;
-		v[first_col_index].y = v[second_col_index].y;
+	std::vector<unsigned char> live(this->tile_live.size(), 0);
+	for (int tile_y = 0; tile_y < this->tiles_y; ++tile_y)
+	{
+		for (int tile_x = 0; tile_x < this->tiles_x; ++tile_x)
+		{
+			if (!this->tile_active[tile_x + tile_y * this->tiles_x])
+			{
+				continue;
+			}
+
+			for (int ny = glm::max(tile_y - 1, 0); ny <= glm::min(tile_y + 1, this->tiles_y - 1); ++ny)
+			{
+				for (int nx = glm::max(tile_x - 1, 0); nx <= glm::min(tile_x + 1, this->tiles_x - 1); ++nx)
+				{
+					live[nx + ny * this->tiles_x] = 1;
+				}
+			}
+		}
+	}
 
-		int last_col_index = (this->width - 1) + y * this->width;
-		int second_last_col_index = (this->width - 2) + y * this->width;
+	this->workers->ParallelRows(this->tiles_y, [&](int tile_y_begin, int tile_y_end, int /*band*/)
+	{
+		for (int tile_y = tile_y_begin; tile_y < tile_y_end; ++tile_y)
+		{
+			int y_begin = tile_y * SPARSE_TILE_SIZE;
+			int y_end = glm::min(y_begin + SPARSE_TILE_SIZE, this->height);
+
+			for (int tile_x = 0; tile_x < this->tiles_x; ++tile_x)
+			{
+				int tile = tile_x + tile_y * this->tiles_x;
+				if (!this->tile_live[tile] || live[tile])
+				{
+					continue;
+				}
+
+				int x_begin = tile_x * SPARSE_TILE_SIZE;
+				int run_cells = glm::min(x_begin + SPARSE_TILE_SIZE, this->width) - x_begin;
+				size_t run_bytes = sizeof(float) * run_cells;
+				size_t half_run_bytes = sizeof(unsigned short) * run_cells;
+
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					int begin = x_begin + y * this->pitch;
+					memcpy(this->back_cells.velocity_x + begin, this->front_cells.velocity_x + begin, run_bytes);
+					memcpy(this->back_cells.velocity_y + begin, this->front_cells.velocity_y + begin, run_bytes);
+					memcpy(this->back_cells.pressure + begin, this->front_cells.pressure + begin, run_bytes);
+
+					if (this->dye_storage == DYE_FLOAT16)
+					{
+						memcpy(this->back_cells.dye_half_r + begin, this->front_cells.dye_half_r + begin, half_run_bytes);
+						memcpy(this->back_cells.dye_half_g + begin, this->front_cells.dye_half_g + begin, half_run_bytes);
+						memcpy(this->back_cells.dye_half_b + begin, this->front_cells.dye_half_b + begin, half_run_bytes);
+					}
+					else
+					{
+						memcpy(this->back_cells.dye_r + begin, this->front_cells.dye_r + begin, run_bytes);
+						memcpy(this->back_cells.dye_g + begin, this->front_cells.dye_g + begin, run_bytes);
+						memcpy(this->back_cells.dye_b + begin, this->front_cells.dye_b + begin, run_bytes);
+					}
+				}
+			}
+		}
+	});
 
-		p[last_col_index] = p[second_last_col_index];
-		v[last_col_index].x = -v[second_last_col_index].x;
-		v[last_col_index].y = v[second_last_col_index].y;
+	this->tile_live.swap(live);
+	this->live_tile_count = 0;
+	for (int tile_y = 0; tile_y < this->tiles_y; ++tile_y)
+	{
+		int count = 0;
+		for (int tile_x = 0; tile_x < this->tiles_x; ++tile_x)
+		{
+			count += this->tile_live[tile_x + tile_y * this->tiles_x];
+		}
+		this->tile_row_live[tile_y] = count;
+		this->live_tile_count += count;
 	}
 }
 
+//pressure of the neighbour at 'index', or 'centre' when it's a solid or inflow cell, so the solve
+//sees no gradient into it and ApplyPressure never pushes fluid through it
+static inline float NeighbourPressure(const float* p, const unsigned char* types, int index, float centre)
+{
+	return (types[index] & CELL_FIXED_VELOCITY) ? centre : p[index];
+}
 
-void DIYFluid::RenderFluid(glm::mat4 viewProj)
+//sweeps for the next SMOOTH_TILED_JACOBI block. the tolerance is only checked between blocks, so
+//the block stops where last frame's solve converged rather than overshooting it by a whole block.
+//past that, blocks double in size so a solve never runs more than twice the sweeps it needs
+static int TiledBlockSweeps(int tile_sweeps, int needed_last_frame, int used, int max_iterations)
+{
+	int sweeps = glm::clamp(tile_sweeps, 1, MAX_TILE_SWEEPS);
+
+	if (needed_last_frame > used)
+	{
+		sweeps = glm::min(sweeps, needed_last_frame - used);
+	}
+	else
+	{
+		sweeps = glm::min(sweeps, glm::max(used, 1));
+	}
+	return glm::min(sweeps, max_iterations - used);
+}
+
+//sweep count at which a tiled block first met the threshold, or 'needed' unchanged if it didn't
+static int FirstConvergedSweep(const float* sweep_residuals, int sweeps, float threshold, int used_before, int needed)
 {
-	//Allocate space for texture data
-	unsigned char* tex_data = new unsigned char[this->width * this->height * 3];
+	if (needed > 0)
+	{
+		return needed;
+	}
 
-	for (int i = 0; i < this->width * this->height; i++)
+	for (int sweep = 0; sweep < sweeps; ++sweep)
 	{
-		tex_data[i * 3 + 0] = (unsigned char)this->front_cells.dye_colour[i].r;
-		tex_data[i * 3 + 1] = (unsigned char)this->front_cells.dye_colour[i].g;
-		tex_data[i * 3 + 2] = (unsigned char)this->front_cells.dye_colour[i].b;
+		if (sweep_residuals[sweep] <= threshold)
+		{
+			return used_before + sweep + 1;
+		}
 	}
+	return 0;
+}
 
-	unsigned int texture_handle = CreateGLTextureBasic(tex_data, this->width, this->height, 3);
+//the tiles don't know about spans, so with obstacles around plain jacobi sweeps stand in for them
+static FluidSmoother ObstacleSmoother(FluidSmoother smoother, bool has_obstacles)
+{
+	return (has_obstacles && smoother == SMOOTH_TILED_JACOBI) ? SMOOTH_JACOBI : smoother;
+}
+
+void DIYFluid::SolveDiffusion(float dt)
+{
+	//the advected velocity is both the right hand side and the first guess
+	this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		if (!this->sparse_running)
+		{
+			size_t band_bytes = sizeof(float) * this->pitch * (y_end - y_begin);
+			memcpy(this->diffuse_source_x + y_begin * this->pitch, this->front_cells.velocity_x + y_begin * this->pitch, band_bytes);
+			memcpy(this->diffuse_source_y + y_begin * this->pitch, this->front_cells.velocity_y + y_begin * this->pitch, band_bytes);
+			return;
+		}
+
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			for (int s = this->live_row_spans[y]; s < this->live_row_spans[y + 1]; ++s)
+			{
+				int begin = this->live_spans[s].begin + y * this->pitch;
+				size_t run_bytes = sizeof(float) * (this->live_spans[s].end - this->live_spans[s].begin);
+				memcpy(this->diffuse_source_x + begin, this->front_cells.velocity_x + begin, run_bytes);
+				memcpy(this->diffuse_source_y + begin, this->front_cells.velocity_y + begin, run_bytes);
+			}
+		}
+	});
 
-	unsigned int quad_vao = BuildQuadGLVAO(5.0f);
+	float rhs_sum_sq = SumSquares(this->workers, this->diffuse_source_x, *this->stage_spans, *this->stage_row_spans, this->height, this->pitch) +
+					   SumSquares(this->workers, this->diffuse_source_y, *this->stage_spans, *this->stage_row_spans, this->height, this->pitch);
+	float threshold = this->diffuse_tolerance * this->diffuse_tolerance * rhs_sum_sq;
 
-	RenderQuad(quad_vao, this->program, texture_handle, viewProj);
+	float residual_sum_sq = 0;
+	int needed_last_frame = this->diffuse_iterations_needed;
+	this->diffuse_iterations_used = 0;
+	this->diffuse_iterations_needed = 0;
 
-	glDeleteVertexArrays(1, &quad_vao);
-	glDeleteTextures(1, &texture_handle);
+	FluidSmoother smoother = ObstacleSmoother(this->smoother, this->has_obstacles);
+
+	while (this->diffuse_iterations_used < this->max_diffuse_iterations)
+	{
+		if (smoother == SMOOTH_RED_BLACK_SOR)
+		{
+			residual_sum_sq = DiffuseSOR(dt);
+			this->diffuse_iterations_used++;
+		}
+		else if (smoother == SMOOTH_TILED_JACOBI)
+		{
+			float sweep_residuals[MAX_TILE_SWEEPS];
+			int sweeps = TiledBlockSweeps(this->tile_sweeps, needed_last_frame, this->diffuse_iterations_used, this->max_diffuse_iterations);
 
-	delete[] tex_data;
+			DiffuseTiled(dt, sweeps, sweep_residuals);
+			SwapVelocities();
 
-}
+			residual_sum_sq = sweep_residuals[sweeps - 1];
+			this->diffuse_iterations_needed = FirstConvergedSweep(sweep_residuals, sweeps, threshold, this->diffuse_iterations_used, this->diffuse_iterations_needed);
+			this->diffuse_iterations_used += sweeps;
+		}
+		else
+		{
+			residual_sum_sq = Diffuse(dt);
+			SwapVelocities();
+			this->diffuse_iterations_used++;
+		}
+
+		if (residual_sum_sq <= threshold)
+		{
+			break;
+		}
+	}
+
+	if (this->diffuse_iterations_needed == 0)
+	{
+		this->diffuse_iterations_needed = this->diffuse_iterations_used;
+	}
+
+	this->diffuse_residual = rhs_sum_sq > 0 ? sqrtf(residual_sum_sq / rhs_sum_sq) : 0;
+}
+
+void DIYFluid::SolvePressure(float dt)
+{
+	//outflow cells are held at 0 and the sweeps never write them, nor look at their divergence
+	for (size_t i = 0; i < this->outflow_cells.size(); ++i)
+	{
+		this->front_cells.pressure[this->outflow_cells[i]] = 0;
+		this->back_cells.pressure[this->outflow_cells[i]] = 0;
+		this->divergence[this->outflow_cells[i]] = 0;
+	}
+
+	float rhs_sum_sq = SumSquares(this->workers, this->divergence, *this->stage_spans, *this->stage_row_spans, this->height, this->pitch);
+
+	int needed_last_frame = this->pressure_iterations_needed;
+	this->pressure_iterations_used = 0;
+	this->pressure_iterations_needed = 0;
+	this->pressure_residual = 0;
+
+	//no divergence at all means any constant pressure is the answer, don't iterate towards it.
+	//both planes are zeroed so they still agree, and with sparse tiles only the live cells are,
+	//the quiet tiles keep what both planes already hold there
+	if (rhs_sum_sq == 0)
+	{
+		const std::vector<FluidSpan>& spans = *this->stage_spans;
+		const std::vector<int>& row_spans = *this->stage_row_spans;
+
+		this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+				{
+					int begin = spans[s].begin + y * this->pitch;
+					size_t run_bytes = sizeof(float) * (spans[s].end - spans[s].begin);
+					memset(this->front_cells.pressure + begin, 0, run_bytes);
+					memset(this->back_cells.pressure + begin, 0, run_bytes);
+				}
+			}
+		});
+		return;
+	}
+
+	//the coarse levels have no cell types, so with obstacles multigrid hands over to PCG, which does
+	if (this->pressure_solver == PRESSURE_MULTIGRID && !this->has_obstacles)
+	{
+		SolvePressureMultigrid(rhs_sum_sq);
+		return;
+	}
+
+	if (this->pressure_solver == PRESSURE_PCG || this->pressure_solver == PRESSURE_MULTIGRID)
+	{
+		SolvePressurePCG(rhs_sum_sq);
+		return;
+	}
+
+	float threshold = this->pressure_tolerance * this->pressure_tolerance * rhs_sum_sq;
+	float residual_sum_sq = 0;
+
+	FluidSmoother smoother = ObstacleSmoother(this->smoother, this->has_obstacles);
+
+	while (this->pressure_iterations_used < this->max_pressure_iterations)
+	{
+		if (smoother == SMOOTH_RED_BLACK_SOR)
+		{
+			residual_sum_sq = UpdatePressureSOR(dt);
+			this->pressure_iterations_used++;
+		}
+		else if (smoother == SMOOTH_TILED_JACOBI)
+		{
+			float sweep_residuals[MAX_TILE_SWEEPS];
+			int sweeps = TiledBlockSweeps(this->tile_sweeps, needed_last_frame, this->pressure_iterations_used, this->max_pressure_iterations);
+
+			UpdatePressureTiled(dt, sweeps, sweep_residuals);
+			SwapPressures();
+
+			residual_sum_sq = sweep_residuals[sweeps - 1];
+			this->pressure_iterations_needed = FirstConvergedSweep(sweep_residuals, sweeps, threshold, this->pressure_iterations_used, this->pressure_iterations_needed);
+			this->pressure_iterations_used += sweeps;
+		}
+		else
+		{
+			residual_sum_sq = UpdatePressure(dt);
+			SwapPressures();
+			this->pressure_iterations_used++;
+		}
+
+		if (residual_sum_sq <= threshold)
+		{
+			break;
+		}
+	}
+
+	if (this->pressure_iterations_needed == 0)
+	{
+		this->pressure_iterations_needed = this->pressure_iterations_used;
+	}
+
+	this->pressure_residual = sqrtf(residual_sum_sq / rhs_sum_sq);
+}
+
+//the four cells around a point and where the point sits between them
+struct FluidSample
+{
+	int bli, bri, tli, tri;
+	glm::vec2 fract;
+};
+
+//clamps the point (px, py), in cells, to the grid and finds the cells to sample it from
+static inline FluidSample FindSample(float px, float py, int width, int height, int pitch)
+{
+	glm::vec2 sample_point = glm::vec2(glm::clamp(px, 0.0f, (float)width - 1),
+									   glm::clamp(py, 0.0f, (float)height - 1));
+
+	glm::vec2 bl = glm::vec2(floorf(sample_point.x), floorf(sample_point.y));
+
+	//samples on the last row or column would read past the edge of the grid
+	int x0 = (int)bl.x;
+	int y0 = (int)bl.y;
+	int x1 = glm::min(x0 + 1, width - 1);
+	int y1 = glm::min(y0 + 1, height - 1);
+
+	FluidSample sample;
+	sample.bli = x0 + pitch * y0;
+	sample.bri = x1 + pitch * y0;
+	sample.tli = x0 + pitch * y1;
+	sample.tri = x1 + pitch * y1;
+	sample.fract = sample_point - bl;
+	return sample;
+}
+
+//bilinear sample of a plane
+static inline float SamplePlane(const float* plane, const FluidSample& sample)
+{
+	float b = glm::mix(plane[sample.bli], plane[sample.bri], sample.fract.x);
+	float t = glm::mix(plane[sample.tli], plane[sample.tri], sample.fract.x);
+	return glm::mix(b, t, sample.fract.y);
+}
+
+//maccormack step for one cell of a plane. 'forward' is the semi-lagrangian value and 'backward'
+//that traced forward again, so half their disagreement with the original is the first step's error.
+//the result is clamped to the cells the first step sampled so the correction can't make new extremes
+static inline float MacCormackCell(const float* original, int cell_index, const FluidSample& sample, float forward, float backward)
+{
+	float corrected = forward + 0.5f * (original[cell_index] - backward);
+
+	float lo = glm::min(glm::min(original[sample.bli], original[sample.bri]), glm::min(original[sample.tli], original[sample.tri]));
+	float hi = glm::max(glm::max(original[sample.bli], original[sample.bri]), glm::max(original[sample.tli], original[sample.tri]));
+
+	return glm::clamp(corrected, lo, hi);
+}
+
+//what a staggered grid's planes hold, and where in the cell
+enum StaggeredPlace
+{
+	PLACE_CENTRE,
+	PLACE_U_FACE,
+	PLACE_V_FACE,
+};
+
+//velocity of a staggered grid at entry (x, y) of a plane at 'place'. the same as bilinear
+//sampling both components there, but every sample lands halfway between faces so it's just averages
+static inline glm::vec2 StaggeredVelocity(const float* u, const float* v, StaggeredPlace place, int x, int y, int width, int height, int pitch)
+{
+	int i = x + y * pitch;
+
+	if (place == PLACE_CENTRE)
+	{
+		return glm::vec2(0.5f * (u[i] + u[i + 1]), 0.5f * (v[i] + v[i + pitch]));
+	}
+
+	if (place == PLACE_U_FACE)
+	{
+		//v from the cells either side of the face, on the faces below and above them
+		int left = glm::max(x - 1, 0) + y * pitch;
+		int right = glm::min(x, width - 1) + y * pitch;
+		return glm::vec2(u[i], 0.25f * ((v[left] + v[right]) + (v[left + pitch] + v[right + pitch])));
+	}
+
+	//u from the cells either side of the face, on the faces left and right of them
+	int down = x + glm::max(y - 1, 0) * pitch;
+	int up = x + glm::min(y, height - 1) * pitch;
+	return glm::vec2(0.25f * ((u[down] + u[up]) + (u[down + 1] + u[up + 1])), v[i]);
+}
+
+//planes that sit at the same place in every cell of a staggered grid, the centre for dye or a face
+//for u and v. entry (x, y) of each is at (x - offset_x, y - offset_y) in cell coordinates
+struct StaggeredPlanes
+{
+	StaggeredPlace place;
+	int width, height;
+	float offset_x, offset_y;
+	int count;
+	float* planes[3];		//front_cells
+	float* advected[3];		//back_cells
+	float* corrected[3];	//advect_cells
+};
+
+//update parts
+void DIYFluid::Advect(float dt)
+{
+	bool maccormack = this->advection == ADVECT_MACCORMACK;
+	bool half_dye = this->dye_storage == DYE_FLOAT16;
+
+	if (maccormack && !this->advect_cells.velocity_x)
+	{
+		this->advect_cells.velocity_x = AllocFluidPlane(this->pitch, this->height + 1);
+		this->advect_cells.velocity_y = AllocFluidPlane(this->pitch, this->height + 1);
+	}
+	if (maccormack && !half_dye && !this->advect_cells.dye_r)
+	{
+		this->advect_cells.dye_r = AllocFluidPlane(this->pitch, this->height);
+		this->advect_cells.dye_g = AllocFluidPlane(this->pitch, this->height);
+		this->advect_cells.dye_b = AllocFluidPlane(this->pitch, this->height);
+	}
+	if (maccormack && half_dye && !this->advect_cells.dye_half_r)
+	{
+		this->advect_cells.dye_half_r = AllocHalfPlane(this->pitch, this->height);
+		this->advect_cells.dye_half_g = AllocHalfPlane(this->pitch, this->height);
+		this->advect_cells.dye_half_b = AllocHalfPlane(this->pitch, this->height);
+	}
+
+	if (this->layout == GRID_STAGGERED)
+	{
+		AdvectStaggered(dt, maccormack);
+	}
+	else
+	{
+		//each band of rows reads anywhere in front_cells but only writes its own rows of back_cells.
+		//the stage spans cover every cell, or with sparse tiles every live one
+		const std::vector<FluidSpan>& spans = *this->stage_spans;
+		const std::vector<int>& row_spans = *this->stage_row_spans;
+
+		this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+				{
+					for (int x = spans[s].begin; x < spans[s].end; ++x)
+					{
+						//find the point to sample for this cell
+						int cell_index = x + y * this->pitch;
+
+						glm::vec2 vel = glm::vec2(this->front_cells.velocity_x[cell_index], this->front_cells.velocity_y[cell_index]) * dt;
+						FluidSample sample = FindSample((float)x - vel.x / this->cell_dist, (float)y - vel.y / this->cell_dist, this->width, this->height, this->pitch);
+
+						//read each value from front_cells and store in back_cells. fp16 dye is done after
+						if (!half_dye)
+						{
+							this->back_cells.dye_r[cell_index] = SamplePlane(this->front_cells.dye_r, sample);
+							this->back_cells.dye_g[cell_index] = SamplePlane(this->front_cells.dye_g, sample);
+							this->back_cells.dye_b[cell_index] = SamplePlane(this->front_cells.dye_b, sample);
+						}
+
+						//vel
+						this->back_cells.velocity_x[cell_index] = SamplePlane(this->front_cells.velocity_x, sample);
+						this->back_cells.velocity_y[cell_index] = SamplePlane(this->front_cells.velocity_y, sample);
+					}
+				}
+			}
+		});
+
+		if (maccormack)
+		{
+			//second pass needs the whole of back_cells from the first, so it can't be fused into it.
+			//it traces forwards through back_cells with the same velocity and corrects into advect_cells
+			this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+			{
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					for (int x = 0; x < this->width; ++x)
+					{
+						int cell_index = x + y * this->pitch;
+
+						glm::vec2 vel = glm::vec2(this->front_cells.velocity_x[cell_index], this->front_cells.velocity_y[cell_index]) * dt;
+						FluidSample sample = FindSample((float)x - vel.x / this->cell_dist, (float)y - vel.y / this->cell_dist, this->width, this->height, this->pitch);
+						FluidSample back_sample = FindSample((float)x + vel.x / this->cell_dist, (float)y + vel.y / this->cell_dist, this->width, this->height, this->pitch);
+
+						if (!half_dye)
+						{
+							this->advect_cells.dye_r[cell_index] = MacCormackCell(this->front_cells.dye_r, cell_index, sample,
+								this->back_cells.dye_r[cell_index], SamplePlane(this->back_cells.dye_r, back_sample));
+							this->advect_cells.dye_g[cell_index] = MacCormackCell(this->front_cells.dye_g, cell_index, sample,
+								this->back_cells.dye_g[cell_index], SamplePlane(this->back_cells.dye_g, back_sample));
+							this->advect_cells.dye_b[cell_index] = MacCormackCell(this->front_cells.dye_b, cell_index, sample,
+								this->back_cells.dye_b[cell_index], SamplePlane(this->back_cells.dye_b, back_sample));
+						}
+
+						this->advect_cells.velocity_x[cell_index] = MacCormackCell(this->front_cells.velocity_x, cell_index, sample,
+							this->back_cells.velocity_x[cell_index], SamplePlane(this->back_cells.velocity_x, back_sample));
+						this->advect_cells.velocity_y[cell_index] = MacCormackCell(this->front_cells.velocity_y, cell_index, sample,
+							this->back_cells.velocity_y[cell_index], SamplePlane(this->back_cells.velocity_y, back_sample));
+					}
+				}
+			});
+		}
+	}
+
+	if (half_dye)
+	{
+		AdvectDyeHalf(dt, maccormack);
+	}
+
+	if (maccormack)
+	{
+		//the corrected planes become back_cells, and the uncorrected ones the scratch for next time.
+		//the dye planes of the format not in use are all 0
+		std::swap(this->back_cells.velocity_x, this->advect_cells.velocity_x);
+		std::swap(this->back_cells.velocity_y, this->advect_cells.velocity_y);
+		std::swap(this->back_cells.dye_r, this->advect_cells.dye_r);
+		std::swap(this->back_cells.dye_g, this->advect_cells.dye_g);
+		std::swap(this->back_cells.dye_b, this->advect_cells.dye_b);
+		std::swap(this->back_cells.dye_half_r, this->advect_cells.dye_half_r);
+		std::swap(this->back_cells.dye_half_g, this->advect_cells.dye_half_g);
+		std::swap(this->back_cells.dye_half_b, this->advect_cells.dye_half_b);
+	}
+}
+
+//same steps as Advect but every plane is traced from where its own entries sit, so u and v
+//follow the flow from their faces rather than the cell centre
+void DIYFluid::AdvectStaggered(float dt, bool maccormack)
+{
+	const float* u = this->front_cells.velocity_x;
+	const float* v = this->front_cells.velocity_y;
+	float to_cells = dt / this->cell_dist;
+
+	//fp16 dye is left to AdvectDyeHalf
+	int dye_count = this->dye_storage == DYE_FLOAT16 ? 0 : 3;
+
+	StaggeredPlanes groups[3] =
+	{
+		{ PLACE_CENTRE, this->width, this->height, 0.0f, 0.0f, dye_count,
+		  { this->front_cells.dye_r, this->front_cells.dye_g, this->front_cells.dye_b },
+		  { this->back_cells.dye_r, this->back_cells.dye_g, this->back_cells.dye_b },
+		  { this->advect_cells.dye_r, this->advect_cells.dye_g, this->advect_cells.dye_b } },
+		{ PLACE_U_FACE, this->width + 1, this->height, 0.5f, 0.0f, 1,
+		  { this->front_cells.velocity_x }, { this->back_cells.velocity_x }, { this->advect_cells.velocity_x } },
+		{ PLACE_V_FACE, this->width, this->height + 1, 0.0f, 0.5f, 1,
+		  { this->front_cells.velocity_y }, { this->back_cells.velocity_y }, { this->advect_cells.velocity_y } },
+	};
+
+	//one pass traces back from every entry into back_cells, the maccormack one runs after it
+	//and traces forwards through back_cells to correct into advect_cells
+	auto advect_pass = [&](bool correct)
+	{
+		this->workers->ParallelRows(this->height + 1, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int g = 0; g < 3; ++g)
+			{
+				const StaggeredPlanes& group = groups[g];
+
+				for (int y = y_begin; y < glm::min(y_end, group.height); ++y)
+				{
+					for (int x = 0; x < group.width; ++x)
+					{
+						int index = x + y * this->pitch;
+
+						float px = (float)x - group.offset_x;
+						float py = (float)y - group.offset_y;
+						glm::vec2 step = StaggeredVelocity(u, v, group.place, x, y, this->width, this->height, this->pitch) * to_cells;
+
+						FluidSample sample = FindSample(px - step.x + group.offset_x, py - step.y + group.offset_y,
+														group.width, group.height, this->pitch);
+
+						if (!correct)
+						{
+							for (int k = 0; k < group.count; ++k)
+							{
+								group.advected[k][index] = SamplePlane(group.planes[k], sample);
+							}
+							continue;
+						}
+
+						FluidSample back_sample = FindSample(px + step.x + group.offset_x, py + step.y + group.offset_y,
+															 group.width, group.height, this->pitch);
+
+						for (int k = 0; k < group.count; ++k)
+						{
+							group.corrected[k][index] = MacCormackCell(group.planes[k], index, sample,
+								group.advected[k][index], SamplePlane(group.advected[k], back_sample));
+						}
+					}
+				}
+			}
+		});
+	};
+
+	advect_pass(false);
+
+	if (maccormack)
+	{
+		advect_pass(true);
+	}
+}
+
+//cells AdvectDyeHalf works on at once, small enough for its scratch to sit on the stack
+static const int HALF_CHUNK = 256;
+
+//the four cells around each of a chunk's samples, gathered from an fp16 plane and then converted together
+struct HalfCorners
+{
+	float bl[HALF_CHUNK];
+	float br[HALF_CHUNK];
+	float tl[HALF_CHUNK];
+	float tr[HALF_CHUNK];
+};
+
+static void GatherHalfCorners(const FluidKernels* kernels, const unsigned short* plane, const FluidSample* samples, int count, HalfCorners* corners)
+{
+	unsigned short gathered[HALF_CHUNK] = {};	//only the first count are read, but the compiler can't tell
+
+	for (int i = 0; i < count; ++i)
+	{
+		gathered[i] = plane[samples[i].bli];
+	}
+	kernels->half_to_float_row(gathered, corners->bl, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		gathered[i] = plane[samples[i].bri];
+	}
+	kernels->half_to_float_row(gathered, corners->br, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		gathered[i] = plane[samples[i].tli];
+	}
+	kernels->half_to_float_row(gathered, corners->tl, count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		gathered[i] = plane[samples[i].tri];
+	}
+	kernels->half_to_float_row(gathered, corners->tr, count);
+}
+
+//SamplePlane on gathered corners
+static inline float SampleCorners(const HalfCorners& corners, int i, const FluidSample& sample)
+{
+	float b = glm::mix(corners.bl[i], corners.br[i], sample.fract.x);
+	float t = glm::mix(corners.tl[i], corners.tr[i], sample.fract.x);
+	return glm::mix(b, t, sample.fract.y);
+}
+
+//the dye traces back from the cell centres on either layout. each chunk of a row finds its samples,
+//gathers and converts the fp16 values around them, and does the same float arithmetic as the float
+//planes get before storing the results as fp16 again
+void DIYFluid::AdvectDyeHalf(float dt, bool maccormack)
+{
+	const float* vx = this->front_cells.velocity_x;
+	const float* vy = this->front_cells.velocity_y;
+	bool staggered = this->layout == GRID_STAGGERED;
+	float to_cells = dt / this->cell_dist;
+
+	const unsigned short* front[3] = { this->front_cells.dye_half_r, this->front_cells.dye_half_g, this->front_cells.dye_half_b };
+	unsigned short* back[3] = { this->back_cells.dye_half_r, this->back_cells.dye_half_g, this->back_cells.dye_half_b };
+	unsigned short* corrected[3] = { this->advect_cells.dye_half_r, this->advect_cells.dye_half_g, this->advect_cells.dye_half_b };
+
+	//the same trace as Advect or AdvectStaggered does for the cell, forwards for maccormack's second pass
+	auto find_sample = [&](int x, int y, float direction) -> FluidSample
+	{
+		if (staggered)
+		{
+			glm::vec2 step = StaggeredVelocity(vx, vy, PLACE_CENTRE, x, y, this->width, this->height, this->pitch) * to_cells;
+			return FindSample((float)x + direction * step.x, (float)y + direction * step.y, this->width, this->height, this->pitch);
+		}
+
+		int cell_index = x + y * this->pitch;
+		glm::vec2 vel = glm::vec2(vx[cell_index], vy[cell_index]) * dt;
+		return FindSample((float)x + direction * vel.x / this->cell_dist, (float)y + direction * vel.y / this->cell_dist,
+						  this->width, this->height, this->pitch);
+	};
+
+	const std::vector<FluidSpan>& spans = *this->stage_spans;
+	const std::vector<int>& row_spans = *this->stage_row_spans;
+
+	//runs chunk(y, x_begin, count) over every cell the stage spans cover, a row's spans joined up
+	auto chunked_rows = [&](const std::function<void(int, int, int)>& chunk)
+	{
+		this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+				{
+					int run_begin = spans[s].begin;
+					while (s + 1 < row_spans[y + 1] && spans[s + 1].begin == spans[s].end)
+					{
+						++s;
+					}
+
+					for (int x = run_begin; x < spans[s].end; x += HALF_CHUNK)
+					{
+						chunk(y, x, glm::min(HALF_CHUNK, spans[s].end - x));
+					}
+				}
+			}
+		});
+	};
+
+	chunked_rows([&](int y, int x_begin, int count)
+	{
+		FluidSample samples[HALF_CHUNK];
+		HalfCorners corners;
+		float advected[HALF_CHUNK];
+
+		for (int i = 0; i < count; ++i)
+		{
+			samples[i] = find_sample(x_begin + i, y, -1.0f);
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			GatherHalfCorners(this->kernels, front[c], samples, count, &corners);
+			for (int i = 0; i < count; ++i)
+			{
+				advected[i] = SampleCorners(corners, i, samples[i]);
+			}
+			this->kernels->float_to_half_row(advected, back[c] + x_begin + y * this->pitch, count);
+		}
+	});
+
+	if (!maccormack)
+	{
+		return;
+	}
+
+	//MacCormackCell's correction and clamp, reading back_cells as the first pass left it
+	chunked_rows([&](int y, int x_begin, int count)
+	{
+		FluidSample samples[HALF_CHUNK];
+		FluidSample back_samples[HALF_CHUNK];
+		HalfCorners corners;
+		HalfCorners back_corners;
+		float original[HALF_CHUNK];
+		float forward[HALF_CHUNK];
+		float result[HALF_CHUNK];
+
+		int row_begin = x_begin + y * this->pitch;
+
+		for (int i = 0; i < count; ++i)
+		{
+			samples[i] = find_sample(x_begin + i, y, -1.0f);
+			back_samples[i] = find_sample(x_begin + i, y, 1.0f);
+		}
+
+		for (int c = 0; c < 3; ++c)
+		{
+			GatherHalfCorners(this->kernels, front[c], samples, count, &corners);
+			GatherHalfCorners(this->kernels, back[c], back_samples, count, &back_corners);
+			this->kernels->half_to_float_row(front[c] + row_begin, original, count);
+			this->kernels->half_to_float_row(back[c] + row_begin, forward, count);
+
+			for (int i = 0; i < count; ++i)
+			{
+				float backward = SampleCorners(back_corners, i, back_samples[i]);
+				float value = forward[i] + 0.5f * (original[i] - backward);
+
+				float lo = glm::min(glm::min(corners.bl[i], corners.br[i]), glm::min(corners.tl[i], corners.tr[i]));
+				float hi = glm::max(glm::max(corners.bl[i], corners.br[i]), glm::max(corners.tl[i], corners.tr[i]));
+
+				result[i] = glm::clamp(value, lo, hi);
+			}
+			this->kernels->float_to_half_row(result, corrected[c] + row_begin, count);
+		}
+	});
+}
+
+float DIYFluid::Diffuse(float dt)
+{
+	float inv_vdt = 1.0f / (this->viscosity * dt);
+	float diag = 4 + inv_vdt;
+	float denom = 1.0f / diag;
+	float residual_scale = diag / inv_vdt;
+
+	//x and y don't interact, so each is diffused as a plane of its own
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int begin = x_begin + y * this->pitch;
+		int end = x_end + y * this->pitch;
+
+		float sum_sq = this->kernels->diffuse_row(this->front_cells.velocity_x, this->diffuse_source_x, this->back_cells.velocity_x,
+												  begin, end, this->pitch, inv_vdt, denom, residual_scale);
+		sum_sq += this->kernels->diffuse_row(this->front_cells.velocity_y, this->diffuse_source_y, this->back_cells.velocity_y,
+											 begin, end, this->pitch, inv_vdt, denom, residual_scale);
+		return sum_sq;
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		//gather the 4 velocities around us
+		int up = x + yp1 * this->pitch;
+		int down = x + ym1 * this->pitch;
+		int right = xp1 + y * this->pitch;
+		int left = xm1 + y * this->pitch;
+
+		const float* vx = this->front_cells.velocity_x;
+		const float* vy = this->front_cells.velocity_y;
+
+		glm::vec2 vel_up = glm::vec2(vx[up], vy[up]);
+		glm::vec2 vel_down = glm::vec2(vx[down], vy[down]);
+		glm::vec2 vel_left = glm::vec2(vx[left], vy[left]);
+		glm::vec2 vel_right = glm::vec2(vx[right], vy[right]);
+		glm::vec2 vel_source = glm::vec2(this->diffuse_source_x[cell_index], this->diffuse_source_y[cell_index]);
+
+		glm::vec2 diffused_velocity = (vel_up + vel_right + vel_down + vel_left + vel_source * inv_vdt) * denom;
+
+		this->back_cells.velocity_x[cell_index] = diffused_velocity.x;
+		this->back_cells.velocity_y[cell_index] = diffused_velocity.y;
+
+		//residual of the old guess is the jacobi step scaled back up by the diagonal
+		glm::vec2 r = (diffused_velocity - glm::vec2(vx[cell_index], vy[cell_index])) * residual_scale;
+		return glm::dot(r, r);
+	};
+
+	return ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+	{
+		return StencilRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, edge_cell, interior);
+	});
+}
+
+//residual of each cell is taken when it is relaxed, so it already sees the
+//red half of the sweep when the black half runs. the two colours are separate
+//parallel passes, as a red cell's neighbours are all black. interior spans go
+//to the kernels, which relax every other cell of them
+float DIYFluid::DiffuseSOR(float dt)
+{
+	float inv_vdt = 1.0f / (this->viscosity * dt);
+	float diag = 4 + inv_vdt;
+	float denom = 1.0f / diag;
+	float residual_scale = diag / inv_vdt;
+	float omega = this->diffuse_omega;
+	float residual_sum_sq = 0;
+
+	//both components share the same stencil, so relax them one after the other
+	float* planes[2] = { this->front_cells.velocity_x, this->front_cells.velocity_y };
+	const float* sources[2] = { this->diffuse_source_x, this->diffuse_source_y };
+
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int begin = x_begin + y * this->pitch;
+		int end = x_end + y * this->pitch;
+
+		float sum_sq = this->kernels->diffuse_sor_row(planes[0], sources[0], begin, end, this->pitch, inv_vdt, denom, residual_scale, omega);
+		sum_sq += this->kernels->diffuse_sor_row(planes[1], sources[1], begin, end, this->pitch, inv_vdt, denom, residual_scale, omega);
+		return sum_sq;
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		float sum_sq = 0;
+		for (int c = 0; c < 2; ++c)
+		{
+			float* v = planes[c];
+
+			float vel_up = v[x + yp1 * this->pitch];
+			float vel_down = v[x + ym1 * this->pitch];
+			float vel_left = v[xm1 + y * this->pitch];
+			float vel_right = v[xp1 + y * this->pitch];
+
+			float step = (vel_up + vel_right + vel_down + vel_left + sources[c][cell_index] * inv_vdt) * denom - v[cell_index];
+
+			v[cell_index] += omega * step;
+
+			float r = step * residual_scale;
+			sum_sq += r * r;
+		}
+		return sum_sq;
+	};
+
+	for (int colour = 0; colour < 2; ++colour)
+	{
+		residual_sum_sq += ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+		{
+			return ColourRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, colour, edge_cell, interior);
+		});
+	}
+
+	return residual_sum_sq;
+}
+
+//the faces on the outside of a staggered grid are walls, nothing flows through them
+static void ClearWallFaces(float* u, float* v, int width, int height, int pitch)
+{
+	for (int y = 0; y < height; ++y)
+	{
+		u[y * pitch] = 0;
+		u[width + y * pitch] = 0;
+	}
+
+	memset(v, 0, sizeof(float) * width);
+	memset(v + height * pitch, 0, sizeof(float) * width);
+}
+
+void DIYFluid::Divergence(float dt)
+{
+	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+
+	const float* vx = this->front_cells.velocity_x;
+	const float* vy = this->front_cells.velocity_y;
+
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int row = y * this->pitch;
+		return this->kernels->divergence_row(vx, vy, this->divergence, row + x_begin, row + x_end, this->pitch, inv_cell_dist);
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		//gather the 4 velocities around us
+		float vel_up = vy[x + yp1 * this->pitch];
+		float vel_down = vy[x + ym1 * this->pitch];
+		float vel_left = vx[xm1 + y * this->pitch];
+		float vel_right = vx[xp1 + y * this->pitch];
+
+		float divergence = ((vel_right - vel_left) + (vel_up - vel_down)) * inv_cell_dist;
+
+		this->divergence[cell_index] = divergence;
+		return divergence;
+	};
+
+	float sum;
+
+	if (this->layout == GRID_STAGGERED)
+	{
+		ClearWallFaces(this->front_cells.velocity_x, this->front_cells.velocity_y, this->width, this->height, this->pitch);
+		ApplyObstacles(&this->front_cells);
+
+		//every cell has all four of its faces, so there's no edge case. runs of cells that aren't
+		//solid or inflow go to the kernel whole, which with no obstacles is every row in one go
+		float inv_face_dist = 1.0f / cell_dist;
+
+		sum = ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+		{
+			float band_sum = 0;
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				int row = y * this->pitch;
+				int run_begin = 0;
+
+				for (int s = this->row_spans[y]; s <= this->row_spans[y + 1]; ++s)
+				{
+					bool row_done = s == this->row_spans[y + 1];
+					if (!row_done && this->spans[s].kind != SPAN_FIXED)
+					{
+						continue;
+					}
+
+					int run_end = row_done ? this->width : this->spans[s].begin;
+					if (run_end > run_begin)
+					{
+						band_sum += this->kernels->staggered_divergence_row(vx, vy, this->divergence, row + run_begin, row + run_end, this->pitch, inv_face_dist);
+					}
+					if (!row_done)
+					{
+						run_begin = this->spans[s].end;
+					}
+				}
+			}
+			return band_sum;
+		});
+	}
+	else
+	{
+		sum = ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+		{
+			return StencilRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, edge_cell, interior);
+		});
+	}
+
+	if (this->has_obstacles)
+	{
+		RemoveRegionMeans();
+		return;
+	}
+
+	//with closed walls the pressure is only defined up to a constant, so the
+	//divergence has to sum to zero for the pressure solve to have a solution
+	float mean = sum / (float)this->stage_cell_count;
+
+	const std::vector<FluidSpan>& spans = *this->stage_spans;
+	const std::vector<int>& row_spans = *this->stage_row_spans;
+
+	this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			float* row = this->divergence + y * this->pitch;
+			for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+			{
+				for (int x = spans[s].begin; x < spans[s].end; ++x)
+				{
+					row[x] -= mean;
+				}
+			}
+		}
+	});
+}
+
+//Divergence's mean removal with obstacles around. each group of cells sealed off from the others
+//gets its own mean taken out, groups with an outflow cell are left alone as it lets the difference out,
+//and solid and inflow cells aren't solved for so theirs is 0
+void DIYFluid::RemoveRegionMeans()
+{
+	int region_count = (int)this->region_open.size();
+	this->region_sums.assign(region_count, 0.0);
+	this->region_cells.assign(region_count, 0);
+
+	//with sparse tiles only the live part of each group is solved, so only it counts
+	const std::vector<FluidSpan>& spans = *this->stage_spans;
+	const std::vector<int>& row_spans = *this->stage_row_spans;
+
+	for (int y = 0; y < this->height; ++y)
+	{
+		int row = y * this->pitch;
+		for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+		{
+			for (int x = spans[s].begin; x < spans[s].end; ++x)
+			{
+				int region = this->cell_regions[row + x];
+				if (region >= 0)
+				{
+					this->region_sums[region] += this->divergence[row + x];
+					this->region_cells[region]++;
+				}
+			}
+		}
+	}
+
+	for (int region = 0; region < region_count; ++region)
+	{
+		bool counted = this->region_cells[region] > 0 && !this->region_open[region];
+		this->region_sums[region] = counted ? this->region_sums[region] / this->region_cells[region] : 0.0;
+	}
+
+	this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int row = y * this->pitch;
+			for (int s = row_spans[y]; s < row_spans[y + 1]; ++s)
+			{
+				for (int x = spans[s].begin; x < spans[s].end; ++x)
+				{
+					int region = this->cell_regions[row + x];
+					this->divergence[row + x] = region < 0 ? 0.0f : this->divergence[row + x] - (float)this->region_sums[region];
+				}
+			}
+		}
+	});
+}
+
+float DIYFluid::UpdatePressure(float dt)
+{
+	float h2 = this->cell_dist * this->cell_dist;
+	float inv_h2 = 1.0f / h2;
+
+	const float* p = this->front_cells.pressure;
+
+	const unsigned char* types = this->cell_types;
+
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int row = y * this->pitch;
+		return this->kernels->pressure_row(p, this->divergence, this->back_cells.pressure,
+										   row + x_begin, row + x_end, this->pitch, h2, inv_h2);
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		if (types[cell_index] & CELL_OUTFLOW)
+		{
+			this->back_cells.pressure[cell_index] = 0;
+			return 0.0f;
+		}
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		float p_c = p[cell_index];
+		float p_up = NeighbourPressure(p, types, x + yp1 * this->pitch, p_c);
+		float p_down = NeighbourPressure(p, types, x + ym1 * this->pitch, p_c);
+		float p_left = NeighbourPressure(p, types, xm1 + y * this->pitch, p_c);
+		float p_right = NeighbourPressure(p, types, xp1 + y * this->pitch, p_c);
+
+		float new_pressure = (p_up + p_down + p_left + p_right - this->divergence[cell_index] * h2) * 0.25f;
+
+		this->back_cells.pressure[cell_index] = new_pressure;
+
+		//residual of the old pressure, divergence - laplacian(pressure)
+		float r = 4.0f * (p[cell_index] - new_pressure) * inv_h2;
+		return r * r;
+	};
+
+	return ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+	{
+		return StencilRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, edge_cell, interior);
+	});
+}
+
+float DIYFluid::UpdatePressureSOR(float dt)
+{
+	float h2 = this->cell_dist * this->cell_dist;
+	float inv_h2 = 1.0f / h2;
+	float omega = this->pressure_omega;
+	float residual_sum_sq = 0;
+
+	float* p = this->front_cells.pressure;
+	const unsigned char* types = this->cell_types;
+
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int row = y * this->pitch;
+		return this->kernels->pressure_sor_row(p, this->divergence, row + x_begin, row + x_end, this->pitch, h2, inv_h2, omega);
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		//outflow stays at 0
+		if (types[cell_index] & CELL_OUTFLOW)
+		{
+			return 0.0f;
+		}
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		float p_c = p[cell_index];
+		float p_up = NeighbourPressure(p, types, x + yp1 * this->pitch, p_c);
+		float p_down = NeighbourPressure(p, types, x + ym1 * this->pitch, p_c);
+		float p_left = NeighbourPressure(p, types, xm1 + y * this->pitch, p_c);
+		float p_right = NeighbourPressure(p, types, xp1 + y * this->pitch, p_c);
+
+		float step = (p_up + p_down + p_left + p_right - this->divergence[cell_index] * h2) * 0.25f - p[cell_index];
+
+		p[cell_index] += omega * step;
+
+		float r = 4.0f * step * inv_h2;
+		return r * r;
+	};
+
+	for (int colour = 0; colour < 2; ++colour)
+	{
+		residual_sum_sq += ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+		{
+			return ColourRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, colour, edge_cell, interior);
+		});
+	}
+
+	return residual_sum_sq;
+}
+
+//floats in each of the two per thread buffers of a tile
+static int TileBufferFloats(int tile_size, int sweeps)
+{
+	int halo_size = tile_size + 2 * sweeps + 2;
+	return FluidRowPitch(halo_size) * halo_size;
+}
+
+//a plane seen from a tile, rows are found relative to the tile's corner (x0, y0)
+struct TilePlane
+{
+	float* corner;	//the element at (x0, y0)
+	int pitch;
+
+	float* Row(int y, int y0) const { return corner + (y - y0) * pitch; }
+};
+
+//runs 'sweeps' Jacobi sweeps of a 5 point stencil from 'in' into 'out' one tile at a time.
+//each tile is relaxed together with a halo 'sweeps' cells deep. stale values creep in from the
+//edge of the halo one cell per sweep so the tile itself stays exact, and the results are exactly
+//what 'sweeps' separate passes over the whole grid would give, but the tile only leaves cache once.
+//
+//the first sweep reads straight from 'in' and the last writes just the tile straight to 'out',
+//the sweeps between ping-pong on per thread buffers. rows shrink towards the tile as the sweeps
+//go on, columns don't so that with the tile and halo a multiple of the simd width every run
+//is whole registers. the residual that each sweep saw over the tiles goes in sweep_residuals.
+//
+//row_fn(in, rhs, out, begin, end, pitch) is one Jacobi sweep along cells [begin, end) of a row whose
+//neighbours are all in the plane, 'pitch' floats apart in 'in', and returns the sum of squared residuals.
+//cell_fn(centre, left, right, down, up, rhs, result) is one Jacobi sweep of a single cell from its value,
+//its 4 (already clamped) neighbours and its right hand side, the new value goes in 'result' and the
+//squared residual is returned. they are template parameters rather than std::functions so the calls,
+//one per row and one per edge cell, are made directly
+template <class RowFn, class CellFn>
+static void TiledJacobi(FluidWorkers* workers, int width, int height, int pitch,
+						const float* in, const float* rhs, float* out,
+						int sweeps, int tile_size, float* scratch,
+						const RowFn& row_fn, const CellFn& cell_fn, float* sweep_residuals)
+{
+	float band_sums[FluidWorkers::MAX_THREADS][MAX_TILE_SWEEPS];
+	int bands = workers->BandCount(height);
+	int buffer_floats = TileBufferFloats(tile_size, sweeps);
+
+	workers->ParallelRows(height, [&](int y_begin, int y_end, int band)
+	{
+		float* buffers[2] = { scratch + band * 2 * buffer_floats, scratch + (band * 2 + 1) * buffer_floats };
+		float* sums = band_sums[band];
+
+		for (int sweep = 0; sweep < sweeps; ++sweep)
+		{
+			sums[sweep] = 0;
+		}
+
+		for (int ty0 = y_begin; ty0 < y_end; ty0 += tile_size)
+		{
+			int ty1 = glm::min(ty0 + tile_size, y_end);
+
+			for (int tx0 = 0; tx0 < width; tx0 += tile_size)
+			{
+				int tx1 = glm::min(tx0 + tile_size, width);
+
+				//corner of the tile plus its halo and a spare column, cut off at the edges of the grid
+				int lx0 = glm::max(tx0 - sweeps - 1, 0);
+				int lx1 = glm::min(tx1 + sweeps + 1, width);
+				int ly0 = glm::max(ty0 - sweeps, 0);
+				int local_pitch = FluidRowPitch(lx1 - lx0);
+
+				TilePlane global_in = { (float*)in + lx0 + ly0 * pitch, pitch };
+				TilePlane global_rhs = { (float*)rhs + lx0 + ly0 * pitch, pitch };
+				TilePlane global_out = { out + lx0 + ly0 * pitch, pitch };
+				TilePlane local[2] = { { buffers[0], local_pitch }, { buffers[1], local_pitch } };
+
+				int x_begin = glm::max(tx0 - sweeps, 0);
+				int x_end = glm::min(tx1 + sweeps, width);
+
+				for (int sweep = 0; sweep < sweeps; ++sweep)
+				{
+					const TilePlane& src = sweep == 0 ? global_in : local[sweep & 1];
+					const TilePlane& dst = sweep == sweeps - 1 ? global_out : local[(sweep + 1) & 1];
+
+					auto cell = [&](int x, int y) -> float
+					{
+						int xp1 = glm::clamp(x + 1, 0, width - 1);
+						int xm1 = glm::clamp(x - 1, 0, width - 1);
+						int yp1 = glm::clamp(y + 1, 0, height - 1);
+						int ym1 = glm::clamp(y - 1, 0, height - 1);
+
+						const float* row = src.Row(y, ly0);
+
+						return cell_fn(row[x - lx0], row[xm1 - lx0], row[xp1 - lx0],
+									   src.Row(ym1, ly0)[x - lx0], src.Row(yp1, ly0)[x - lx0],
+									   global_rhs.Row(y, ly0)[x - lx0], dst.Row(y, ly0) + (x - lx0));
+					};
+
+					//cells [seg_begin, seg_end) of row y, edge cells clamped and the rest through the row kernel
+					auto segment = [&](int seg_begin, int seg_end, int y) -> float
+					{
+						float sum = 0;
+
+						if (seg_begin >= seg_end)
+						{
+							return 0;
+						}
+
+						if (y == 0 || y == height - 1 || width < 3)
+						{
+							for (int x = seg_begin; x < seg_end; ++x)
+							{
+								sum += cell(x, y);
+							}
+							return sum;
+						}
+
+						int run_begin = seg_begin;
+						int run_end = seg_end;
+
+						if (run_begin == 0)
+						{
+							sum += cell(0, y);
+							run_begin = 1;
+						}
+						if (run_end == width)
+						{
+							run_end = width - 1;
+						}
+						if (run_begin < run_end)
+						{
+							sum += row_fn(src.Row(y, ly0), global_rhs.Row(y, ly0), dst.Row(y, ly0),
+										  run_begin - lx0, run_end - lx0, src.pitch);
+						}
+						if (seg_end == width)
+						{
+							sum += cell(width - 1, y);
+						}
+						return sum;
+					};
+
+					//rows this sweep relaxes, the last sweep is just the tile's
+					int grow = sweeps - 1 - sweep;
+					int y_begin_sweep = glm::max(ty0 - grow, 0);
+					int y_end_sweep = glm::min(ty1 + grow, height);
+
+					for (int y = y_begin_sweep; y < y_end_sweep; ++y)
+					{
+						bool tile_row = y >= ty0 && y < ty1;
+
+						//only the tile's own cells count towards the residual, the halo belongs to other
+						//tiles. the last sweep writes to 'out', so it must leave the halo alone
+						if (sweep < sweeps - 1)
+						{
+							if (!tile_row)
+							{
+								segment(x_begin, x_end, y);
+								continue;
+							}
+							segment(x_begin, tx0, y);
+							segment(tx1, x_end, y);
+						}
+
+						sums[sweep] += segment(tx0, tx1, y);
+					}
+				}
+			}
+		}
+	});
+
+	for (int sweep = 0; sweep < sweeps; ++sweep)
+	{
+		sweep_residuals[sweep] = 0;
+		for (int band = 0; band < bands; ++band)
+		{
+			sweep_residuals[sweep] += band_sums[band][sweep];
+		}
+	}
+}
+
+float* DIYFluid::GetTileScratch(int sweeps)
+{
+	int floats = this->workers->thread_count * 2 * TileBufferFloats(this->tile_size, sweeps);
+
+	if (floats > this->tile_scratch_floats)
+	{
+		if (this->tile_scratch)
+		{
+			FreeFluidPlane(this->tile_scratch);
+		}
+		this->tile_scratch = AllocFluidPlane(floats, 1);
+		this->tile_scratch_floats = floats;
+	}
+
+	return this->tile_scratch;
+}
+
+void DIYFluid::DiffuseTiled(float dt, int sweeps, float* sweep_residuals)
+{
+	float inv_vdt = 1.0f / (this->viscosity * dt);
+	float diag = 4 + inv_vdt;
+	float denom = 1.0f / diag;
+	float residual_scale = diag / inv_vdt;
+
+	const FluidKernels* kernels = this->kernels;
+
+	auto row_fn = [&](const float* in, const float* rhs, float* out, int begin, int end, int pitch) -> float
+	{
+		return kernels->diffuse_row(in, rhs, out, begin, end, pitch, inv_vdt, denom, residual_scale);
+	};
+
+	auto cell_fn = [&](float centre, float left, float right, float down, float up, float rhs, float* result) -> float
+	{
+		float diffused = (up + right + down + left + rhs * inv_vdt) * denom;
+		*result = diffused;
+
+		float r = (diffused - centre) * residual_scale;
+		return r * r;
+	};
+
+	float* scratch = GetTileScratch(sweeps);
+	float y_residuals[MAX_TILE_SWEEPS];
+
+	TiledJacobi(this->workers, this->width, this->height, this->pitch,
+				this->front_cells.velocity_x, this->diffuse_source_x, this->back_cells.velocity_x,
+				sweeps, this->tile_size, scratch, row_fn, cell_fn, sweep_residuals);
+	TiledJacobi(this->workers, this->width, this->height, this->pitch,
+				this->front_cells.velocity_y, this->diffuse_source_y, this->back_cells.velocity_y,
+				sweeps, this->tile_size, scratch, row_fn, cell_fn, y_residuals);
+
+	for (int sweep = 0; sweep < sweeps; ++sweep)
+	{
+		sweep_residuals[sweep] += y_residuals[sweep];
+	}
+}
+
+void DIYFluid::UpdatePressureTiled(float dt, int sweeps, float* sweep_residuals)
+{
+	float h2 = this->cell_dist * this->cell_dist;
+	float inv_h2 = 1.0f / h2;
+
+	const FluidKernels* kernels = this->kernels;
+
+	auto row_fn = [&](const float* in, const float* rhs, float* out, int begin, int end, int pitch) -> float
+	{
+		return kernels->pressure_row(in, rhs, out, begin, end, pitch, h2, inv_h2);
+	};
+
+	auto cell_fn = [&](float centre, float left, float right, float down, float up, float rhs, float* result) -> float
+	{
+		float new_pressure = (up + down + left + right - rhs * h2) * 0.25f;
+		*result = new_pressure;
+
+		float r = 4.0f * (centre - new_pressure) * inv_h2;
+		return r * r;
+	};
+
+	TiledJacobi(this->workers, this->width, this->height, this->pitch,
+				this->front_cells.pressure, this->divergence, this->back_cells.pressure,
+				sweeps, this->tile_size, GetTileScratch(sweeps), row_fn, cell_fn, sweep_residuals);
+}
+
+//red-black Gauss-Seidel sweeps of the pressure equation on one level, in place
+static void SmoothLevel(FluidWorkers* workers, FluidGridLevel* grid, int sweeps)
+{
+	float h2 = grid->cell_dist * grid->cell_dist;
+	float* p = grid->pressure;
+
+	for (int sweep = 0; sweep < sweeps; ++sweep)
+	{
+		for (int colour = 0; colour < 2; ++colour)
+		{
+			workers->ParallelRows(grid->height, [&](int y_begin, int y_end, int /*band*/)
+			{
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					int yp1 = glm::clamp(y + 1, 0, grid->height - 1);
+					int ym1 = glm::clamp(y - 1, 0, grid->height - 1);
+
+					for (int x = (y + colour) & 1; x < grid->width; x += 2)
+					{
+						int cell_index = x + y * grid->pitch;
+
+						int xp1 = glm::clamp(x + 1, 0, grid->width - 1);
+						int xm1 = glm::clamp(x - 1, 0, grid->width - 1);
+
+						float p_up = p[x + yp1 * grid->pitch];
+						float p_down = p[x + ym1 * grid->pitch];
+						float p_left = p[xm1 + y * grid->pitch];
+						float p_right = p[xp1 + y * grid->pitch];
+
+						p[cell_index] = (p_up + p_down + p_left + p_right - grid->rhs[cell_index] * h2) * 0.25f;
+					}
+				}
+			});
+		}
+	}
+}
+
+//residual = rhs - laplacian(pressure), returns the sum of the squared residuals
+static float ComputeLevelResidual(FluidWorkers* workers, FluidGridLevel* grid)
+{
+	float inv_h2 = 1.0f / (grid->cell_dist * grid->cell_dist);
+	float* p = grid->pressure;
+
+	return ParallelSum(workers, grid->height, [&](int y_begin, int y_end) -> float
+	{
+		float sum_sq = 0;
+
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int yp1 = glm::clamp(y + 1, 0, grid->height - 1);
+			int ym1 = glm::clamp(y - 1, 0, grid->height - 1);
+
+			for (int x = 0; x < grid->width; ++x)
+			{
+				int cell_index = x + y * grid->pitch;
+
+				int xp1 = glm::clamp(x + 1, 0, grid->width - 1);
+				int xm1 = glm::clamp(x - 1, 0, grid->width - 1);
+
+				float p_up = p[x + yp1 * grid->pitch];
+				float p_down = p[x + ym1 * grid->pitch];
+				float p_left = p[xm1 + y * grid->pitch];
+				float p_right = p[xp1 + y * grid->pitch];
+
+				float laplacian = (p_up + p_down + p_left + p_right - 4.0f * p[cell_index]) * inv_h2;
+				float r = grid->rhs[cell_index] - laplacian;
+
+				grid->residual[cell_index] = r;
+				sum_sq += r * r;
+			}
+		}
+
+		return sum_sq;
+	});
+}
+
+//average each 2x2 block of the fine residual into the coarse rhs and clear the coarse guess
+static void RestrictResidual(FluidWorkers* workers, FluidGridLevel* fine, FluidGridLevel* coarse)
+{
+	workers->ParallelRows(coarse->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int fy = 2 * y;
+
+			for (int x = 0; x < coarse->width; ++x)
+			{
+				int fx = 2 * x;
+
+				float sum = fine->residual[fx + fy * fine->pitch] +
+							fine->residual[fx + 1 + fy * fine->pitch] +
+							fine->residual[fx + (fy + 1) * fine->pitch] +
+							fine->residual[fx + 1 + (fy + 1) * fine->pitch];
+
+				int cell_index = x + y * coarse->pitch;
+
+				coarse->rhs[cell_index] = sum * 0.25f;
+				coarse->pressure[cell_index] = 0;
+			}
+		}
+	});
+}
+
+//bilinearly interpolate the coarse correction onto the cell centres of the fine grid
+static void ProlongCorrection(FluidWorkers* workers, FluidGridLevel* coarse, FluidGridLevel* fine)
+{
+	workers->ParallelRows(fine->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			float cy = (float)y * 0.5f - 0.25f;
+			float fy = cy - floorf(cy);
+			int cy0 = glm::clamp((int)floorf(cy), 0, coarse->height - 1);
+			int cy1 = glm::clamp((int)floorf(cy) + 1, 0, coarse->height - 1);
+
+			for (int x = 0; x < fine->width; ++x)
+			{
+				float cx = (float)x * 0.5f - 0.25f;
+				float fx = cx - floorf(cx);
+				int cx0 = glm::clamp((int)floorf(cx), 0, coarse->width - 1);
+				int cx1 = glm::clamp((int)floorf(cx) + 1, 0, coarse->width - 1);
+
+				float e_b = glm::mix(coarse->pressure[cx0 + cy0 * coarse->pitch], coarse->pressure[cx1 + cy0 * coarse->pitch], fx);
+				float e_t = glm::mix(coarse->pressure[cx0 + cy1 * coarse->pitch], coarse->pressure[cx1 + cy1 * coarse->pitch], fx);
+
+				fine->pressure[x + y * fine->pitch] += glm::mix(e_b, e_t, fy);
+			}
+		}
+	});
+}
+
+void DIYFluid::VCycle(int level)
+{
+	FluidGridLevel* grid = this->levels + level;
+
+	if (level == this->level_count - 1)
+	{
+		//coarsest grid is only a handful of cells for even sized grids, just relax it until it settles
+		SmoothLevel(this->workers, grid, 50);
+		return;
+	}
+
+	SmoothLevel(this->workers, grid, 2);
+
+	ComputeLevelResidual(this->workers, grid);
+	RestrictResidual(this->workers, grid, grid + 1);
+
+	VCycle(level + 1);
+
+	ProlongCorrection(this->workers, grid + 1, grid);
+	SmoothLevel(this->workers, grid, 2);
+}
+
+void DIYFluid::SolvePressureMultigrid(float rhs_sum_sq)
+{
+	FluidGridLevel* grid = this->levels;
+
+	grid->pressure = this->front_cells.pressure;
+	grid->rhs = this->divergence;
+
+	//front_cells.pressure still holds last frame's solution, which is a good first guess
+	float threshold = this->pressure_tolerance * this->pressure_tolerance * rhs_sum_sq;
+	float residual_sum_sq = ComputeLevelResidual(this->workers, grid);
+
+	while (residual_sum_sq > threshold && this->pressure_iterations_used < this->max_vcycles)
+	{
+		VCycle(0);
+		this->pressure_iterations_used++;
+
+		residual_sum_sq = ComputeLevelResidual(this->workers, grid);
+	}
+
+	this->pressure_residual = sqrtf(residual_sum_sq / rhs_sum_sq);
+}
+
+//true if (x, y) is on the grid and an ordinary fluid cell, one of the unknowns of the PCG solve
+static inline bool IsFluidCell(const unsigned char* types, int x, int y, int width, int height, int pitch)
+{
+	return x >= 0 && y >= 0 && x < width && y < height && types[x + y * pitch] == CELL_FLUID;
+}
+
+//cells next to (x, y) on the grid that aren't solid or inflow, the diagonal of its row of the scaled pressure matrix
+static inline int OpenNeighbourCount(const unsigned char* types, int x, int y, int width, int height, int pitch)
+{
+	int count = 0;
+	int i = x + y * pitch;
+	count += x > 0 && !(types[i - 1] & CELL_FIXED_VELOCITY);
+	count += x < width - 1 && !(types[i + 1] & CELL_FIXED_VELOCITY);
+	count += y > 0 && !(types[i - pitch] & CELL_FIXED_VELOCITY);
+	count += y < height - 1 && !(types[i + pitch] & CELL_FIXED_VELOCITY);
+	return count;
+}
+
+//the pressure equations scaled by h^2 so every coefficient is a whole number: -1 for each neighbour
+//inside the grid and their count on the diagonal. an off-grid neighbour reads the cell itself like the
+//clamped jacobi sweep does, so its -1 and its share of the 4 cancel. out = A * p, returns dot(p, A * p).
+//with 'types' only fluid cells are unknowns, solid and inflow neighbours drop out like off-grid ones
+//and outflow neighbours are a known 0, so they stay on the diagonal and off the sum. other rows are 0
+static float PressureMatrixProduct(FluidWorkers* workers, const unsigned char* types, const float* p, float* out, int width, int height, int pitch)
+{
+	return ParallelSum(workers, height, [&](int y_begin, int y_end) -> float
+	{
+		double dot = 0;
+
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			const float* row = p + y * pitch;
+			const float* row_down = p + glm::max(y - 1, 0) * pitch;
+			const float* row_up = p + glm::min(y + 1, height - 1) * pitch;
+			float* row_out = out + y * pitch;
+
+			if (types)
+			{
+				for (int x = 0; x < width; ++x)
+				{
+					float product = 0;
+					if (types[x + y * pitch] == CELL_FLUID)
+					{
+						product = (float)OpenNeighbourCount(types, x, y, width, height, pitch) * row[x];
+						product -= IsFluidCell(types, x - 1, y, width, height, pitch) ? row[x - 1] : 0.0f;
+						product -= IsFluidCell(types, x + 1, y, width, height, pitch) ? row[x + 1] : 0.0f;
+						product -= IsFluidCell(types, x, y - 1, width, height, pitch) ? row_down[x] : 0.0f;
+						product -= IsFluidCell(types, x, y + 1, width, height, pitch) ? row_up[x] : 0.0f;
+					}
+					row_out[x] = product;
+					dot += (double)row[x] * product;
+				}
+				continue;
+			}
+
+			for (int x = 0; x < width; ++x)
+			{
+				int xm1 = glm::max(x - 1, 0);
+				int xp1 = glm::min(x + 1, width - 1);
+
+				float product = 4.0f * row[x] - row[xm1] - row[xp1] - row_down[x] - row_up[x];
+				row_out[x] = product;
+				dot += (double)row[x] * product;
+			}
+		}
+
+		return (float)dot;
+	});
+}
+
+//dot product of two planes, summed in doubles within each band since conjugate gradient is
+//a lot less forgiving of rounding in these than the jacobi residuals are
+static float PlaneDot(FluidWorkers* workers, const float* a, const float* b, int width, int height, int pitch)
+{
+	return ParallelSum(workers, height, [&](int y_begin, int y_end) -> float
+	{
+		double dot = 0;
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			const float* row_a = a + y * pitch;
+			const float* row_b = b + y * pitch;
+			for (int x = 0; x < width; ++x)
+			{
+				dot += (double)row_a[x] * row_b[x];
+			}
+		}
+		return (float)dot;
+	});
+}
+
+//modified incomplete cholesky, MIC(0), of the matrix in PressureMatrixProduct. only the inverse of
+//the factor's diagonal is kept, the off diagonal entries are the matrix's own -1s.
+//the fill-in that IC(0) throws away is added back onto the diagonal scaled by pcg_tau, which keeps
+//the factor's row sums close to the matrix's and is what makes MIC(0) work so much better on smooth errors
+void DIYFluid::BuildPressurePreconditioner()
+{
+	//a pivot that has lost more than this fraction of its diagonal falls back to plain jacobi
+	const float safety = 0.25f;
+	const unsigned char* types = this->cell_types;
+	int w = this->width;
+	int h = this->height;
+
+	//cells that aren't fluid get 0, which also drops their couplings from both triangular solves
+	for (int y = 0; y < h; ++y)
+	{
+		float* row = this->pcg_precon + y * this->pitch;
+		const float* row_down = row - this->pitch;
+
+		for (int x = 0; x < w; ++x)
+		{
+			if (!IsFluidCell(types, x, y, w, h, this->pitch))
+			{
+				row[x] = 0;
+				continue;
+			}
+
+			float diagonal = (float)OpenNeighbourCount(types, x, y, w, h, this->pitch);
+			float e = diagonal;
+
+			if (x > 0)
+			{
+				float left = row[x - 1];
+				e -= left * left;
+				if (IsFluidCell(types, x - 1, y + 1, w, h, this->pitch))
+				{
+					e -= this->pcg_tau * left * left;
+				}
+			}
+			if (y > 0)
+			{
+				float down = row_down[x];
+				e -= down * down;
+				if (IsFluidCell(types, x + 1, y - 1, w, h, this->pitch))
+				{
+					e -= this->pcg_tau * down * down;
+				}
+			}
+
+			if (e < safety * diagonal)
+			{
+				e = diagonal;
+			}
+
+			row[x] = diagonal > 0 ? 1.0f / sqrtf(e) : 0;
+		}
+	}
+}
+
+//z = (L L^T)^-1 r with the factor from BuildPressurePreconditioner. both triangular solves carry a
+//dependency from each cell to the one before it, so this runs on the calling thread. each row does
+//the part that only needs the row before it first, which vectorizes, and leaves the serial chain
+//along the row as one multiply and add per cell
+void DIYFluid::ApplyPressurePreconditioner(const float* r, float* z)
+{
+	int last_x = this->width - 1;
+	int last_y = this->height - 1;
+
+	//forward, L q = r, leaving q in z
+	for (int y = 0; y <= last_y; ++y)
+	{
+		const float* precon = this->pcg_precon + y * this->pitch;
+		const float* row_r = r + y * this->pitch;
+		float* row_z = z + y * this->pitch;
+
+		if (y > 0)
+		{
+			const float* precon_down = precon - this->pitch;
+			const float* z_down = row_z - this->pitch;
+			for (int x = 0; x <= last_x; ++x)
+			{
+				row_z[x] = (row_r[x] + precon_down[x] * z_down[x]) * precon[x];
+			}
+		}
+		else
+		{
+			for (int x = 0; x <= last_x; ++x)
+			{
+				row_z[x] = row_r[x] * precon[x];
+			}
+		}
+
+		//two cells a step, the second one straight from the cell before the pair so the chain is half as long
+		int x = 1;
+		for (; x + 1 <= last_x; x += 2)
+		{
+			float c0 = precon[x] * precon[x - 1];
+			float c1 = precon[x + 1] * precon[x];
+			float z_before = row_z[x - 1];
+
+			row_z[x + 1] = row_z[x + 1] + c1 * row_z[x] + c1 * c0 * z_before;
+			row_z[x] += c0 * z_before;
+		}
+		for (; x <= last_x; ++x)
+		{
+			row_z[x] += precon[x] * precon[x - 1] * row_z[x - 1];
+		}
+	}
+
+	//back, L^T z = q, right to left and top to bottom so each q is read before it's overwritten
+	for (int y = last_y; y >= 0; --y)
+	{
+		const float* precon = this->pcg_precon + y * this->pitch;
+		float* row_z = z + y * this->pitch;
+
+		if (y < last_y)
+		{
+			const float* z_up = row_z + this->pitch;
+			for (int x = 0; x <= last_x; ++x)
+			{
+				row_z[x] = (row_z[x] + precon[x] * z_up[x]) * precon[x];
+			}
+		}
+		else
+		{
+			for (int x = 0; x <= last_x; ++x)
+			{
+				row_z[x] = row_z[x] * precon[x];
+			}
+		}
+
+		int x = last_x - 1;
+		for (; x - 1 >= 0; x -= 2)
+		{
+			float c0 = precon[x] * precon[x];
+			float c1 = precon[x - 1] * precon[x - 1];
+			float z_before = row_z[x + 1];
+
+			row_z[x - 1] = row_z[x - 1] + c1 * row_z[x] + c1 * c0 * z_before;
+			row_z[x] += c0 * z_before;
+		}
+		for (; x >= 0; --x)
+		{
+			row_z[x] += precon[x] * precon[x] * row_z[x + 1];
+		}
+	}
+}
+
+void DIYFluid::SolvePressurePCG(float rhs_sum_sq)
+{
+	if (!this->pcg_precon)
+	{
+		this->pcg_precon = AllocFluidPlane(this->pitch, this->height);
+		this->pcg_residual = AllocFluidPlane(this->pitch, this->height);
+		this->pcg_aux = AllocFluidPlane(this->pitch, this->height);
+		this->pcg_search = AllocFluidPlane(this->pitch, this->height);
+	}
+
+	if (this->pcg_precon_dirty)
+	{
+		BuildPressurePreconditioner();
+		this->pcg_precon_dirty = false;
+	}
+
+	float h2 = this->cell_dist * this->cell_dist;
+	const unsigned char* types = this->has_obstacles ? this->cell_types : 0;
+
+	float* p = this->front_cells.pressure;
+	float* r = this->pcg_residual;
+	float* z = this->pcg_aux;
+	float* s = this->pcg_search;
+
+	//front_cells.pressure still holds last frame's solution, start from there. r = b - A p, b = -h^2 divergence
+	PressureMatrixProduct(this->workers, types, p, r, this->width, this->height, this->pitch);
+
+	float residual_sum_sq = ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+	{
+		float sum_sq = 0;
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int row = y * this->pitch;
+			for (int x = 0; x < this->width; ++x)
+			{
+				float residual = -h2 * this->divergence[row + x] - r[row + x];
+				r[row + x] = residual;
+				sum_sq += residual * residual;
+			}
+		}
+		return sum_sq;
+	});
+
+	//the scaled equations have residuals h^2 times the ones the other solvers report
+	float rhs_scale = h2 * h2;
+	float threshold = this->pressure_tolerance * this->pressure_tolerance * rhs_sum_sq * rhs_scale;
+
+	if (residual_sum_sq > threshold)
+	{
+		ApplyPressurePreconditioner(r, z);
+		memcpy(s, z, sizeof(float) * this->pitch * this->height);
+
+		float sigma = PlaneDot(this->workers, r, z, this->width, this->height, this->pitch);
+
+		while (this->pressure_iterations_used < this->max_pcg_iterations)
+		{
+			//z = A s for now
+			float s_dot_as = PressureMatrixProduct(this->workers, types, s, z, this->width, this->height, this->pitch);
+			if (s_dot_as <= 0)
+			{
+				break;
+			}
+
+			float alpha = sigma / s_dot_as;
+
+			residual_sum_sq = ParallelSum(this->workers, this->height, [&](int y_begin, int y_end) -> float
+			{
+				float sum_sq = 0;
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					int row = y * this->pitch;
+					for (int x = 0; x < this->width; ++x)
+					{
+						int i = row + x;
+						p[i] += alpha * s[i];
+						r[i] -= alpha * z[i];
+						sum_sq += r[i] * r[i];
+					}
+				}
+				return sum_sq;
+			});
+
+			this->pressure_iterations_used++;
+
+			if (residual_sum_sq <= threshold)
+			{
+				break;
+			}
+
+			ApplyPressurePreconditioner(r, z);
+
+			float sigma_new = PlaneDot(this->workers, r, z, this->width, this->height, this->pitch);
+			float beta = sigma_new / sigma;
+			sigma = sigma_new;
+
+			this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+			{
+				for (int y = y_begin; y < y_end; ++y)
+				{
+					int row = y * this->pitch;
+					for (int x = 0; x < this->width; ++x)
+					{
+						s[row + x] = z[row + x] + beta * s[row + x];
+					}
+				}
+			});
+		}
+	}
+
+	this->pressure_residual = sqrtf(residual_sum_sq / (rhs_sum_sq * rhs_scale));
+}
+
+void DIYFluid::ApplyPressure(float dt)
+{
+	if (this->layout == GRID_STAGGERED)
+	{
+		//each face takes the difference of the two cells it sits between. the faces on the
+		//walls only have one, and stay closed
+		float inv_face_dist = 1.0f / cell_dist;
+		const float* p = this->front_cells.pressure;
+
+		this->workers->ParallelRows(this->height + 1, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				int row = y * this->pitch;
+
+				if (y < this->height)
+				{
+					this->back_cells.velocity_x[row] = 0;
+					this->back_cells.velocity_x[row + this->width] = 0;
+					this->kernels->subtract_gradient_row(p, this->front_cells.velocity_x, this->back_cells.velocity_x,
+														 row + 1, row + this->width, 1, inv_face_dist);
+				}
+
+				if (y == 0 || y == this->height)
+				{
+					memset(this->back_cells.velocity_y + row, 0, sizeof(float) * this->width);
+				}
+				else
+				{
+					this->kernels->subtract_gradient_row(p, this->front_cells.velocity_y, this->back_cells.velocity_y,
+														 row, row + this->width, this->pitch, inv_face_dist);
+				}
+			}
+		});
+		return;
+	}
+
+	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+
+	const float* p = this->front_cells.pressure;
+
+	const unsigned char* types = this->cell_types;
+
+	auto interior = [&](int y, int x_begin, int x_end) -> float
+	{
+		int row = y * this->pitch;
+		this->kernels->apply_pressure_row(p, this->front_cells.velocity_x, this->front_cells.velocity_y,
+										  this->back_cells.velocity_x, this->back_cells.velocity_y,
+										  row + x_begin, row + x_end, this->pitch, inv_cell_dist);
+		return 0;
+	};
+
+	auto edge_cell = [&](int x, int y) -> float
+	{
+		int cell_index = x + y * this->pitch;
+
+		int xp1 = glm::clamp(x + 1, 0, this->width - 1);
+		int xm1 = glm::clamp(x - 1, 0, this->width - 1);
+		int yp1 = glm::clamp(y + 1, 0, this->height - 1);
+		int ym1 = glm::clamp(y - 1, 0, this->height - 1);
+
+		float p_c = p[cell_index];
+		float p_up = NeighbourPressure(p, types, x + yp1 * this->pitch, p_c);
+		float p_down = NeighbourPressure(p, types, x + ym1 * this->pitch, p_c);
+		float p_left = NeighbourPressure(p, types, xm1 + y * this->pitch, p_c);
+		float p_right = NeighbourPressure(p, types, xp1 + y * this->pitch, p_c);
+
+		this->back_cells.velocity_x[cell_index] = this->front_cells.velocity_x[cell_index] + (p_left - p_right) * inv_cell_dist;
+		this->back_cells.velocity_y[cell_index] = this->front_cells.velocity_y[cell_index] + (p_down - p_up) * inv_cell_dist;
+		return 0;
+	};
+
+	this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		StencilRows(*this->stage_spans, *this->stage_row_spans, y_begin, y_end, edge_cell, interior);
+	});
+}
+
+void DIYFluid::UpdateBoundary()
+{
+
+	float* p = this->front_cells.pressure;
+	float* vx = this->front_cells.velocity_x;
+	float* vy = this->front_cells.velocity_y;
+
+	//staggered velocities sit on the walls themselves and ApplyPressure has already closed them,
+	//collocated ones are mirrored so the wall between the last two cells has no flow through it
+	bool mirror_velocity = this->layout == GRID_COLLOCATED;
+
+	for (int x = 0; x < this->width; x++)
+	{
+
+		//first rows
+		int first_row_index = x;
+		int second_row_index = x + this->pitch;
+
+		p[first_row_index] = p[second_row_index];
+
+		//last rows
+		int last_row_index = x + (this->height - 1) * this->pitch;
+		int second_last_row_index = x + (this->height - 2) * this->pitch;
+
+		p[last_row_index] =    p[second_last_row_index];
+
+		if (mirror_velocity)
+		{
+			vx[first_row_index] = vx[second_row_index];
+			vy[first_row_index] = -vy[second_row_index];
+
+			vx[last_row_index] =  vx[second_last_row_index];
+			vy[last_row_index] = -vy[second_last_row_index];
+		}
+	}
+
+	for (int y = 0; y < this->height; y++)
+	{
+		int first_col_index = 0 + y * this->pitch;
+		int second_col_index = 1 + y * this->pitch;
+
+		int last_col_index = (this->width - 1) + y * this->pitch;
+		int second_last_col_index = (this->width - 2) + y * this->pitch;
+
+		p[first_col_index] = p[second_col_index];
+		p[last_col_index] = p[second_last_col_index];
+
+		if (mirror_velocity)
+		{
+			vx[first_col_index] = -vx[second_col_index];
+			vy[first_col_index] = vy[second_col_index];
+
+			vx[last_col_index] = -vx[second_last_col_index];
+			vy[last_col_index] = vy[second_last_col_index];
+		}
+	}
+}
+
+//vorticity confinement acceleration at cell (x, y), from the curl plane. pushes sideways from the
+//slope of |curl| so each swirl spins about the peak of its own vorticity
+static inline glm::vec2 ConfinementForce(const float* curl, int x, int y, int width, int height, int pitch, float scale)
+{
+	int xp1 = glm::min(x + 1, width - 1);
+	int xm1 = glm::max(x - 1, 0);
+	int yp1 = glm::min(y + 1, height - 1);
+	int ym1 = glm::max(y - 1, 0);
+
+	glm::vec2 slope = glm::vec2(fabsf(curl[xp1 + y * pitch]) - fabsf(curl[xm1 + y * pitch]),
+								fabsf(curl[x + yp1 * pitch]) - fabsf(curl[x + ym1 * pitch]));
+
+	//flat |curl| has no direction to push in
+	float length_sq = glm::dot(slope, slope);
+	if (length_sq < 1e-20f)
+	{
+		return glm::vec2(0);
+	}
+
+	float w = curl[x + y * pitch] * scale / sqrtf(length_sq);
+	return glm::vec2(slope.y * w, -slope.x * w);
+}
+
+void DIYFluid::AddForces(float dt)
+{
+	float* vx = this->front_cells.velocity_x;
+	float* vy = this->front_cells.velocity_y;
+	bool staggered = this->layout == GRID_STAGGERED;
+	bool confine = this->vorticity_confinement > 0;
+
+	if (confine)
+	{
+		if (!this->curl)
+		{
+			this->curl = AllocFluidPlane(this->pitch, this->height);
+		}
+
+		//curl at the cell centres. staggered faces are averaged to the centres first
+		float inv_2h = 1.0f / (2.0f * this->cell_dist);
+
+		auto centre_x = [&](int x, int y) -> float
+		{
+			int i = x + y * this->pitch;
+			return staggered ? 0.5f * (vx[i] + vx[i + 1]) : vx[i];
+		};
+		auto centre_y = [&](int x, int y) -> float
+		{
+			int i = x + y * this->pitch;
+			return staggered ? 0.5f * (vy[i] + vy[i + this->pitch]) : vy[i];
+		};
+
+		this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; ++y)
+			{
+				int yp1 = glm::min(y + 1, this->height - 1);
+				int ym1 = glm::max(y - 1, 0);
+
+				for (int x = 0; x < this->width; ++x)
+				{
+					int xp1 = glm::min(x + 1, this->width - 1);
+					int xm1 = glm::max(x - 1, 0);
+
+					this->curl[x + y * this->pitch] = ((centre_y(xp1, y) - centre_y(xm1, y)) -
+													   (centre_x(x, yp1) - centre_x(x, ym1))) * inv_2h;
+				}
+			}
+		});
+	}
+
+	float scale = this->vorticity_confinement * this->cell_dist * dt;
+
+	//the box that stirs the fluid, kept inside the grid as small grids would otherwise
+	//write into the padding or past the planes
+	int box_size = 10;
+	int half_box_size = box_size / 2;
+
+	int box_x_begin = glm::max(width / 2 - half_box_size, 0);
+	int box_x_end = glm::min(width / 2 + half_box_size, this->width);
+	int box_y_begin = 5;
+	int box_y_end = glm::min(5 + box_size, this->height);
+
+	//staggered v faces have a row more than there are cells
+	int velocity_rows = staggered ? this->height + 1 : this->height;
+
+	this->workers->ParallelRows(velocity_rows, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int row = y * this->pitch;
+
+			if (confine && !staggered)
+			{
+				for (int x = 0; x < this->width; ++x)
+				{
+					glm::vec2 force = ConfinementForce(this->curl, x, y, this->width, this->height, this->pitch, scale);
+					vx[row + x] += force.x;
+					vy[row + x] += force.y;
+				}
+			}
+			else if (confine)
+			{
+				//each inside face takes the average of the cells either side, the wall faces stay closed
+				if (y < this->height)
+				{
+					for (int x = 1; x < this->width; ++x)
+					{
+						vx[row + x] += 0.5f * (ConfinementForce(this->curl, x - 1, y, this->width, this->height, this->pitch, scale).x +
+											   ConfinementForce(this->curl, x, y, this->width, this->height, this->pitch, scale).x);
+					}
+				}
+				if (y > 0 && y < this->height)
+				{
+					for (int x = 0; x < this->width; ++x)
+					{
+						vy[row + x] += 0.5f * (ConfinementForce(this->curl, x, y - 1, this->width, this->height, this->pitch, scale).y +
+											   ConfinementForce(this->curl, x, y, this->width, this->height, this->pitch, scale).y);
+					}
+				}
+			}
+
+			if (y >= box_y_begin && y < box_y_end)
+			{
+				for (int x = box_x_begin; x < box_x_end; ++x)
+				{
+					vy[row + x] += 10 * dt;
+				}
+			}
+		}
+	});
+}
+
+#ifndef DIYFLUID_HEADLESS
+
+void DIYFluid::RenderFluid(glm::mat4 viewProj)
+{
+	unsigned int upload_buffer = this->upload_buffers[this->upload_index];
+	this->upload_index ^= 1;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+
+	//invalidating means the map doesn't wait on whatever the buffer held before
+	unsigned char* tex_data = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, this->width * this->height * 4,
+															   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+	if (tex_data)
+	{
+		bool half_dye = this->dye_storage == DYE_FLOAT16;
+
+		this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+		{
+			for (int y = y_begin; y < y_end; y++)
+			{
+				int row = y * this->pitch;
+				unsigned char* row_pixels = tex_data + y * this->width * 4;
+
+				if (!half_dye)
+				{
+					this->kernels->dye_to_rgba8_row(this->front_cells.dye_r + row, this->front_cells.dye_g + row, this->front_cells.dye_b + row,
+													row_pixels, this->width);
+					continue;
+				}
+
+				//fp16 dye goes through floats a chunk at a time on its way to bytes
+				float r[HALF_CHUNK], g[HALF_CHUNK], b[HALF_CHUNK];
+				for (int x = 0; x < this->width; x += HALF_CHUNK)
+				{
+					int count = glm::min(HALF_CHUNK, this->width - x);
+					this->kernels->half_to_float_row(this->front_cells.dye_half_r + row + x, r, count);
+					this->kernels->half_to_float_row(this->front_cells.dye_half_g + row + x, g, count);
+					this->kernels->half_to_float_row(this->front_cells.dye_half_b + row + x, b, count);
+					this->kernels->dye_to_rgba8_row(r, g, b, row_pixels + x * 4, count);
+				}
+			}
+		});
+
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		//with a buffer bound the last argument is an offset into it, so this only queues a copy and returns
+		glBindTexture(GL_TEXTURE_2D, this->texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	RenderQuad(this->quad_vao, this->program, this->texture, viewProj);
+}
+
+#endif
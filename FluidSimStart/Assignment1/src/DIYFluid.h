@@ -1,31 +1,201 @@
 #include "glm/glm.hpp"
+#include "FluidKernels.h"
+
+#include <vector>
 
 
 #pragma once
 
+class FluidWorkers;
+
+//each field is its own plane of floats so the stencils only stream what they use.
+//cell (x, y) is at x + y * pitch, see DIYFluid::pitch. with GRID_STAGGERED the velocities are
+//on faces instead, and their planes have one more column and row for the faces on the far walls
 struct FluidCells
 {
 	float *pressure;
-	glm::vec2 *velocity;
-	glm::vec3 *dye_colour;
+	float *velocity_x;
+	float *velocity_y;
+	float *dye_r;
+	float *dye_g;
+	float *dye_b;
+
+	//the dye as fp16 when it is stored that way, see DIYFluid::dye_format. only one of
+	//these and the float dye planes is allocated at a time, the others are 0
+	unsigned short *dye_half_r;
+	unsigned short *dye_half_g;
+	unsigned short *dye_half_b;
+};
+
+//one level of the multigrid pressure hierarchy, level 0 is the full grid
+struct FluidGridLevel
+{
+	int width, height;
+	int pitch;
+	float cell_dist;
+
+	float *pressure;
+	float *rhs;
+	float *residual;
+};
+
+enum PressureSolver
+{
+	PRESSURE_JACOBI = 0,
+	PRESSURE_MULTIGRID = 1,
+	PRESSURE_PCG = 2,		//conjugate gradient with a modified incomplete cholesky preconditioner
+};
+
+//how Diffuse and UpdatePressure relax their systems
+enum FluidSmoother
+{
+	SMOOTH_JACOBI = 0,			//ping-pong between front_cells and back_cells
+	SMOOTH_RED_BLACK_SOR = 1,	//in place on front_cells, red cells then black cells
+	SMOOTH_TILED_JACOBI = 2,	//jacobi, but several sweeps at a time on cache sized tiles of the grid
+};
+
+//how Advect moves velocity and dye along the flow
+enum FluidAdvection
+{
+	ADVECT_SEMI_LAGRANGIAN = 0,	//one bilinear sample traced back from each cell
+	ADVECT_MACCORMACK = 1,		//traces back, then forward again to estimate and cancel most of the first step's error
+};
+
+//where the velocity components are stored, pick one before the first UpdateFluid
+enum FluidGridLayout
+{
+	GRID_COLLOCATED = 0,	//both at the cell centre, differences are taken across the cells either side
+	GRID_STAGGERED = 1,		//MAC grid, velocity_x(x, y) on the face between cells x - 1 and x, velocity_y(x, y) between y - 1 and y
+};
+
+//how the dye planes are stored. the arithmetic on them is in floats either way
+enum FluidDyeFormat
+{
+	DYE_FLOAT32 = 0,
+	DYE_FLOAT16 = 1,	//half the memory and bandwidth, 11 bits of precision. converted a chunk of a row at a time as it's used
+};
+
+//what a cell is, one byte per cell in DIYFluid::cell_types. 0 is ordinary fluid
+enum FluidCellFlags
+{
+	CELL_FLUID = 0,
+	CELL_SOLID = 1,		//an obstacle, velocity is the obstacle's and no pressure gradient crosses into it
+	CELL_INFLOW = 2,	//velocity and dye are set from outside, otherwise a wall to the pressure solve
+	CELL_OUTFLOW = 4,	//open to the outside, pressure held at 0 so fluid can leave
+
+	CELL_FIXED_VELOCITY = CELL_SOLID | CELL_INFLOW,
+};
+
+//how a stencil stage treats a run of cells along a row, see DIYFluid::BuildSpans
+enum FluidSpanKind
+{
+	SPAN_INTERIOR = 0,	//fluid with 4 fluid neighbours, handed to the simd kernels as one run
+	SPAN_EDGE = 1,		//on the grid edge, next to a non-fluid cell, or outflow. done a cell at a time
+	SPAN_FIXED = 2,		//solid or inflow, the solvers skip these
+};
+
+struct FluidSpan
+{
+	int begin, end;		//cells [begin, end) of the row
+	FluidSpanKind kind;
+};
+
+//cells along each side of a DIYFluid::sparse_tiles tile
+static const int SPARSE_TILE_SIZE = 16;
+
+//longest run of sweeps SMOOTH_TILED_JACOBI does on a tile before writing it back
+static const int MAX_TILE_SWEEPS = 16;
+
+//time spent in each stage of the last UpdateFluid call, in milliseconds
+struct FluidStageTimings
+{
+	double advect_ms;
+	double diffuse_ms;
+	double divergence_ms;
+	double pressure_ms;
+	double apply_pressure_ms;
+	double boundary_ms;
+	double forces_ms;
+	double tiles_ms;	//sparse_tiles bookkeeping
 };
 
 class DIYFluid
 {
 public:
-	DIYFluid(int _width, int _height, float _viscosity, float _cell_dist);
+	//_thread_count of 0 uses one thread per hardware thread
+	DIYFluid(int _width, int _height, float _viscosity, float _cell_dist, int _thread_count = 0);
 	~DIYFluid();
 
-	void UpdateFluid(float dt);
+	void SetThreadCount(int thread_count);
+	void SetSimd(FluidSimd simd);	//defaults to the widest the cpu supports
+
+	void UpdateFluid(float dt);		//one step of dt, however long it is
+
+	//adds a frame's time to the accumulator and runs whole fixed_dt steps out of it, each split into
+	//as many substeps as the cfl limit needs. returns how many UpdateFluid calls it made
+	int AdvanceFluid(float frame_dt);
+	float MaxCellSpeed();			//upper bound on how many cells a second anything on the grid moves
+#ifndef DIYFLUID_HEADLESS
 	void RenderFluid(glm::mat4 viewProj);
+#endif
 
 	//update parts
-	void Advect(float dt);
-	void Diffuse(float dt);
+	void Advect(float dt);			//front_cells into back_cells, see advection
+	void AdvectStaggered(float dt, bool maccormack);
+	void AdvectDyeHalf(float dt, bool maccormack);	//Advect's dye when it is stored as fp16
+	float Diffuse(float dt);		//one Jacobi sweep, returns the squared residual of the velocity it read
 	void Divergence(float dt);
-	void UpdatePressure(float dt);
+	float UpdatePressure(float dt);	//one Jacobi sweep, returns the squared residual of the pressure it read
 	void ApplyPressure(float dt);
 	void UpdateBoundary();
+	void AddForces(float dt);		//vorticity confinement and the stirring box, one pass over the velocities
+
+	//red-black SOR versions of Diffuse and UpdatePressure, these update front_cells in place.
+	//a sweep is two passes over the grid, one per colour, and costs about twice a Jacobi sweep, so
+	//SOR only wins on wall time when it's let run to the tolerance: at 256x256 it gets there in
+	//under half the sweeps and ~30% less time. at the default iteration caps both stop on the cap
+	//and SOR is the slower of the two, though with a smaller residual
+	float DiffuseSOR(float dt);
+	float UpdatePressureSOR(float dt);
+
+	//'sweeps' Jacobi sweeps from front_cells into back_cells, run tile by tile with a halo so
+	//each tile stays in cache for all of them. the residual of the input to every sweep goes in sweep_residuals.
+	//it only pays once the planes are far bigger than the cache: on one thread a pressure sweep took
+	//~40% less time than plain Jacobi at 3072x3072 and 4096x4096, but at 2048x2048 and below the halo
+	//work cancels out what it saves and it is no faster, sometimes a little slower
+	void DiffuseTiled(float dt, int sweeps, float* sweep_residuals);
+	void UpdatePressureTiled(float dt, int sweeps, float* sweep_residuals);
+	float* GetTileScratch(int sweeps);
+
+	//iterate the stages above until their residual is under tolerance
+	void SolveDiffusion(float dt);
+	void SolvePressure(float dt);
+
+	//multigrid pressure projection, used in place of the UpdatePressure loop
+	void SolvePressureMultigrid(float rhs_sum_sq);
+	void VCycle(int level);
+
+	//preconditioned conjugate gradient pressure projection, also used in place of the UpdatePressure loop
+	void SolvePressurePCG(float rhs_sum_sq);
+	void BuildPressurePreconditioner();
+	void ApplyPressurePreconditioner(const float* r, float* z);
+
+	//obstacles and open boundaries. cells start out as CELL_FLUID, velocity is what a solid or
+	//inflow cell moves at. changes are picked up at the start of the next UpdateFluid
+	void SetCellType(int x, int y, unsigned char type, glm::vec2 velocity = glm::vec2(0));
+	void ClearCellTypes(unsigned char type);	//every cell with any of 'type's flags goes back to fluid
+	void BuildSpans();
+	void BuildRegions();
+	void RemoveRegionMeans();
+	void ApplyObstacles(FluidCells* cells);		//fixed velocities into solid and inflow cells, dye into inflow ones
+
+	//sparse_tiles. which tiles are live for this frame's stages, and the spans cut down to them
+	bool SparseSupported();
+	void BuildLiveSpans();
+	void UpdateTileActivity();
+
+	//moves the dye into planes of the given format, front_cells and back_cells both
+	void StoreDye(FluidDyeFormat format);
 
 	void SwapColors();
 	void SwapVelocities();
@@ -40,8 +210,130 @@ public:
 	FluidCells back_cells;
 
 	float* divergence;
+	float* diffuse_source_x;	//advected velocity, the right hand side of the diffusion solve
+	float* diffuse_source_y;
+
+	//per cell flags from FluidCellFlags, pitch bytes a row, and the velocity of each solid or inflow cell
+	unsigned char* cell_types;
+	float* obstacle_velocity_x;
+	float* obstacle_velocity_y;
+	glm::vec3 inflow_dye;
+	bool cell_types_changed;
+
+	//cell_types as runs for the stencil stages, the spans of row y are [row_spans[y], row_spans[y + 1]).
+	//with no obstacles every row is the edge cell, an interior run and the other edge cell
+	std::vector<FluidSpan> spans;
+	std::vector<int> row_spans;
+	std::vector<int> outflow_cells;
+	unsigned char* span_types;	//cell_types the spans were built from
+	bool has_obstacles;			//any cell that isn't CELL_FLUID
+	bool has_outflow;
+
+	//connected groups of cells that aren't solid or inflow, only labelled when there are obstacles.
+	//a group that obstacles have sealed off needs its own divergence to sum to 0
+	std::vector<int> cell_regions;		//group of each cell, -1 for solid and inflow. pitch ints a row
+	std::vector<bool> region_open;		//group has an outflow cell
+	std::vector<double> region_sums;	//Divergence's scratch
+	std::vector<int> region_cells;
+
+	//strength of the vorticity confinement in AddForces, 0 turns it off. puts back the small swirls
+	//that advection and diffusion smear out, so a coarser grid keeps much the same look
+	float vorticity_confinement;
+	float* curl;	//of the velocity at each cell centre, allocated the first time confinement runs
+
+	//with sparse_tiles on, the stages only run on tiles whose velocity got over activity_threshold
+	//last frame and the tiles around them, everywhere else is left as it is. it needs the collocated
+	//layout, semi-lagrangian advection, jacobi solves and no vorticity confinement, anything else runs dense
+	bool sparse_tiles;
+	float activity_threshold;
+	bool sparse_running;		//last frame ran sparse
+	int tiles_x, tiles_y;
+	std::vector<unsigned char> tile_active;
+	std::vector<unsigned char> tile_live;		//active or next to an active tile
+	std::vector<int> tile_row_live;				//live tiles in each row of tiles
+	std::vector<FluidSpan> live_spans;			//spans cut down to the live tiles
+	std::vector<int> live_row_spans;
+	int live_tile_count;
+
+	//what the stages run over this frame, spans or live_spans, and how many cells that is
+	const std::vector<FluidSpan>* stage_spans;
+	const std::vector<int>* stage_row_spans;
+	int stage_cell_count;
+
+	FluidGridLayout layout;
+	FluidAdvection advection;
+	FluidCells advect_cells;	//ADVECT_MACCORMACK's corrected result, allocated the first time it runs. pressure is unused
+
+	//set dye_format any time, the planes are converted at the start of the next UpdateFluid.
+	//dye_storage is what they are now
+	FluidDyeFormat dye_format;
+	FluidDyeFormat dye_storage;
 
 	int width, height;
+	int pitch;	//floats between rows of every plane, padded to a whole number of simd registers
+
+	FluidSmoother smoother;
+	float diffuse_omega;	//over-relaxation factors for SMOOTH_RED_BLACK_SOR, 1 is plain Gauss-Seidel
+	float pressure_omega;
+
+	int tile_size;		//cells along each side of a SMOOTH_TILED_JACOBI tile, not counting its halo
+	int tile_sweeps;	//sweeps per tile before moving on, at most MAX_TILE_SWEEPS
+	float* tile_scratch;	//per thread copies of the tile being worked on
+	int tile_scratch_floats;
+
+	//iterative stages stop once |residual| / |right hand side| drops below their tolerance,
+	//or when they hit the iteration cap. the last frame's counts and residuals are kept for profiling
+	float diffuse_tolerance;
+	int max_diffuse_iterations;
+	int diffuse_iterations_used;
+	int diffuse_iterations_needed;	//sweep that first met the tolerance, sizes the next frame's first tiled block
+	float diffuse_residual;
+
+	PressureSolver pressure_solver;
+	float pressure_tolerance;
+	int max_pressure_iterations;	//Jacobi sweeps
+	int max_vcycles;				//multigrid cycles
+	int max_pcg_iterations;			//conjugate gradient iterations
+	int pressure_iterations_used;
+	int pressure_iterations_needed;
+	float pressure_residual;
+
+	FluidGridLevel* levels;
+	int level_count;
+
+	//PRESSURE_PCG planes, allocated the first time it runs
+	float* pcg_precon;		//1 / diagonal of the MIC(0) factor of the pressure matrix
+	float* pcg_residual;
+	float* pcg_aux;			//preconditioned residual, and the matrix times the search direction
+	float* pcg_search;
+	float pcg_tau;			//how much of the dropped fill-in MIC(0) puts back on the diagonal, 0 is plain IC(0)
+	bool pcg_precon_dirty;	//cell types changed since the preconditioner was built
+
+	//AdvanceFluid's clock. nothing may move more than cfl_number cells in one substep, up to max_substeps
+	//of them a step. a frame runs at most max_frame_updates UpdateFluid calls and drops what it hasn't
+	//caught up with by then, so a hitch slows the fluid down for a frame instead of blowing it up
+	float fixed_dt;
+	float cfl_number;
+	int max_substeps;
+	int max_frame_updates;
+	float step_accumulator;		//time owed to the fluid, under fixed_dt between frames
+	float step_dt;				//length of the last substep run
+	int frame_steps;			//last AdvanceFluid's fixed steps, substeps and dropped time, for profiling
+	int frame_updates;
+	float frame_dropped_time;
+
+	FluidStageTimings timings;
+
+	FluidWorkers* workers;	//every stage is split into bands of rows across these
+	const FluidKernels* kernels;	//simd row kernels for the interior of the stencil stages
 
 	unsigned int program;
-};
\ No newline at end of file
+
+	//render resources, made once in the constructor. each frame's dye goes into one of the two
+	//pixel unpack buffers and is copied to texture from there, alternating so the driver can still
+	//be reading last frame's while this one is written
+	unsigned int texture;
+	unsigned int quad_vao;
+	unsigned int upload_buffers[2];
+	int upload_index;
+};
@@ -0,0 +1,663 @@
+#include "DIYFluid3D.h"
+#include "FluidWorkers.h"
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+//milliseconds since some fixed point, only used to time the update stages
+static double FluidTimeMS()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+void DIYFluid3D::SwapSmoke()
+{
+	std::swap(this->front_cells.smoke, this->back_cells.smoke);
+}
+
+void DIYFluid3D::SwapVelocities()
+{
+	std::swap(this->front_cells.velocity_x, this->back_cells.velocity_x);
+	std::swap(this->front_cells.velocity_y, this->back_cells.velocity_y);
+	std::swap(this->front_cells.velocity_z, this->back_cells.velocity_z);
+}
+
+void DIYFluid3D::SwapPressures()
+{
+	std::swap(this->front_cells.pressure, this->back_cells.pressure);
+}
+
+DIYFluid3D::DIYFluid3D(int _width, int _height, int _depth, float _viscosity, float _cell_dist, int _thread_count)
+{
+	this->width = _width;
+	this->height = _height;
+	this->depth = _depth;
+	this->viscosity = _viscosity;
+	this->cell_dist = _cell_dist;
+
+	this->pitch = FluidRowPitch(_width);
+	this->slice = this->pitch * _height;
+
+	//every plane is height * depth rows of pitch floats
+	int rows = _height * _depth;
+
+	FluidCells3D* both_cells[2] = { &this->front_cells, &this->back_cells };
+	for (int i = 0; i < 2; ++i)
+	{
+		both_cells[i]->pressure = AllocFluidPlane(this->pitch, rows);
+		both_cells[i]->velocity_x = AllocFluidPlane(this->pitch, rows);
+		both_cells[i]->velocity_y = AllocFluidPlane(this->pitch, rows);
+		both_cells[i]->velocity_z = AllocFluidPlane(this->pitch, rows);
+		both_cells[i]->smoke = AllocFluidPlane(this->pitch, rows);
+	}
+
+	this->divergence = AllocFluidPlane(this->pitch, rows);
+	this->diffuse_source_x = AllocFluidPlane(this->pitch, rows);
+	this->diffuse_source_y = AllocFluidPlane(this->pitch, rows);
+	this->diffuse_source_z = AllocFluidPlane(this->pitch, rows);
+
+	this->diffuse_tolerance = 1e-3f;
+	this->max_diffuse_iterations = 50;
+	this->diffuse_iterations_used = 0;
+	this->diffuse_residual = 0;
+
+	this->pressure_tolerance = 1e-3f;
+	this->max_pressure_iterations = 60;
+	this->pressure_iterations_used = 0;
+	this->pressure_residual = 0;
+
+	this->workers = new FluidWorkers(_thread_count);
+	this->kernels = SelectFluidKernels();
+
+	memset(&this->timings, 0, sizeof(FluidStageTimings));
+}
+
+DIYFluid3D::~DIYFluid3D()
+{
+	FreeFluidPlane(this->divergence);
+	FreeFluidPlane(this->diffuse_source_x);
+	FreeFluidPlane(this->diffuse_source_y);
+	FreeFluidPlane(this->diffuse_source_z);
+
+	FluidCells3D* both_cells[2] = { &this->front_cells, &this->back_cells };
+	for (int i = 0; i < 2; ++i)
+	{
+		FreeFluidPlane(both_cells[i]->pressure);
+		FreeFluidPlane(both_cells[i]->velocity_x);
+		FreeFluidPlane(both_cells[i]->velocity_y);
+		FreeFluidPlane(both_cells[i]->velocity_z);
+		FreeFluidPlane(both_cells[i]->smoke);
+	}
+
+	delete this->workers;
+}
+
+void DIYFluid3D::SetThreadCount(int thread_count)
+{
+	delete this->workers;
+	this->workers = new FluidWorkers(thread_count);
+}
+
+void DIYFluid3D::SetSimd(FluidSimd simd)
+{
+	this->kernels = GetFluidKernels(simd);
+}
+
+void DIYFluid3D::UpdateFluid(float dt)
+{
+	double stage_start = FluidTimeMS();
+	double stage_end;
+
+	Advect(dt);
+	SwapVelocities();
+	SwapSmoke();
+
+	stage_end = FluidTimeMS();
+	this->timings.advect_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	SolveDiffusion(dt);
+
+	stage_end = FluidTimeMS();
+	this->timings.diffuse_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	Divergence();
+
+	stage_end = FluidTimeMS();
+	this->timings.divergence_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	SolvePressure();
+
+	stage_end = FluidTimeMS();
+	this->timings.pressure_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	ApplyPressure();
+	SwapVelocities();
+
+	stage_end = FluidTimeMS();
+	this->timings.apply_pressure_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	UpdateBoundary();
+
+	stage_end = FluidTimeMS();
+	this->timings.boundary_ms = stage_end - stage_start;
+	stage_start = stage_end;
+
+	//ahead of the next frame's advection and projection
+	AddForces(dt);
+
+	this->timings.forces_ms = FluidTimeMS() - stage_start;
+	this->timings.tiles_ms = 0;
+}
+
+//runs a row kernel that returns a partial sum on every band, then adds the bands up in order
+//so the total comes out the same from run to run
+static float ParallelSum(FluidWorkers* workers, int row_count, const std::function<float(int, int)>& kernel)
+{
+	float band_sums[FluidWorkers::MAX_THREADS];
+	int bands = workers->BandCount(row_count);
+
+	workers->ParallelRows(row_count, [&](int r_begin, int r_end, int band)
+	{
+		band_sums[band] = kernel(r_begin, r_end);
+	});
+
+	float sum = 0;
+	for (int band = 0; band < bands; ++band)
+	{
+		sum += band_sums[band];
+	}
+	return sum;
+}
+
+//sum of squares over every cell of a plane
+static float SumSquares(FluidWorkers* workers, const float* values, int width, int rows, int pitch)
+{
+	return ParallelSum(workers, rows, [&](int r_begin, int r_end) -> float
+	{
+		float sum_sq = 0;
+		for (int r = r_begin; r < r_end; ++r)
+		{
+			const float* row = values + r * pitch;
+			for (int x = 0; x < width; ++x)
+			{
+				sum_sq += row[x] * row[x];
+			}
+		}
+		return sum_sq;
+	});
+}
+
+//runs rows [r_begin, r_end) of a stencil stage, row r being y = r % height of slice z = r / height.
+//rows on the walls of the grid, and the first and last cell of the others, have neighbours off the grid
+//and go through edge_cell(x, y, z) one at a time. the rest of each row is handed to interior(r, x_begin, x_end)
+//as one run. returns the sum of what they all return, added up in the same order whichever kernels are in use
+static float StencilRows3D(int width, int height, int depth, int r_begin, int r_end,
+						   const std::function<float(int, int, int)>& edge_cell,
+						   const std::function<float(int, int, int)>& interior)
+{
+	float sum = 0;
+
+	for (int r = r_begin; r < r_end; ++r)
+	{
+		int y = r % height;
+		int z = r / height;
+
+		if (y == 0 || y == height - 1 || z == 0 || z == depth - 1 || width < 3)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				sum += edge_cell(x, y, z);
+			}
+			continue;
+		}
+
+		sum += edge_cell(0, y, z);
+		sum += interior(r, 1, width - 1);
+		sum += edge_cell(width - 1, y, z);
+	}
+
+	return sum;
+}
+
+//indices of the 6 cells around (x, y, z), clamped to the grid so a cell on a wall sees itself past it
+struct FluidNeighbours3D
+{
+	int left, right;
+	int down, up;
+	int back, front;
+};
+
+static inline FluidNeighbours3D ClampedNeighbours(int x, int y, int z, int width, int height, int depth, int pitch, int slice)
+{
+	int cell_index = x + y * pitch + z * slice;
+
+	FluidNeighbours3D n;
+	n.left = cell_index + (x > 0 ? -1 : 0);
+	n.right = cell_index + (x < width - 1 ? 1 : 0);
+	n.down = cell_index + (y > 0 ? -pitch : 0);
+	n.up = cell_index + (y < height - 1 ? pitch : 0);
+	n.back = cell_index + (z > 0 ? -slice : 0);
+	n.front = cell_index + (z < depth - 1 ? slice : 0);
+	return n;
+}
+
+void DIYFluid3D::SolveDiffusion(float dt)
+{
+	int rows = this->height * this->depth;
+
+	//the advected velocity is both the right hand side and the first guess
+	this->workers->ParallelRows(rows, [&](int r_begin, int r_end, int /*band*/)
+	{
+		size_t band_bytes = sizeof(float) * this->pitch * (r_end - r_begin);
+		memcpy(this->diffuse_source_x + r_begin * this->pitch, this->front_cells.velocity_x + r_begin * this->pitch, band_bytes);
+		memcpy(this->diffuse_source_y + r_begin * this->pitch, this->front_cells.velocity_y + r_begin * this->pitch, band_bytes);
+		memcpy(this->diffuse_source_z + r_begin * this->pitch, this->front_cells.velocity_z + r_begin * this->pitch, band_bytes);
+	});
+
+	float rhs_sum_sq = SumSquares(this->workers, this->diffuse_source_x, this->width, rows, this->pitch) +
+					   SumSquares(this->workers, this->diffuse_source_y, this->width, rows, this->pitch) +
+					   SumSquares(this->workers, this->diffuse_source_z, this->width, rows, this->pitch);
+	float threshold = this->diffuse_tolerance * this->diffuse_tolerance * rhs_sum_sq;
+
+	float residual_sum_sq = 0;
+	this->diffuse_iterations_used = 0;
+
+	while (this->diffuse_iterations_used < this->max_diffuse_iterations)
+	{
+		residual_sum_sq = Diffuse(dt);
+		SwapVelocities();
+		this->diffuse_iterations_used++;
+
+		if (residual_sum_sq <= threshold)
+		{
+			break;
+		}
+	}
+
+	this->diffuse_residual = rhs_sum_sq > 0 ? sqrtf(residual_sum_sq / rhs_sum_sq) : 0;
+}
+
+void DIYFluid3D::SolvePressure()
+{
+	int rows = this->height * this->depth;
+	float rhs_sum_sq = SumSquares(this->workers, this->divergence, this->width, rows, this->pitch);
+
+	this->pressure_iterations_used = 0;
+	this->pressure_residual = 0;
+
+	//no divergence at all means any constant pressure is the answer, don't iterate towards it
+	if (rhs_sum_sq == 0)
+	{
+		memset(this->front_cells.pressure, 0, sizeof(float) * this->pitch * rows);
+		return;
+	}
+
+	float threshold = this->pressure_tolerance * this->pressure_tolerance * rhs_sum_sq;
+	float residual_sum_sq = 0;
+
+	while (this->pressure_iterations_used < this->max_pressure_iterations)
+	{
+		residual_sum_sq = UpdatePressure();
+		SwapPressures();
+		this->pressure_iterations_used++;
+
+		if (residual_sum_sq <= threshold)
+		{
+			break;
+		}
+	}
+
+	this->pressure_residual = sqrtf(residual_sum_sq / rhs_sum_sq);
+}
+
+//the eight cells around a point, as the first one and the steps to the others along each axis,
+//and where the point sits between them
+struct FluidSample3D
+{
+	int base;
+	int step_x, step_y, step_z;
+	glm::vec3 fract;
+};
+
+//clamps the point, in cells, to the grid and finds the cells to sample it from
+static inline FluidSample3D FindSample3D(glm::vec3 point, int width, int height, int depth, int pitch, int slice)
+{
+	glm::vec3 sample_point = glm::clamp(point, glm::vec3(0), glm::vec3((float)width - 1, (float)height - 1, (float)depth - 1));
+	glm::vec3 corner = glm::floor(sample_point);
+
+	int x0 = (int)corner.x;
+	int y0 = (int)corner.y;
+	int z0 = (int)corner.z;
+
+	//samples on the last row, column or slice would read past the edge of the grid
+	FluidSample3D sample;
+	sample.base = x0 + y0 * pitch + z0 * slice;
+	sample.step_x = x0 + 1 < width ? 1 : 0;
+	sample.step_y = y0 + 1 < height ? pitch : 0;
+	sample.step_z = z0 + 1 < depth ? slice : 0;
+	sample.fract = sample_point - corner;
+	return sample;
+}
+
+//trilinear sample of a plane
+static inline float SampleVolume(const float* plane, const FluidSample3D& sample)
+{
+	const float* c = plane + sample.base;
+	int sx = sample.step_x;
+	int sy = sample.step_y;
+	int sz = sample.step_z;
+
+	float b0 = glm::mix(c[0], c[sx], sample.fract.x);
+	float t0 = glm::mix(c[sy], c[sy + sx], sample.fract.x);
+	float b1 = glm::mix(c[sz], c[sz + sx], sample.fract.x);
+	float t1 = glm::mix(c[sz + sy], c[sz + sy + sx], sample.fract.x);
+
+	return glm::mix(glm::mix(b0, t0, sample.fract.y), glm::mix(b1, t1, sample.fract.y), sample.fract.z);
+}
+
+void DIYFluid3D::Advect(float dt)
+{
+	float scale = dt / this->cell_dist;
+
+	//each band of rows reads anywhere in front_cells but only writes its own rows of back_cells.
+	//the samples land anywhere so this is a gather, and stays one cell at a time
+	this->workers->ParallelRows(this->height * this->depth, [&](int r_begin, int r_end, int /*band*/)
+	{
+		for (int r = r_begin; r < r_end; ++r)
+		{
+			int y = r % this->height;
+			int z = r / this->height;
+
+			for (int x = 0; x < this->width; ++x)
+			{
+				int cell_index = x + r * this->pitch;
+
+				glm::vec3 vel = glm::vec3(this->front_cells.velocity_x[cell_index],
+										  this->front_cells.velocity_y[cell_index],
+										  this->front_cells.velocity_z[cell_index]) * scale;
+				FluidSample3D sample = FindSample3D(glm::vec3((float)x, (float)y, (float)z) - vel,
+													this->width, this->height, this->depth, this->pitch, this->slice);
+
+				this->back_cells.smoke[cell_index] = SampleVolume(this->front_cells.smoke, sample);
+
+				this->back_cells.velocity_x[cell_index] = SampleVolume(this->front_cells.velocity_x, sample);
+				this->back_cells.velocity_y[cell_index] = SampleVolume(this->front_cells.velocity_y, sample);
+				this->back_cells.velocity_z[cell_index] = SampleVolume(this->front_cells.velocity_z, sample);
+			}
+		}
+	});
+}
+
+float DIYFluid3D::Diffuse(float dt)
+{
+	float inv_vdt = 1.0f / (this->viscosity * dt);
+	float diag = 6 + inv_vdt;
+	float denom = 1.0f / diag;
+	float residual_scale = diag / inv_vdt;
+
+	//the three components don't interact, so each is diffused as a plane of its own
+	const float* v_in[3] = { this->front_cells.velocity_x, this->front_cells.velocity_y, this->front_cells.velocity_z };
+	const float* sources[3] = { this->diffuse_source_x, this->diffuse_source_y, this->diffuse_source_z };
+	float* v_out[3] = { this->back_cells.velocity_x, this->back_cells.velocity_y, this->back_cells.velocity_z };
+
+	auto interior = [&](int r, int x_begin, int x_end) -> float
+	{
+		int begin = x_begin + r * this->pitch;
+		int end = x_end + r * this->pitch;
+
+		float sum_sq = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			sum_sq += this->kernels->diffuse_row_3d(v_in[axis], sources[axis], v_out[axis],
+													begin, end, this->pitch, this->slice, inv_vdt, denom, residual_scale);
+		}
+		return sum_sq;
+	};
+
+	auto edge_cell = [&](int x, int y, int z) -> float
+	{
+		int cell_index = x + y * this->pitch + z * this->slice;
+		FluidNeighbours3D n = ClampedNeighbours(x, y, z, this->width, this->height, this->depth, this->pitch, this->slice);
+
+		float sum_sq = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float* v = v_in[axis];
+			float diffused = ((((((v[n.up] + v[n.right]) + v[n.down]) + v[n.left]) + v[n.front]) + v[n.back]) +
+							  sources[axis][cell_index] * inv_vdt) * denom;
+
+			v_out[axis][cell_index] = diffused;
+
+			//residual of the old guess is the jacobi step scaled back up by the diagonal
+			float r = (diffused - v[cell_index]) * residual_scale;
+			sum_sq += r * r;
+		}
+		return sum_sq;
+	};
+
+	return ParallelSum(this->workers, this->height * this->depth, [&](int r_begin, int r_end) -> float
+	{
+		return StencilRows3D(this->width, this->height, this->depth, r_begin, r_end, edge_cell, interior);
+	});
+}
+
+void DIYFluid3D::Divergence()
+{
+	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+
+	const float* vx = this->front_cells.velocity_x;
+	const float* vy = this->front_cells.velocity_y;
+	const float* vz = this->front_cells.velocity_z;
+
+	auto interior = [&](int r, int x_begin, int x_end) -> float
+	{
+		int row = r * this->pitch;
+		return this->kernels->divergence_row_3d(vx, vy, vz, this->divergence, row + x_begin, row + x_end,
+												this->pitch, this->slice, inv_cell_dist);
+	};
+
+	auto edge_cell = [&](int x, int y, int z) -> float
+	{
+		int cell_index = x + y * this->pitch + z * this->slice;
+		FluidNeighbours3D n = ClampedNeighbours(x, y, z, this->width, this->height, this->depth, this->pitch, this->slice);
+
+		float divergence = (((vx[n.right] - vx[n.left]) + (vy[n.up] - vy[n.down])) + (vz[n.front] - vz[n.back])) * inv_cell_dist;
+
+		this->divergence[cell_index] = divergence;
+		return divergence;
+	};
+
+	int rows = this->height * this->depth;
+
+	float sum = ParallelSum(this->workers, rows, [&](int r_begin, int r_end) -> float
+	{
+		return StencilRows3D(this->width, this->height, this->depth, r_begin, r_end, edge_cell, interior);
+	});
+
+	//with closed walls the pressure is only defined up to a constant, so the
+	//divergence has to sum to zero for the pressure solve to have a solution
+	float mean = sum / ((float)this->width * rows);
+
+	this->workers->ParallelRows(rows, [&](int r_begin, int r_end, int /*band*/)
+	{
+		for (int r = r_begin; r < r_end; ++r)
+		{
+			float* row = this->divergence + r * this->pitch;
+			for (int x = 0; x < this->width; ++x)
+			{
+				row[x] -= mean;
+			}
+		}
+	});
+}
+
+float DIYFluid3D::UpdatePressure()
+{
+	float h2 = this->cell_dist * this->cell_dist;
+	float inv_h2 = 1.0f / h2;
+
+	const float* p = this->front_cells.pressure;
+
+	auto interior = [&](int r, int x_begin, int x_end) -> float
+	{
+		int row = r * this->pitch;
+		return this->kernels->pressure_row_3d(p, this->divergence, this->back_cells.pressure,
+											  row + x_begin, row + x_end, this->pitch, this->slice, h2, inv_h2);
+	};
+
+	auto edge_cell = [&](int x, int y, int z) -> float
+	{
+		int cell_index = x + y * this->pitch + z * this->slice;
+		FluidNeighbours3D n = ClampedNeighbours(x, y, z, this->width, this->height, this->depth, this->pitch, this->slice);
+
+		float new_pressure = ((((((p[n.up] + p[n.down]) + p[n.left]) + p[n.right]) + p[n.front]) + p[n.back]) -
+							  this->divergence[cell_index] * h2) * (1.0f / 6.0f);
+
+		this->back_cells.pressure[cell_index] = new_pressure;
+
+		//residual of the old pressure, divergence - laplacian(pressure)
+		float r = 6.0f * (p[cell_index] - new_pressure) * inv_h2;
+		return r * r;
+	};
+
+	return ParallelSum(this->workers, this->height * this->depth, [&](int r_begin, int r_end) -> float
+	{
+		return StencilRows3D(this->width, this->height, this->depth, r_begin, r_end, edge_cell, interior);
+	});
+}
+
+void DIYFluid3D::ApplyPressure()
+{
+	float inv_cell_dist = 1.0f / (2.0f * cell_dist);
+
+	const float* p = this->front_cells.pressure;
+
+	auto interior = [&](int r, int x_begin, int x_end) -> float
+	{
+		int row = r * this->pitch;
+		this->kernels->apply_pressure_row_3d(p, this->front_cells.velocity_x, this->front_cells.velocity_y, this->front_cells.velocity_z,
+											 this->back_cells.velocity_x, this->back_cells.velocity_y, this->back_cells.velocity_z,
+											 row + x_begin, row + x_end, this->pitch, this->slice, inv_cell_dist);
+		return 0;
+	};
+
+	auto edge_cell = [&](int x, int y, int z) -> float
+	{
+		int cell_index = x + y * this->pitch + z * this->slice;
+		FluidNeighbours3D n = ClampedNeighbours(x, y, z, this->width, this->height, this->depth, this->pitch, this->slice);
+
+		this->back_cells.velocity_x[cell_index] = this->front_cells.velocity_x[cell_index] + (p[n.left] - p[n.right]) * inv_cell_dist;
+		this->back_cells.velocity_y[cell_index] = this->front_cells.velocity_y[cell_index] + (p[n.down] - p[n.up]) * inv_cell_dist;
+		this->back_cells.velocity_z[cell_index] = this->front_cells.velocity_z[cell_index] + (p[n.back] - p[n.front]) * inv_cell_dist;
+		return 0;
+	};
+
+	this->workers->ParallelRows(this->height * this->depth, [&](int r_begin, int r_end, int /*band*/)
+	{
+		StencilRows3D(this->width, this->height, this->depth, r_begin, r_end, edge_cell, interior);
+	});
+}
+
+void DIYFluid3D::UpdateBoundary()
+{
+	float* p = this->front_cells.pressure;
+	float* velocities[3] = { this->front_cells.velocity_x, this->front_cells.velocity_y, this->front_cells.velocity_z };
+
+	//a wall cell takes the pressure of the cell inside it, and its velocity mirrored so the
+	//wall between them has no flow through it
+	auto mirror = [&](int wall, int inside, int normal_axis)
+	{
+		p[wall] = p[inside];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			velocities[axis][wall] = axis == normal_axis ? -velocities[axis][inside] : velocities[axis][inside];
+		}
+	};
+
+	//floor and ceiling, then front and back, then the sides, so the edges and corners end
+	//up with what the last pass gives them. each pass only reads cells the one before wrote
+	this->workers->ParallelRows(this->depth, [&](int z_begin, int z_end, int /*band*/)
+	{
+		for (int z = z_begin; z < z_end; ++z)
+		{
+			int first_row = z * this->slice;
+			int last_row = (this->height - 1) * this->pitch + z * this->slice;
+
+			for (int x = 0; x < this->width; ++x)
+			{
+				mirror(first_row + x, first_row + this->pitch + x, 1);
+				mirror(last_row + x, last_row - this->pitch + x, 1);
+			}
+		}
+	});
+
+	this->workers->ParallelRows(this->height, [&](int y_begin, int y_end, int /*band*/)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int first_row = y * this->pitch;
+			int last_row = y * this->pitch + (this->depth - 1) * this->slice;
+
+			for (int x = 0; x < this->width; ++x)
+			{
+				mirror(first_row + x, first_row + this->slice + x, 2);
+				mirror(last_row + x, last_row - this->slice + x, 2);
+			}
+		}
+	});
+
+	this->workers->ParallelRows(this->height * this->depth, [&](int r_begin, int r_end, int /*band*/)
+	{
+		for (int r = r_begin; r < r_end; ++r)
+		{
+			int row = r * this->pitch;
+
+			mirror(row, row + 1, 0);
+			mirror(row + this->width - 1, row + this->width - 2, 0);
+		}
+	});
+}
+
+void DIYFluid3D::AddForces(float dt)
+{
+	//the source, a column 10 cells across kept inside the grid as small grids would
+	//otherwise write into the padding or past the planes
+	int source_size = 10;
+	int half_source_size = source_size / 2;
+
+	int x_begin = glm::max(this->width / 2 - half_source_size, 0);
+	int x_end = glm::min(this->width / 2 + half_source_size, this->width);
+	int y_begin = 5;
+	int y_end = glm::min(5 + source_size, this->height);
+	int z_begin = glm::max(this->depth / 2 - half_source_size, 0);
+	int z_end = glm::min(this->depth / 2 + half_source_size, this->depth);
+
+	this->workers->ParallelRows(this->height * this->depth, [&](int r_begin, int r_end, int /*band*/)
+	{
+		for (int r = r_begin; r < r_end; ++r)
+		{
+			int y = r % this->height;
+			int z = r / this->height;
+
+			if (y < y_begin || y >= y_end || z < z_begin || z >= z_end)
+			{
+				continue;
+			}
+
+			int row = r * this->pitch;
+			for (int x = x_begin; x < x_end; ++x)
+			{
+				this->front_cells.velocity_y[row + x] += 10 * dt;
+				this->front_cells.smoke[row + x] = 1;
+			}
+		}
+	});
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "DIYFluid.h"
+
+//each field is its own plane of floats, as in FluidCells. cell (x, y, z) is at
+//x + y * pitch + z * slice, see DIYFluid3D::slice
+struct FluidCells3D
+{
+	float *pressure;
+	float *velocity_x;
+	float *velocity_y;
+	float *velocity_z;
+	float *smoke;		//density of the smoke, 0 for clear air
+};
+
+//volumetric version of DIYFluid for smoke, the same stages on a width * height * depth grid.
+//velocities are at the cell centres, advection is semi-lagrangian and the solves are jacobi, with
+//closed walls all round. a slice is height rows one after another, so every stage splits the
+//height * depth rows of the grid into bands across the workers and hands the inside of each row
+//to the 3d simd kernels
+class DIYFluid3D
+{
+public:
+	//_thread_count of 0 uses one thread per hardware thread
+	DIYFluid3D(int _width, int _height, int _depth, float _viscosity, float _cell_dist, int _thread_count = 0);
+	~DIYFluid3D();
+
+	void SetThreadCount(int thread_count);
+	void SetSimd(FluidSimd simd);	//defaults to the widest the cpu supports
+
+	void UpdateFluid(float dt);
+
+	//update parts, as DIYFluid's
+	void Advect(float dt);			//front_cells into back_cells
+	float Diffuse(float dt);		//one Jacobi sweep, returns the squared residual of the velocity it read
+	void Divergence();
+	float UpdatePressure();	//one Jacobi sweep, returns the squared residual of the pressure it read
+	void ApplyPressure();
+	void UpdateBoundary();
+	void AddForces(float dt);		//the smoke source, a column over the middle of the floor that pushes up and fills with smoke
+
+	//iterate the stages above until their residual is under tolerance
+	void SolveDiffusion(float dt);
+	void SolvePressure();
+
+	void SwapSmoke();
+	void SwapVelocities();
+	void SwapPressures();
+
+
+public:
+	float viscosity;
+	float cell_dist;
+
+	FluidCells3D front_cells;
+	FluidCells3D back_cells;
+
+	float* divergence;
+	float* diffuse_source_x;	//advected velocity, the right hand side of the diffusion solve
+	float* diffuse_source_y;
+	float* diffuse_source_z;
+
+	int width, height, depth;
+	int pitch;	//floats between rows of every plane, padded to a whole number of simd registers
+	int slice;	//floats between z slices, pitch * height. row r of the grid starts at r * pitch
+
+	//iterative stages stop once |residual| / |right hand side| drops below their tolerance,
+	//or when they hit the iteration cap. the last frame's counts and residuals are kept for profiling
+	float diffuse_tolerance;
+	int max_diffuse_iterations;
+	int diffuse_iterations_used;
+	float diffuse_residual;
+
+	float pressure_tolerance;
+	int max_pressure_iterations;
+	int pressure_iterations_used;
+	float pressure_residual;
+
+	FluidStageTimings timings;	//tiles_ms is always 0
+
+	FluidWorkers* workers;	//every stage is split into bands of rows across these
+	const FluidKernels* kernels;	//simd row kernels for the interior of the stencil stages
+};
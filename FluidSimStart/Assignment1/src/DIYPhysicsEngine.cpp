@@ -1,4 +1,7 @@
 #include "DIYPhysicsEngine.h"
+
+#include <algorithm>
+
 //rigid body functions
 using namespace std;
 
@@ -16,117 +19,276 @@ void DIYPhysicScene::checkForCollisions()
 {
     int actor_count = actors.size();
 
-    for (int first_actor = 0;
-        first_actor < actor_count - 1;
-        ++first_actor)
+    contacts.clear();
+
+    if (!broadphase)
     {
-        for (int second_actor = first_actor + 1;
-            second_actor < actor_count;
-            ++second_actor)
+        for (int first_actor = 0;
+            first_actor < actor_count - 1;
+            ++first_actor)
+        {
+            for (int second_actor = first_actor + 1;
+                second_actor < actor_count;
+                ++second_actor)
+            {
+                collectContact(actors[first_actor], actors[second_actor]);
+            }
+        }
+        return;
+    }
+
+    bounds.clear();
+    bounded_actors.clear();
+    unbounded_actors.clear();
+
+    for (int actor = 0; actor < actor_count; ++actor)
+    {
+        BroadphaseBox box;
+        if (actors[actor]->getBounds(box))
+        {
+            bounds.push_back(box);
+            bounded_actors.push_back(actor);
+        }
+        else
         {
-            PhysicsObject * object1 = actors[first_actor];
-            PhysicsObject * object2 = actors[second_actor];
-            
-            int shapeid1 = object1->_shapeID;
-            int shapeid2 = object2->_shapeID;
+            unbounded_actors.push_back(actor);
+        }
+    }
 
-            int index = (shapeid1 * NUMBERSHAPE) + shapeid2;
+    broadphase->findPairs(bounds, bounded_pairs);
 
-            fn collision_function = FunctionPointerTable[index];
+    candidate_pairs.clear();
+    for (const BroadphasePair& pair : bounded_pairs)
+    {
+        BroadphasePair candidate = { bounded_actors[pair.first], bounded_actors[pair.second] };
+        candidate_pairs.push_back(candidate);
+    }
 
-            if (collision_function != nullptr)
-            {
-                CollisionManifold manifold = collision_function(this, object1, object2);
+    //planes are the only unbounded shape. each is tested against every box with a corner behind it
+    for (int plane_actor : unbounded_actors)
+    {
+        if (actors[plane_actor]->_shapeID != PLANE)
+        {
+            continue;
+        }
+        PlaneClass* plane = (PlaneClass*)actors[plane_actor];
 
-                if (manifold.colliding)
-                {
-                    //ADDED THIS
-                    if ( manifold.first->is_static && manifold.second && manifold.second->is_static )
-                    {
-                        continue;
-                    }
-
-                    Gizmos::add2DCircle(manifold.P, 0.5f, 16, glm::vec4(1, 1, 0, 1));
-                    Gizmos::add2DLine(manifold.P, manifold.P + manifold.N * 5.0f, glm::vec4(1, 1, 0, 1));
-
-                    //CHAGED THESE TWO LINES. LOOK AT THEM CLOSELY
-                    float inv_mass1 = (!manifold.first->is_static) ? 1.0f / manifold.first->mass : 0;
-                    float inv_mass2 = (manifold.second && !manifold.second->is_static) 
-                                        ? 1.0f / manifold.second->mass : 0;
-
-                    
-                    float inv_moi1 = (!manifold.first->is_static) ? 1.0f / manifold.first->moment_of_inertia : 0;
-                    float inv_moi2 = (manifold.second && !manifold.second->is_static)
-                                        ? 1.0f / manifold.second->moment_of_inertia : 0;
-
-                    glm::vec2 com1 = manifold.first->position;
-                    glm::vec2 com2 = manifold.second ? manifold.second->position : manifold.P;
-
-                    glm::vec2 R_1p = manifold.P - manifold.first->position;
-                    R_1p = glm::vec2(-R_1p.y, R_1p.x);
-
-                    glm::vec2 R_2p = manifold.P - (manifold.second ? manifold.second->position : manifold.P);
-                    R_2p = glm::vec2(-R_2p.y, R_2p.x);
-
-                    glm::vec2 velocity1 = manifold.first->velocity + manifold.first->angular_velocity * R_1p;
-                    
-                    glm::vec2 velocity2;
-                    if (manifold.second)
-                    {
-                        velocity2 = manifold.second->velocity + manifold.second->angular_velocity * R_2p;
-                    }
-
-                    float R_1p_dot_n = glm::dot(R_1p, manifold.N);
-                    float R_2p_dot_n = glm::dot(R_2p, manifold.N);
-
-                    float denom = glm::dot(manifold.N, manifold.N * (inv_mass1 + inv_mass2)) +
-                        R_1p_dot_n * R_1p_dot_n * inv_moi1 + R_2p_dot_n * R_2p_dot_n * inv_moi2;
-
-                    float j = (-(1 + manifold.e) * glm::dot(velocity1 - velocity2, manifold.N)) / denom;
-
-
-
-                    if (!manifold.first->is_static) //added this if
-                    {
-                        manifold.first->velocity += (j * inv_mass1) * manifold.N;
-                        manifold.first->angular_velocity += glm::dot(R_1p, j * manifold.N) * inv_moi1;
-                    }
-                                            //Added this second check
-                    if (manifold.second && !manifold.second->is_static)
-                    {
-                        manifold.second->velocity += (-j * inv_mass2) * manifold.N;
-                        manifold.second->angular_velocity += glm::dot(R_2p, -j * manifold.N) * inv_moi2;
-                    }
-                    
-                    glm::vec2 tangent(manifold.N.y, -manifold.N.x);
-
-                    float R_1p_dot_t = glm::dot(R_1p, tangent);
-                    float R_2p_dot_t = glm::dot(R_2p, tangent);
-
-                    float friction_denom =
-                        inv_mass1 + inv_mass2 + (R_1p_dot_t*R_1p_dot_t) * inv_moi1 + (R_2p_dot_t*R_2p_dot_t) * inv_moi2;
-                    
-                    float friction_j = (-(1.1f) * glm::dot(velocity1 - velocity2, tangent)) / friction_denom;
-
-
-                    /*if (!manifold.first->is_static) //added this if
-                    {
-                        manifold.first->velocity += (friction_j * inv_mass1) * tangent;
-                        manifold.first->angular_velocity += glm::dot(R_1p, friction_j * tangent) * inv_moi1;
-                    }
-                                            //Added this second check
-                    if (manifold.second && !manifold.second->is_static)
-                    {
-                        manifold.second->velocity += (-friction_j * inv_mass2) * tangent;
-                        manifold.second->angular_velocity += glm::dot(R_2p, -friction_j * tangent) * inv_moi2;
-                    }*/
+        for (int b = 0; b < (int)bounds.size(); ++b)
+        {
+            glm::vec2 centre = (bounds[b].min + bounds[b].max) * 0.5f;
+            glm::vec2 extents = (bounds[b].max - bounds[b].min) * 0.5f;
+            float reach = glm::abs(plane->normal.x) * extents.x + glm::abs(plane->normal.y) * extents.y;
 
-                }
+            if (glm::dot(centre, plane->normal) - plane->distance <= reach)
+            {
+                int actor = bounded_actors[b];
+                BroadphasePair candidate = { glm::min(actor, plane_actor), glm::max(actor, plane_actor) };
+                candidate_pairs.push_back(candidate);
             }
         }
     }
-}   
- 
+
+    //in the order the all pairs loop takes them, the narrow phase pushes bodies apart as it goes
+    std::sort(candidate_pairs.begin(), candidate_pairs.end(), [](const BroadphasePair& a, const BroadphasePair& b)
+    {
+        return a.first < b.first || (a.first == b.first && a.second < b.second);
+    });
+
+    for (const BroadphasePair& pair : candidate_pairs)
+    {
+        collectContact(actors[pair.first], actors[pair.second]);
+    }
+}
+
+void DIYPhysicScene::collectContact(PhysicsObject* object1, PhysicsObject* object2)
+{
+    int shapeid1 = object1->_shapeID;
+    int shapeid2 = object2->_shapeID;
+
+    int index = (shapeid1 * NUMBERSHAPE) + shapeid2;
+
+    fn collision_function = FunctionPointerTable[index];
+
+    if (collision_function == nullptr)
+    {
+        return;
+    }
+
+    CollisionManifold manifold = collision_function(this, object1, object2);
+
+    if (!manifold.colliding)
+    {
+        return;
+    }
+
+    int first = manifold.first->body;
+    int second = manifold.second ? manifold.second->body : -1;
+
+    //ADDED THIS
+    //nothing can move, a plane counts as static. the solver would divide by a mass of 0
+    if ( bodies.isStatic(first) && (second < 0 || bodies.isStatic(second)) )
+    {
+        return;
+    }
+
+    Gizmos::add2DCircle(manifold.P, 0.5f, 16, glm::vec4(1, 1, 0, 1));
+    Gizmos::add2DLine(manifold.P, manifold.P + manifold.N * 5.0f, glm::vec4(1, 1, 0, 1));
+
+    ContactConstraint contact;
+    contact.first = first;
+    contact.second = second;
+    contact.point = manifold.P;
+    contact.normal = manifold.N;
+
+    //planes get ids below 0 so they can't be taken for a body's slot
+    int first_slot = bodies.slot[first];
+    int second_id = second >= 0 ? bodies.slot[second] : -1 - ((PlaneClass*)(manifold.first == object1 ? object2 : object1))->id;
+    contact.key = ContactCache::pairKey(first_slot, second_id);
+    contact.generation1 = slot_generations[first_slot];
+    contact.generation2 = second >= 0 ? slot_generations[second_id] : 0;
+    contact.feature = manifold.feature;
+
+    float inv_mass1 = contact.inv_mass1 = bodies.inverse_mass[first];
+    float inv_mass2 = contact.inv_mass2 = second >= 0 ? bodies.inverse_mass[second] : 0;
+
+    float inv_moi1 = contact.inv_moi1 = bodies.inverse_moment[first];
+    float inv_moi2 = contact.inv_moi2 = second >= 0 ? bodies.inverse_moment[second] : 0;
+
+    glm::vec2 position1 = bodies.getPosition(first);
+    glm::vec2 position2 = second >= 0 ? bodies.getPosition(second) : manifold.P;
+
+    contact.R_1p = manifold.P - position1;
+    contact.R_1p = glm::vec2(-contact.R_1p.y, contact.R_1p.x);
+
+    contact.R_2p = manifold.P - position2;
+    contact.R_2p = glm::vec2(-contact.R_2p.y, contact.R_2p.x);
+
+    float R_1p_dot_n = glm::dot(contact.R_1p, manifold.N);
+    float R_2p_dot_n = glm::dot(contact.R_2p, manifold.N);
+    contact.normal_mass = 1.0f / (inv_mass1 + inv_mass2 +
+        R_1p_dot_n * R_1p_dot_n * inv_moi1 + R_2p_dot_n * R_2p_dot_n * inv_moi2);
+
+    glm::vec2 tangent(manifold.N.y, -manifold.N.x);
+    float R_1p_dot_t = glm::dot(contact.R_1p, tangent);
+    float R_2p_dot_t = glm::dot(contact.R_2p, tangent);
+    contact.tangent_mass = 1.0f / (inv_mass1 + inv_mass2 +
+        R_1p_dot_t * R_1p_dot_t * inv_moi1 + R_2p_dot_t * R_2p_dot_t * inv_moi2);
+
+    //restitution is a target for the closing speed going in, not for whatever speed the
+    //iterations before have left, so it is taken now
+    glm::vec2 velocity1 = bodies.getVelocity(first) + bodies.angular_velocity[first] * contact.R_1p;
+    glm::vec2 velocity2;
+    if (second >= 0)
+    {
+        velocity2 = bodies.getVelocity(second) + bodies.angular_velocity[second] * contact.R_2p;
+    }
+    float closing_speed = glm::dot(velocity2 - velocity1, manifold.N);
+    contact.velocity_bias = closing_speed < -restitution_threshold ? -manifold.e * closing_speed : 0;
+
+    contact.normal_impulse = 0;
+    contact.tangent_impulse = 0;
+
+    contacts.push_back(contact);
+}
+
+//an impulse at the contact, taken off first and given to second. static bodies are left alone
+static void ApplyContactImpulse(DIYBodyArrays& bodies, const ContactConstraint& contact, glm::vec2 impulse)
+{
+    if (contact.inv_mass1 > 0)
+    {
+        bodies.setVelocity(contact.first, bodies.getVelocity(contact.first) - impulse * contact.inv_mass1);
+        bodies.angular_velocity[contact.first] -= glm::dot(contact.R_1p, impulse) * contact.inv_moi1;
+    }
+
+    if (contact.second >= 0 && contact.inv_mass2 > 0)
+    {
+        bodies.setVelocity(contact.second, bodies.getVelocity(contact.second) + impulse * contact.inv_mass2);
+        bodies.angular_velocity[contact.second] += glm::dot(contact.R_2p, impulse) * contact.inv_moi2;
+    }
+}
+
+//velocity of second relative to first at the contact
+static glm::vec2 ContactVelocity(const DIYBodyArrays& bodies, const ContactConstraint& contact)
+{
+    glm::vec2 velocity1 = bodies.getVelocity(contact.first) + bodies.angular_velocity[contact.first] * contact.R_1p;
+    glm::vec2 velocity2;
+    if (contact.second >= 0)
+    {
+        velocity2 = bodies.getVelocity(contact.second) + bodies.angular_velocity[contact.second] * contact.R_2p;
+    }
+    return velocity2 - velocity1;
+}
+
+//cos of the most a contact's normal can turn between updates and still be warm started
+static const float WARM_START_MIN_COS = 0.95f;
+
+//sequential impulses, as in box2d. each iteration goes over every contact and changes its summed
+//impulses by what would fix its velocity on its own, clamped so the sums stay ones a contact could
+//really push with, which over the iterations settles on impulses that suit all the contacts at once
+void DIYPhysicScene::solveContacts()
+{
+    contact_cache.beginUpdate();
+
+    for (ContactConstraint& contact : contacts)
+    {
+        if (!warm_starting)
+        {
+            continue;
+        }
+
+        //the same bodies touching at the same feature, facing much the same way. anything else
+        //starts from nothing, an impulse that suited some other contact would only have to be undone
+        const CachedContact* cached = contact_cache.findPrevious(contact.key);
+        if (cached &&
+            cached->generation1 == contact.generation1 &&
+            cached->generation2 == contact.generation2 &&
+            cached->feature == contact.feature &&
+            glm::dot(cached->normal, contact.normal) > WARM_START_MIN_COS)
+        {
+            contact.normal_impulse = cached->normal_impulse;
+            contact.tangent_impulse = cached->tangent_impulse;
+
+            glm::vec2 tangent(contact.normal.y, -contact.normal.x);
+            ApplyContactImpulse(bodies, contact, contact.normal_impulse * contact.normal + contact.tangent_impulse * tangent);
+        }
+    }
+
+    for (int iteration = 0; iteration < solver_iterations; ++iteration)
+    {
+        for (ContactConstraint& contact : contacts)
+        {
+            glm::vec2 tangent(contact.normal.y, -contact.normal.x);
+
+            //friction first, so the normal impulse has the last word on whether they part
+            float max_friction = contact_friction * contact.normal_impulse;
+            float tangent_impulse = -glm::dot(ContactVelocity(bodies, contact), tangent) * contact.tangent_mass;
+            float new_tangent_impulse = glm::clamp(contact.tangent_impulse + tangent_impulse, -max_friction, max_friction);
+            tangent_impulse = new_tangent_impulse - contact.tangent_impulse;
+            contact.tangent_impulse = new_tangent_impulse;
+            ApplyContactImpulse(bodies, contact, tangent_impulse * tangent);
+
+            float normal_speed = glm::dot(ContactVelocity(bodies, contact), contact.normal);
+            float normal_impulse = -(normal_speed - contact.velocity_bias) * contact.normal_mass;
+            float new_normal_impulse = glm::max(contact.normal_impulse + normal_impulse, 0.0f);
+            normal_impulse = new_normal_impulse - contact.normal_impulse;
+            contact.normal_impulse = new_normal_impulse;
+            ApplyContactImpulse(bodies, contact, normal_impulse * contact.normal);
+        }
+    }
+
+    for (const ContactConstraint& contact : contacts)
+    {
+        CachedContact& cached = contact_cache.store(contact.key);
+        cached.generation1 = contact.generation1;
+        cached.generation2 = contact.generation2;
+        cached.feature = contact.feature;
+        cached.point = contact.point;
+        cached.normal = contact.normal;
+        cached.normal_impulse = contact.normal_impulse;
+        cached.tangent_impulse = contact.tangent_impulse;
+    }
+}
+
 
 //plane class functions
 PlaneClass::PlaneClass(glm::vec2 normal,float distance)
@@ -149,61 +311,34 @@ void PlaneClass::makeGizmo()
 
 //sphere class functions
 
-SphereClass::SphereClass(	glm::vec2 position,glm::vec2 velocity,float radius,float mass,glm::vec4& colour)
-	: DIYRigidBody(position,velocity,0,mass)  //call the base class constructor
-{
-	this->_radius = radius;
-	this->colour = colour;
-    this->moment_of_inertia = (this->mass * this->_radius * this->_radius) / 2.0f;
-	std::cout<<"adding sphere "<<this->position.x<<','<<this->position.y<<std::endl;
-	_shapeID = SPHERE;
-}
-
-SphereClass::SphereClass(	glm::vec2 position,float angle,float speed,float radius,float mass,glm::vec4& colour)
-		: DIYRigidBody(position,glm::vec2(speed * cos(angle),speed * sin(angle)),0,mass)  //call the base class constructor
+SphereClass::SphereClass(float radius, glm::vec4 colour)
+	: DIYRigidBody(colour)  //call the base class constructor
 {
 	this->_radius = radius;
-	this->colour = colour;
-    this->moment_of_inertia = (this->mass * this->_radius * this->_radius) / 2.0f;
-	std::cout<<"adding sphere "<<this->position.x<<','<<this->position.y<<std::endl;
 	_shapeID = SPHERE;
 }
 
 void SphereClass::makeGizmo()
 {
-	glm::vec2 center = position.xy();
+	glm::vec2 center = scene->bodies.getPosition(body);
 	Gizmos::add2DCircle(center, _radius,30, colour);
 }
 
-//box class functions
-
-BoxClass::BoxClass(	glm::vec2 position,glm::vec2 velocity,float rotation,float mass,float width, float height,glm::vec4& colour)
-	: DIYRigidBody(position,velocity,rotation,mass)  //call the base class constructor
+bool SphereClass::getBounds(BroadphaseBox& bounds)
 {
-	this->width = width;
-	this->height = height;
-	this->colour = colour;
-    this->is_colliding = false;
-
-    float h = 2 * height;
-    float w = 2 * width;
-    this->moment_of_inertia = mass * (h * h + w * w) / 12;
-
-	_shapeID = BOX;
+    glm::vec2 position = scene->bodies.getPosition(body);
+    bounds.min = position - glm::vec2(_radius);
+    bounds.max = position + glm::vec2(_radius);
+    return true;
 }
 
-BoxClass::BoxClass(	glm::vec2 position, float angle, float speed, float rotation, float width, float height, float mass, glm::vec4& colour)
-	: DIYRigidBody(position,glm::vec2(speed * cos(angle),speed * sin(angle)),rotation,mass)  //call the base class constructor
+//box class functions
+
+BoxClass::BoxClass(float width, float height, glm::vec4 colour)
+	: DIYRigidBody(colour)  //call the base class constructor
 {
 	this->width = width;
 	this->height = height;
-    this->colour = colour;
-
-    float h = 2 * height;
-    float w = 2 * width;
-    this->moment_of_inertia = mass * (h * h + w * w) / 12;
-
-    this->is_colliding = false;
 
 	_shapeID = BOX;
 }
@@ -212,24 +347,32 @@ void BoxClass::makeGizmo()
 {
     //Added all this
     glm::vec4 my_colour(1, 0, 0, 1);
-    if (this->is_colliding)
+    if (scene->bodies.colliding[body])
     {
         my_colour = glm::vec4(0, 1, 0, 1);
     }
                                                                 
-    Gizmos::add2DAABBFilled(position, glm::vec2(width, height), my_colour, &rotationMatrix);
+    glm::mat4 rotation_matrix = getRotationMatrix();
+    Gizmos::add2DAABBFilled(scene->bodies.getPosition(body), glm::vec2(width, height), my_colour, &rotation_matrix);
                                                                //  ^ added the my_
 }
 
-bool BoxClass::isPointOver(glm::vec2 point)
+//from the same cos and sin BuildBoxPoints uses, so the bounds hold the corners the narrow phase tests
+bool BoxClass::getBounds(BroadphaseBox& bounds)
 {
-    glm::vec2 rel_point = point - position;
-
-    float ct = cosf(-rotation2D);
-    float st = sinf(-rotation2D);
+    glm::vec2 position = scene->bodies.getPosition(body);
+    float abs_cos = glm::abs(scene->bodies.rotation_cos[body]);
+    float abs_sin = glm::abs(scene->bodies.rotation_sin[body]);
+    glm::vec2 extents(abs_cos * width + abs_sin * height,
+                      abs_sin * width + abs_cos * height);
+    bounds.min = position - extents;
+    bounds.max = position + extents;
+    return true;
+}
 
-    rel_point = glm::vec2(ct * rel_point.x - st * rel_point.y,
-                          st * rel_point.x + ct * rel_point.y);
+bool BoxClass::isPointOver(glm::vec2 point)
+{
+    glm::vec2 rel_point = scene->bodies.toLocal(body, point - scene->bodies.getPosition(body));
 
 
     bool result = rel_point.x > -width && rel_point.x < width
@@ -239,100 +382,133 @@ bool BoxClass::isPointOver(glm::vec2 point)
     return result;
 }
 
-DIYRigidBody::DIYRigidBody(	glm::vec2 position,glm::vec2 velocity,float rotation,float mass) 
+DIYRigidBody::DIYRigidBody(glm::vec4 colour)
 {
-	std::cout<<"adding rigid body "<<position.x<<','<<position.y<<std::endl;
-	this->position = position;
-	this->velocity = velocity;
-	this->rotation2D = rotation;
-    
-    //ADDED THIS
-    this->is_static = false;
+	this->colour = colour;
+	this->scene = nullptr;
+	this->body = -1;
+}
 
-    //added these 3 lines
-    this->angular_velocity = 0;
-    this->total_torque = 0;
-    this->total_force = glm::vec2();
+void DIYRigidBody::debug()
+{
+	glm::vec2 position = scene->bodies.getPosition(body);
+	cout<<"position "<<position.x<<','<<position.y<<endl;
+}
 
-	this->mass = mass;
-    this->dynamic_friction = 0.2f;
-	colour = glm::vec4(1,1,1,1); //white by default
+//what glm::rotate about z gives for the body's rotation
+glm::mat4 DIYRigidBody::getRotationMatrix() const
+{
+    float c = scene->bodies.rotation_cos[body];
+    float s = scene->bodies.rotation_sin[body];
+
+    glm::mat4 matrix(1);
+    matrix[0][0] = c;
+    matrix[0][1] = s;
+    matrix[1][0] = -s;
+    matrix[1][1] = c;
+    return matrix;
 }
 
-void DIYRigidBody::applyForceAtPoint(glm::vec2 force, glm::vec2 point)
+//body array functions
+
+void DIYBodyArrays::applyForceAtPoint(int body, glm::vec2 force, glm::vec2 point)
 {
-    total_force += force;
-    glm::vec2 cm_to_point = point - this->position;
+    force_x[body] += force.x;
+    force_y[body] += force.y;
+    glm::vec2 cm_to_point = point - getPosition(body);
 
     glm::vec2 perp_to_point(-cm_to_point.y, cm_to_point.x);
-    total_torque += glm::dot(perp_to_point, force);
+    torque[body] += glm::dot(perp_to_point, force);
 }
 
+void DIYBodyArrays::applyForce(int body, glm::vec2 force)
+{
+    applyForceAtPoint(body, force, getPosition(body));
+}
 
-void DIYRigidBody::applyForce(glm::vec2 force)
+void DIYBodyArrays::push(DIYRigidBody* object)
 {
-    applyForceAtPoint(force, this->position);
+    position_x.push_back(0);
+    position_y.push_back(0);
+    velocity_x.push_back(0);
+    velocity_y.push_back(0);
+    rotation.push_back(0);
+    rotation_cos.push_back(1);
+    rotation_sin.push_back(0);
+    angular_velocity.push_back(0);
+    force_x.push_back(0);
+    force_y.push_back(0);
+    torque.push_back(0);
+    mass.push_back(0);
+    moment_of_inertia.push_back(0);
+    dynamic_friction.push_back(0);
+    dynamic.push_back(0);
+    inverse_mass.push_back(0);
+    inverse_moment.push_back(0);
+    colliding.push_back(0);
+    slot.push_back(-1);
+    objects.push_back(object);
 }
-void DIYRigidBody::applyForceToActor(DIYRigidBody* actor2, glm::vec2 force)
+
+void DIYBodyArrays::updateInverses(int body)
 {
-	actor2->applyForce(force);
-	applyForce(-force);
+    bool moves = !isStatic(body);
+    inverse_mass[body] = moves ? 1.0f / mass[body] : 0;
+    inverse_moment[body] = moves ? 1.0f / moment_of_inertia[body] : 0;
 }
 
-void DIYRigidBody::collisionResponse(glm::vec2 collisionPoint)
+template <class T>
+static void SwapRemove(std::vector<T>& values, int index)
 {
-	// for now we'll just set the velocity to zero
-	collisionPoint = collisionPoint;
+    values[index] = values.back();
+    values.pop_back();
 }
 
-void DIYRigidBody::update(glm::vec2 gravity,float timeStep)
+void DIYBodyArrays::swapRemove(int body)
 {
-    if (this->is_static)
+    SwapRemove(position_x, body);
+    SwapRemove(position_y, body);
+    SwapRemove(velocity_x, body);
+    SwapRemove(velocity_y, body);
+    SwapRemove(rotation, body);
+    SwapRemove(rotation_cos, body);
+    SwapRemove(rotation_sin, body);
+    SwapRemove(angular_velocity, body);
+    SwapRemove(force_x, body);
+    SwapRemove(force_y, body);
+    SwapRemove(torque, body);
+    SwapRemove(mass, body);
+    SwapRemove(moment_of_inertia, body);
+    SwapRemove(dynamic_friction, body);
+    SwapRemove(dynamic, body);
+    SwapRemove(inverse_mass, body);
+    SwapRemove(inverse_moment, body);
+    SwapRemove(colliding, body);
+    SwapRemove(slot, body);
+    SwapRemove(objects, body);
+
+    if (body < size())
     {
-        return;
+        objects[body]->body = body;
     }
-
-    //removed  * timeStep
-	applyForce(gravity * mass);
-
-    glm::vec2 friction_force = 
-        -this->mass * this->dynamic_friction * this->velocity;
-    applyForce(friction_force);
-       
-    float friction_torque = 
-        (-moment_of_inertia * this->dynamic_friction * angular_velocity);
-    total_torque += friction_torque;
-
-    glm::vec2 acceleration = (total_force / mass);
-    glm::vec2 delta_v = acceleration * timeStep;
-
-    float angular_accel = total_torque / moment_of_inertia;
-    float delta_w = angular_accel * timeStep;
-
-	oldPosition = position; //keep our old position for collision response
-	
-
-    velocity += delta_v;
-    position += velocity * timeStep;
-
-    rotation2D += angular_velocity * timeStep;
-    angular_velocity += delta_w;
-
-	rotationMatrix = glm::rotate(rotation2D,glm::vec3(0.0f,0.0f,1.0f)); 
-
-    total_force = glm::vec2();
-    total_torque = 0;
 }
 
-void DIYRigidBody::debug()
+//scene functions
+
+DIYPhysicScene::~DIYPhysicScene()
 {
-	cout<<"position "<<position.x<<','<<position.y<<endl;
+    for (DIYRigidBody* object : bodies.objects)
+    {
+        delete object;
+    }
 }
 
-//scene functions
-
 void DIYPhysicScene::addActor(PhysicsObject* object)
 {
+	if (object->_shapeID == PLANE)
+	{
+		((PlaneClass*)object)->id = plane_count++;
+	}
 	actors.push_back(object);
 }
 	
@@ -345,6 +521,99 @@ void DIYPhysicScene::removeActor(PhysicsObject* object)
 	}
 }
 
+DIYBodyHandle DIYPhysicScene::addBody(DIYRigidBody* object, glm::vec2 position, glm::vec2 velocity, float rotation, float mass, float moment_of_inertia)
+{
+    DIYBodyHandle handle;
+    if (free_slots.empty())
+    {
+        handle.slot = (int)slot_bodies.size();
+        slot_bodies.push_back(-1);
+        slot_generations.push_back(0);
+    }
+    else
+    {
+        handle.slot = free_slots.back();
+        free_slots.pop_back();
+    }
+    handle.generation = slot_generations[handle.slot];
+
+    int body = bodies.size();
+    bodies.push(object);
+    bodies.setPosition(body, position);
+    bodies.setVelocity(body, velocity);
+    bodies.setRotation(body, rotation);
+    bodies.mass[body] = mass;
+    bodies.moment_of_inertia[body] = moment_of_inertia;
+    bodies.dynamic_friction[body] = 0.2f;
+    bodies.dynamic[body] = 1;
+    bodies.updateInverses(body);
+    bodies.slot[body] = handle.slot;
+    slot_bodies[handle.slot] = body;
+
+    object->scene = this;
+    object->body = body;
+    object->handle = handle;
+
+    actors.push_back(object);
+    return handle;
+}
+
+DIYBodyHandle DIYPhysicScene::addSphere(glm::vec2 position, glm::vec2 velocity, float radius, float mass, glm::vec4 colour)
+{
+	std::cout<<"adding sphere "<<position.x<<','<<position.y<<std::endl;
+    SphereClass* sphere = new SphereClass(radius, colour);
+    return addBody(sphere, position, velocity, 0, mass, (mass * radius * radius) / 2.0f);
+}
+
+DIYBodyHandle DIYPhysicScene::addBox(glm::vec2 position, glm::vec2 velocity, float rotation, float mass, float width, float height, glm::vec4 colour)
+{
+    BoxClass* box = new BoxClass(width, height, colour);
+
+    float h = 2 * height;
+    float w = 2 * width;
+    return addBody(box, position, velocity, rotation, mass, mass * (h * h + w * w) / 12);
+}
+
+void DIYPhysicScene::removeBody(DIYBodyHandle handle)
+{
+    int body = bodyIndex(handle);
+    if (body < 0)
+    {
+        return;
+    }
+
+    DIYRigidBody* object = bodies.objects[body];
+    removeActor(object);
+
+    //the last body moves into its place
+    bodies.swapRemove(body);
+    if (body < bodies.size())
+    {
+        slot_bodies[bodies.slot[body]] = body;
+    }
+
+    slot_bodies[handle.slot] = -1;
+    slot_generations[handle.slot] += 1;
+    free_slots.push_back(handle.slot);
+
+    delete object;
+}
+
+int DIYPhysicScene::bodyIndex(DIYBodyHandle handle) const
+{
+    if (handle.slot < 0 || handle.slot >= (int)slot_bodies.size() || slot_generations[handle.slot] != handle.generation)
+    {
+        return -1;
+    }
+    return slot_bodies[handle.slot];
+}
+
+DIYRigidBody* DIYPhysicScene::getBody(DIYBodyHandle handle)
+{
+    int body = bodyIndex(handle);
+    return body < 0 ? nullptr : bodies.objects[body];
+}
+
 //added these two functions
 void DIYPhysicScene::addJoint(Joint* object)
 {
@@ -360,21 +629,50 @@ void DIYPhysicScene::removeJoint(Joint* object)
     }
 }
 
+//one pass down the arrays with no calls or branches in it. static bodies go through the same
+//arithmetic with their changes scaled to nothing
+void DIYPhysicScene::integrateBodies()
+{
+    BodyStreams streams;
+    streams.position_x = bodies.position_x.data();
+    streams.position_y = bodies.position_y.data();
+    streams.velocity_x = bodies.velocity_x.data();
+    streams.velocity_y = bodies.velocity_y.data();
+    streams.rotation = bodies.rotation.data();
+    streams.rotation_cos = bodies.rotation_cos.data();
+    streams.rotation_sin = bodies.rotation_sin.data();
+    streams.angular_velocity = bodies.angular_velocity.data();
+    streams.force_x = bodies.force_x.data();
+    streams.force_y = bodies.force_y.data();
+    streams.torque = bodies.torque.data();
+    streams.mass = bodies.mass.data();
+    streams.moment_of_inertia = bodies.moment_of_inertia.data();
+    streams.dynamic_friction = bodies.dynamic_friction.data();
+    streams.dynamic = bodies.dynamic.data();
+    streams.inverse_mass = bodies.inverse_mass.data();
+    streams.inverse_moment = bodies.inverse_moment.data();
+
+    kernels->integrate(streams, 0, bodies.size(), timeStep, gravity.x, gravity.y);
+
+    std::fill(bodies.colliding.begin(), bodies.colliding.end(), 0);
+}
+
+void DIYPhysicScene::setSimd(SimdLevel simd)
+{
+    kernels = GetBodyKernels(simd);
+}
 
 void DIYPhysicScene::upDate()
 {
 	bool runPhysics = true;
 	int maxIterations = 10; //emergency count to stop us repeating for ever in extreme situations
 
-	for(auto actorPtr:actors)
-	{
-		actorPtr->update(gravity,timeStep);
-    }
+    integrateBodies();
 
     //ADDED THIS FOR LOOP
     for (auto jointPtr : joints)
     {
-        jointPtr->Update(timeStep);
+        jointPtr->Update(this, timeStep);
 
     }
 
@@ -382,6 +680,7 @@ void DIYPhysicScene::upDate()
     if (collisionEnabled)
     {
         checkForCollisions();
+        solveContacts();
     }
 
 	maxIterations--;
@@ -408,7 +707,7 @@ void DIYPhysicScene::upDateGizmos()
     //ADDED THIS FOR LOOP
     for (auto jointPtr : joints)
     {
-        jointPtr->DrawGizmo();
+        jointPtr->DrawGizmo(this);
     }
 }
 
@@ -416,9 +715,12 @@ CollisionManifold DIYPhysicScene::Sphere2Sphere(DIYPhysicScene* scene, PhysicsOb
 {
     SphereClass * first_sphere = (SphereClass*)first;
     SphereClass * second_sphere = (SphereClass*)second;
+    DIYBodyArrays& bodies = scene->bodies;
+    int first_body = first_sphere->body;
+    int second_body = second_sphere->body;
 
     //get the vector from the first to the second sphere
-    glm::vec2 delta = second_sphere->position - first_sphere->position;
+    glm::vec2 delta = bodies.getPosition(second_body) - bodies.getPosition(first_body);
     //the length of the delta is the distance
     float distance = glm::length(delta);
     float raddii_sum = first_sphere->_radius + second_sphere->_radius;
@@ -437,20 +739,20 @@ CollisionManifold DIYPhysicScene::Sphere2Sphere(DIYPhysicScene* scene, PhysicsOb
         float intersection = (raddii_sum - distance) * 0.5f;
 
         //added the following 3 if checks
-        if (first_sphere->is_static || second_sphere->is_static)
+        if (bodies.isStatic(first_body) || bodies.isStatic(second_body))
             intersection *= 2;
 
         //glm::vec2 rel_vel = 
 
-        if ( !first_sphere->is_static )
-            first_sphere->position  -= intersection * collision_normal;
+        if ( !bodies.isStatic(first_body) )
+            bodies.setPosition(first_body, bodies.getPosition(first_body) - intersection * collision_normal);
         
-        if (!second_sphere->is_static)
-            second_sphere->position += intersection * collision_normal;
+        if (!bodies.isStatic(second_body))
+            bodies.setPosition(second_body, bodies.getPosition(second_body) + intersection * collision_normal);
         
         result.e = 0.95f;
         result.N = collision_normal;
-        result.P = first_sphere->position + collision_normal * first_sphere->_radius;
+        result.P = bodies.getPosition(first_body) + collision_normal * first_sphere->_radius;
 
         result.colliding = true;
     }
@@ -464,9 +766,11 @@ CollisionManifold DIYPhysicScene::Sphere2Plane(DIYPhysicScene* scene, PhysicsObj
 {
     SphereClass* sphere = (SphereClass*)first;
     PlaneClass* plane = (PlaneClass*)second;
+    DIYBodyArrays& bodies = scene->bodies;
+    glm::vec2 position = bodies.getPosition(sphere->body);
 
     float perpendicular_distance = 
-        glm::dot(sphere->position, plane->normal) - plane->distance;
+        glm::dot(position, plane->normal) - plane->distance;
 
     CollisionManifold result = {};
     result.colliding = false;
@@ -476,12 +780,13 @@ CollisionManifold DIYPhysicScene::Sphere2Plane(DIYPhysicScene* scene, PhysicsObj
     if (perpendicular_distance < sphere->_radius)
     {
         float intersection = sphere->_radius - perpendicular_distance;
-        sphere->position += plane->normal * intersection;
+        position += plane->normal * intersection;
+        bodies.setPosition(sphere->body, position);
         
         result.colliding = true;
-        result.N = plane->normal;
+        result.N = -plane->normal;
         result.e = 0.75f;
-        result.P = sphere->position - plane->normal * sphere->_radius;
+        result.P = position - plane->normal * sphere->_radius;
     }
 
     return result;
@@ -494,22 +799,13 @@ CollisionManifold DIYPhysicScene::Plane2Sphere(DIYPhysicScene* scene, PhysicsObj
 
 void BuildBoxPoints(BoxClass* box, glm::vec2* points)
 {
-    points[0] =
-        (box->rotationMatrix *
-        glm::vec4(-box->width, -box->height, 0, 1)).xy()
-        + box->position;
-    points[1] =
-        (box->rotationMatrix *
-        glm::vec4(-box->width, box->height, 0, 1)).xy()
-        + box->position;
-    points[2] =
-        (box->rotationMatrix *
-        glm::vec4(box->width, box->height, 0, 1)).xy()
-        + box->position;
-    points[3] =
-        (box->rotationMatrix *
-        glm::vec4(box->width, -box->height, 0, 1)).xy()
-        + box->position;
+    const DIYBodyArrays& bodies = box->scene->bodies;
+    glm::vec2 position = bodies.getPosition(box->body);
+
+    points[0] = bodies.toWorld(box->body, glm::vec2(-box->width, -box->height)) + position;
+    points[1] = bodies.toWorld(box->body, glm::vec2(-box->width, box->height)) + position;
+    points[2] = bodies.toWorld(box->body, glm::vec2(box->width, box->height)) + position;
+    points[3] = bodies.toWorld(box->body, glm::vec2(box->width, -box->height)) + position;
 }
 
 
@@ -609,8 +905,8 @@ CollisionManifold DIYPhysicScene::Box2Box(DIYPhysicScene* scene, PhysicsObject*
 
     //if we made it this far and did not return yet, that means they are colliding
     
-    first_box->is_colliding = true;
-    second_box->is_colliding = true;
+    scene->bodies.colliding[first_box->body] = 1;
+    scene->bodies.colliding[second_box->body] = 1;
 
     return result;
 }
@@ -638,11 +934,12 @@ CollisionManifold DIYPhysicScene::Box2Plane(DIYPhysicScene* scene, PhysicsObject
         if (distance < 0)
         {
             result.colliding = true;
-            result.N = plane->normal;
+            result.N = -plane->normal;
 
             if (distance < lowest_distance)
             {
                 lowest_distance = distance;
+                result.feature = point_index;
                 result.P = points[point_index] - plane->normal * lowest_distance;
             }
         }
@@ -650,7 +947,7 @@ CollisionManifold DIYPhysicScene::Box2Plane(DIYPhysicScene* scene, PhysicsObject
 
     if (result.colliding)
     {
-        box->position -= plane->normal * lowest_distance;
+        scene->bodies.setPosition(box->body, scene->bodies.getPosition(box->body) - plane->normal * lowest_distance);
     }
 
     return result;
@@ -666,13 +963,8 @@ CollisionManifold DIYPhysicScene::Box2Sphere(DIYPhysicScene* scene, PhysicsObjec
     BoxClass* box = (BoxClass*)first;
     SphereClass* sphere = (SphereClass*)second;
 
-    glm::vec2 vector_to_circle = sphere->position - box->position;
-
-    float sin_theta = sinf(-box->rotation2D);
-    float cos_theta = cosf(-box->rotation2D);
-
-    vector_to_circle = glm::vec2(cos_theta * vector_to_circle.x - sin_theta * vector_to_circle.y,
-                                 sin_theta * vector_to_circle.x + cos_theta * vector_to_circle.y);
+    DIYBodyArrays& bodies = scene->bodies;
+    glm::vec2 vector_to_circle = bodies.toLocal(box->body, bodies.getPosition(sphere->body) - bodies.getPosition(box->body));
 
     float dist_sq = 0;
     if (vector_to_circle.x > box->width ) // if the circle is to the right
@@ -699,7 +991,7 @@ CollisionManifold DIYPhysicScene::Box2Sphere(DIYPhysicScene* scene, PhysicsObjec
 
     if ((sphere->_radius * sphere->_radius) > dist_sq)
     {
-        box->is_colliding = true;
+        bodies.colliding[box->body] = 1;
         
         CollisionManifold result = {};
         return result;
@@ -715,7 +1007,7 @@ CollisionManifold DIYPhysicScene::Sphere2Box(DIYPhysicScene* scene, PhysicsObjec
     return Box2Sphere(scene, second, first);
 }
 
-SpringJoint::SpringJoint(DIYRigidBody* a_bodyA, DIYRigidBody* a_bodyB,
+SpringJoint::SpringJoint(DIYBodyHandle a_bodyA, DIYBodyHandle a_bodyB,
                             float a_k, float a_d, float a_resting_distance)
 {
     this->bodyA = a_bodyA;
@@ -725,28 +1017,38 @@ SpringJoint::SpringJoint(DIYRigidBody* a_bodyA, DIYRigidBody* a_bodyB,
     this->resting_distance = a_resting_distance;
 }
 
-void SpringJoint::Update(float delta_time)
+void SpringJoint::Update(DIYPhysicScene* scene, float delta_time)
 {
-    if (!bodyA || !bodyB)
+    int a = scene->bodyIndex(bodyA);
+    int b = scene->bodyIndex(bodyB);
+    if (a < 0 || b < 0)
     {
         return;
     }
 
-    glm::vec2 diff_vector = bodyA->position - bodyB->position;
+    DIYBodyArrays& bodies = scene->bodies;
+    glm::vec2 diff_vector = bodies.getPosition(a) - bodies.getPosition(b);
 
     float distance = glm::length(diff_vector);
 
     glm::vec2 force = -k * (distance - resting_distance) 
                                 * glm::normalize(diff_vector);
 
-    if ( !bodyA->is_static )
-        bodyA->applyForce( force - this->d * bodyA->velocity );
+    if ( !bodies.isStatic(a) )
+        bodies.applyForce( a, force - this->d * bodies.getVelocity(a) );
     
-    if ( !bodyB->is_static )
-        bodyB->applyForce( -force - this->d * bodyB->velocity );
+    if ( !bodies.isStatic(b) )
+        bodies.applyForce( b, -force - this->d * bodies.getVelocity(b) );
 }
 
-void SpringJoint::DrawGizmo()
+void SpringJoint::DrawGizmo(DIYPhysicScene* scene)
 {
-    Gizmos::add2DLine(bodyA->position, bodyB->position, glm::vec4(0, 0.8f, 0.8f, 1));
+    int a = scene->bodyIndex(bodyA);
+    int b = scene->bodyIndex(bodyB);
+    if (a < 0 || b < 0)
+    {
+        return;
+    }
+
+    Gizmos::add2DLine(scene->bodies.getPosition(a), scene->bodies.getPosition(b), glm::vec4(0, 0.8f, 0.8f, 1));
 }
@@ -13,6 +13,10 @@
 #include <glm/ext.hpp>
 #include <iostream>
 
+#include "DIYBroadphase.h"
+#include "DIYBodyKernels.h"
+#include "DIYContactCache.h"
+
 enum ShapeType
 {
 	PLANE = 0,
@@ -23,14 +27,17 @@ enum ShapeType
 	NUMBERSHAPE = 3,
 };
 
+class DIYPhysicScene;
+class DIYRigidBody;
+
 class PhysicsObject
 {
 public:
 	ShapeType _shapeID;
-	void virtual update(glm::vec2 gravity,float timeStep) = 0;
 	void virtual debug() =0;
 	void virtual makeGizmo() =0;
-	void virtual resetPosition(){};
+	//axis aligned bounds for the broadphase, false for shapes that don't have any
+	bool virtual getBounds(BroadphaseBox& /*bounds*/) { return false; }
 };
 
 
@@ -39,67 +46,113 @@ class PlaneClass: public PhysicsObject
 public:
 	glm::vec2 normal;
 	float distance;
-	void virtual update(glm::vec2 gravity,float timeStep){};
+	int id = -1;	//given by the scene it's added to, for its contacts' keys
 	void virtual debug(){};
 	void virtual makeGizmo();
 	PlaneClass(glm::vec2 normal,float distance);
 	PlaneClass();
 };
 
+//names a body of a DIYPhysicScene. a body keeps its slot for as long as it exists, and the slot's
+//generation goes up when the body is removed, so an old handle to it can be told from one to
+//whatever body takes the slot next
+struct DIYBodyHandle
+{
+    int slot = -1;
+    unsigned int generation = 0;
+};
+
+//the state of every body that the scene reads each update, one entry per body in split arrays so
+//integration is a straight pass over them. bodies move about in these as others are removed,
+//DIYPhysicScene::bodyIndex finds where a handle's body is now
+struct DIYBodyArrays
+{
+    std::vector<float> position_x, position_y;
+    std::vector<float> velocity_x, velocity_y;
+    std::vector<float> rotation;            //about z
+    std::vector<float> rotation_cos, rotation_sin;  //of rotation, kept up to date by whatever sets it
+    std::vector<float> angular_velocity;
+    std::vector<float> force_x, force_y;    //added up until the next update
+    std::vector<float> torque;
+    std::vector<float> mass;
+    std::vector<float> moment_of_inertia;
+    std::vector<float> dynamic_friction;
+    std::vector<float> dynamic;             //1 for bodies that move and 0 for static ones, a factor so integration doesn't branch
+    std::vector<float> inverse_mass;        //1 / mass, and 1 / moment_of_inertia. 0 for static bodies, whatever their
+    std::vector<float> inverse_moment;      //mass, so nothing changes their velocity. see updateInverses
+    std::vector<unsigned char> colliding;   //a box touched another this update
+
+    std::vector<int> slot;                  //of each body's handle
+    std::vector<DIYRigidBody*> objects;     //shape, colour and the rest of what is only read now and then
+
+    int size() const { return (int)objects.size(); }
+
+    glm::vec2 getPosition(int body) const { return glm::vec2(position_x[body], position_y[body]); }
+    void setPosition(int body, glm::vec2 position) { position_x[body] = position.x; position_y[body] = position.y; }
+    glm::vec2 getVelocity(int body) const { return glm::vec2(velocity_x[body], velocity_y[body]); }
+    void setVelocity(int body, glm::vec2 velocity) { velocity_x[body] = velocity.x; velocity_y[body] = velocity.y; }
+    bool isStatic(int body) const { return dynamic[body] == 0; }
+    void setStatic(int body, bool is_static) { dynamic[body] = is_static ? 0.0f : 1.0f; updateInverses(body); }
+    void setMass(int body, float body_mass) { mass[body] = body_mass; updateInverses(body); }
+    void updateInverses(int body);      //after mass, moment_of_inertia or dynamic change
+
+    //a vector turned from the body's frame into the world's, and back
+    glm::vec2 toWorld(int body, glm::vec2 v) const
+    {
+        return glm::vec2(rotation_cos[body] * v.x - rotation_sin[body] * v.y,
+                         rotation_sin[body] * v.x + rotation_cos[body] * v.y);
+    }
+    glm::vec2 toLocal(int body, glm::vec2 v) const
+    {
+        return glm::vec2(rotation_cos[body] * v.x + rotation_sin[body] * v.y,
+                         rotation_cos[body] * v.y - rotation_sin[body] * v.x);
+    }
+    void setRotation(int body, float angle) { rotation[body] = WrapBodyAngle(angle); BodySinCos(rotation[body], &rotation_cos[body], &rotation_sin[body]); }
+
+    void applyForce(int body, glm::vec2 force);
+    void applyForceAtPoint(int body, glm::vec2 force, glm::vec2 point);
+
+    void push(DIYRigidBody* object);    //zeroed state
+    void swapRemove(int body);          //the last body takes its place
+};
+
+//a body's shape and the state the scene doesn't touch every update. the scene makes and owns these,
+//see DIYPhysicScene::addSphere and addBox
 class DIYRigidBody: public PhysicsObject
 {
 public:
-	glm::vec2 position;
-	glm::vec2 velocity;
 	glm::vec4 colour;
-	glm::vec2 oldPosition;
-	glm::vec2 contactPoint;
-	float mass;
-    
-    float angular_velocity;
-    float moment_of_inertia;
-    glm::vec2 total_force;
-    float total_torque;
-
-    float static_friction;
-    float dynamic_friction;
-
-    //ADDED THIS
-    bool is_static;
-
-	float rotation2D; //2D so we only need a single float to represent our rotation about Z
-	glm::mat4 rotationMatrix;
-
-	DIYRigidBody(glm::vec2 position,glm::vec2 velocity,float rotation,float mass);
-	virtual void update(glm::vec2 gravity,float timeStep);
-	virtual void debug();
-	virtual void collisionResponse(glm::vec2 collisionPoint);
-	virtual void resetPosition(){position = oldPosition;};
 
-	void applyForce(glm::vec2 force);
-    void applyForceAtPoint(glm::vec2 force, glm::vec2 point);
+	DIYPhysicScene* scene;
+	int body;               //index into scene->bodies
+	DIYBodyHandle handle;
 
-    void applyForceToActor(DIYRigidBody* actor2, glm::vec2 force);
+	DIYRigidBody(glm::vec4 colour);
+	virtual ~DIYRigidBody() {}
+	virtual void debug();
 
+	//built from the body's cos and sin when asked for, only drawing needs one
+	glm::mat4 getRotationMatrix() const;
 };
 
 class Joint
 {
 public:
-    DIYRigidBody* bodyA;
-    DIYRigidBody* bodyB;
+    DIYBodyHandle bodyA;
+    DIYBodyHandle bodyB;
 
-    virtual void Update(float delta_time) = 0;
-    virtual void DrawGizmo() = 0; //ADDED THIS
+    virtual ~Joint() {}
+    virtual void Update(DIYPhysicScene* scene, float delta_time) = 0;
+    virtual void DrawGizmo(DIYPhysicScene* scene) = 0; //ADDED THIS
 };
 
 class SpringJoint : public Joint
 {
 public:
-    SpringJoint(DIYRigidBody* a_bodyA, DIYRigidBody* a_bodyB,
+    SpringJoint(DIYBodyHandle a_bodyA, DIYBodyHandle a_bodyB,
         float a_k, float a_d, float a_resting_distance);
-    virtual void Update(float delta_time);
-    virtual void DrawGizmo();
+    virtual void Update(DIYPhysicScene* scene, float delta_time);
+    virtual void DrawGizmo(DIYPhysicScene* scene);
 
     float k; //spring stiffness
     float d; //spring damping value
@@ -112,31 +165,24 @@ class SphereClass: public DIYRigidBody
 {
 public:
 	float _radius;
-	SphereClass(	glm::vec2 position,glm::vec2 velocity,float mass,float radius, glm::vec4& colour);
-	SphereClass(	glm::vec2 position, float angle, float speed, float radius, float mass, glm::vec4& colour);
+	SphereClass(float radius, glm::vec4 colour);
 	virtual void makeGizmo();
+	virtual bool getBounds(BroadphaseBox& bounds);
 };
 
 class BoxClass: public DIYRigidBody
 {
 public:
 	float width,height;
-    bool is_colliding;
 
-	BoxClass(	glm::vec2 position,glm::vec2 velocity,float rotation,float mass,float width, float height,glm::vec4& colour);
-	BoxClass(	glm::vec2 position, float angle, float speed, float rotation, float width, float height, float mass, glm::vec4& colour);
+	BoxClass(float width, float height, glm::vec4 colour);
 	virtual void makeGizmo();
 
     bool isPointOver(glm::vec2 point);
-
-    //Added this function
-    virtual void update(glm::vec2 gravity, float delta)
-    {
-        DIYRigidBody::update(gravity, delta);
-        this->is_colliding = false;
-    }
+    virtual bool getBounds(BroadphaseBox& bounds);
 };
 
+//what the narrow phase found. N points from first to second, second is 0 for a plane
 struct CollisionManifold
 {
     bool colliding;
@@ -147,9 +193,38 @@ struct CollisionManifold
     glm::vec2 P;
     glm::vec2 N;
     float e;
+    int feature;    //what touched, for telling whether it's the same contact as last update. a box's corner
+};
+
+//a manifold as the contact solver works on it
+struct ContactConstraint
+{
+    //ties it to last update's contact between the same two, see DIYPhysicScene::contact_cache
+    unsigned long long key;
+    unsigned int generation1;
+    unsigned int generation2;
+    int feature;
+
+    int first;
+    int second;                 //-1 for a plane
+
+    glm::vec2 point;
+    glm::vec2 normal;
+    glm::vec2 R_1p, R_2p;       //from each body to the contact point, turned a quarter turn
+    float inv_mass1, inv_mass2;     //0 for static bodies and planes
+    float inv_moi1, inv_moi2;
+    float normal_mass;
+    float tangent_mass;
+    float velocity_bias;        //the separating speed restitution asks for
+
+    //summed over the iterations. the normal impulse only ever pushes apart and the
+    //tangent one stays within contact_friction of it
+    float normal_impulse;
+    float tangent_impulse;
 };
 
 
+
 class DIYPhysicScene
 {
 	public:
@@ -157,22 +232,85 @@ class DIYPhysicScene
 	glm::vec2 gravity;
 	float timeStep;
 
+    ~DIYPhysicScene();
+
+    //every shape in the order they were added, planes and bodies alike
     std::vector<PhysicsObject*> actors;
 
+    DIYBodyArrays bodies;
+
+    //bodyIndex of every slot a handle has ever had, -1 once its body is removed
+    std::vector<int> slot_bodies;
+    std::vector<unsigned int> slot_generations;
+    std::vector<int> free_slots;
+
     std::vector<Joint*> joints;
 
+    //finds the pairs checkForCollisions runs the narrow phase on, 0 tests every pair.
+    //the scene doesn't own it
+    Broadphase* broadphase = nullptr;
+
+    //integrateBodies' simd kernels, see setSimd
+    const BodyKernels* kernels = SelectBodyKernels();
+
+    //checkForCollisions' working space, kept so it doesn't allocate every update
+    std::vector<BroadphaseBox> bounds;
+    std::vector<int> bounded_actors;    //actor index of each of bounds
+    std::vector<int> unbounded_actors;
+    std::vector<BroadphasePair> bounded_pairs;
+    std::vector<BroadphasePair> candidate_pairs;
+
+    //planes, which the scene doesn't own. bodies come from addSphere and addBox
     void addActor(PhysicsObject*);
     void removeActor(PhysicsObject*);
 
+    DIYBodyHandle addSphere(glm::vec2 position, glm::vec2 velocity, float radius, float mass, glm::vec4 colour);
+    DIYBodyHandle addBox(glm::vec2 position, glm::vec2 velocity, float rotation, float mass, float width, float height, glm::vec4 colour);
+    DIYBodyHandle addBody(DIYRigidBody* object, glm::vec2 position, glm::vec2 velocity, float rotation, float mass, float moment_of_inertia);
+    void removeBody(DIYBodyHandle handle);
+
+    int bodyIndex(DIYBodyHandle handle) const;     //where the body is in bodies, -1 if it has been removed
+    DIYRigidBody* getBody(DIYBodyHandle handle);
+
+    //for user code, by handle. the handle has to be to a body that is still there
+    glm::vec2 getPosition(DIYBodyHandle handle) { return bodies.getPosition(bodyIndex(handle)); }
+    void setPosition(DIYBodyHandle handle, glm::vec2 position) { bodies.setPosition(bodyIndex(handle), position); }
+    glm::vec2 getVelocity(DIYBodyHandle handle) { return bodies.getVelocity(bodyIndex(handle)); }
+    void setVelocity(DIYBodyHandle handle, glm::vec2 velocity) { bodies.setVelocity(bodyIndex(handle), velocity); }
+    float getRotation(DIYBodyHandle handle) { return bodies.rotation[bodyIndex(handle)]; }
+    void setRotation(DIYBodyHandle handle, float rotation) { bodies.setRotation(bodyIndex(handle), rotation); }
+    float getMass(DIYBodyHandle handle) { return bodies.mass[bodyIndex(handle)]; }
+    void setMass(DIYBodyHandle handle, float mass) { bodies.setMass(bodyIndex(handle), mass); }
+    bool isStatic(DIYBodyHandle handle) { return bodies.isStatic(bodyIndex(handle)); }
+    void setStatic(DIYBodyHandle handle, bool is_static) { bodies.setStatic(bodyIndex(handle), is_static); }
+    void applyForce(DIYBodyHandle handle, glm::vec2 force) { bodies.applyForce(bodyIndex(handle), force); }
+    void applyForceAtPoint(DIYBodyHandle handle, glm::vec2 force, glm::vec2 point) { bodies.applyForceAtPoint(bodyIndex(handle), force, point); }
+
     void addJoint(Joint*);
     void removeJoint(Joint*);
 	
     void upDate();
+    void integrateBodies();      //gravity, friction and the forces applied since the last update, over every body
+    void setSimd(SimdLevel simd);
 	void solveIntersections();
 	void debugScene();
 	void upDateGizmos();
 
+    //contacts are all found first and then solved together, see solveContacts
+    int solver_iterations = 8;
+    bool warm_starting = true;          //start each contact from the impulses it ended on last update
+    float restitution_threshold = 1.0f; //closing speeds below this don't bounce, so resting contacts settle
+    float contact_friction = 0;         //coulomb friction coefficient, 0 leaves tangents alone as before
+
+    std::vector<ContactConstraint> contacts;
+
+    //every contact's impulses, by the slots of its bodies' handles, or a plane's id, to warm start from
+    ContactCache contact_cache;
+    int plane_count = 0;
+
     void checkForCollisions();
+    void collectContact(PhysicsObject* object1, PhysicsObject* object2);
+    void solveContacts();
 
     static CollisionManifold Sphere2Sphere   (DIYPhysicScene* scene, PhysicsObject* first, PhysicsObject* second);
     static CollisionManifold Sphere2Plane    (DIYPhysicScene* scene, PhysicsObject* first, PhysicsObject* second);
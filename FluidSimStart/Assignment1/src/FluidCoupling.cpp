@@ -0,0 +1,220 @@
+#include "FluidCoupling.h"
+#include "DIYFluid.h"
+#include "FluidWorkers.h"
+#include "DIYPhysicsEngine.h"
+
+FluidWorldMapping DefaultFluidMapping(const DIYFluid* fluid)
+{
+	FluidWorldMapping mapping;
+	mapping.origin = glm::vec2(-50, -50);
+	mapping.cell_size = 100.0f / (float)glm::max(fluid->width, fluid->height);
+	return mapping;
+}
+
+FluidCoupling::FluidCoupling(DIYFluid* _fluid, DIYPhysicScene* _scene, const FluidWorldMapping& _mapping)
+{
+	this->fluid = _fluid;
+	this->scene = _scene;
+	this->mapping = _mapping;
+
+	//about what the tutorial scenes' spheres weigh for their size
+	this->density = 0.1f;
+
+	this->owners.assign(_fluid->pitch * _fluid->height, -1);
+}
+
+//is the point, in cells relative to the body's centre, inside it
+static inline bool BodyContains(const CoupledBody& body, glm::vec2 offset)
+{
+	if (body.is_box)
+	{
+		//same test as BoxClass::isPointOver, with the rotation worked out once per body
+		return fabsf(glm::dot(offset, body.axis_x)) < body.extents.x &&
+			   fabsf(glm::dot(offset, body.axis_y)) < body.extents.y;
+	}
+	return glm::dot(offset, offset) < body.extents.x * body.extents.x;
+}
+
+void FluidCoupling::Rasterize()
+{
+	DIYFluid* fluid = this->fluid;
+	float inv_cell_size = 1.0f / this->mapping.cell_size;
+
+	//fluid velocities are in the fluid's own units, cell_dist to a cell rather than cell_size
+	float velocity_scale = fluid->cell_dist * inv_cell_size;
+
+	const DIYBodyArrays& scene_bodies = this->scene->bodies;
+
+	this->bodies.clear();
+	for (int b = 0; b < scene_bodies.size(); ++b)
+	{
+		DIYRigidBody* actor = scene_bodies.objects[b];
+
+		CoupledBody body;
+		body.index = b;
+		body.is_box = actor->_shapeID == BOX;
+		body.centre = (scene_bodies.getPosition(b) - this->mapping.origin) * inv_cell_size;
+		body.axis_x = glm::vec2(scene_bodies.rotation_cos[b], scene_bodies.rotation_sin[b]);
+		body.axis_y = glm::vec2(-body.axis_x.y, body.axis_x.x);
+		body.velocity = scene_bodies.getVelocity(b) * velocity_scale;
+		body.angular_velocity = scene_bodies.angular_velocity[b];
+
+		//a box's bounding circle reaches out to its corners
+		float radius;
+		if (body.is_box)
+		{
+			BoxClass* box = (BoxClass*)actor;
+			body.extents = glm::vec2(box->width, box->height) * inv_cell_size;
+			radius = glm::length(body.extents);
+		}
+		else
+		{
+			body.extents = glm::vec2(((SphereClass*)actor)->_radius * inv_cell_size, 0);
+			radius = body.extents.x;
+		}
+
+		body.x_begin = glm::max((int)floorf(body.centre.x - radius), 0);
+		body.y_begin = glm::max((int)floorf(body.centre.y - radius), 0);
+		body.x_end = glm::min((int)ceilf(body.centre.x + radius), fluid->width);
+		body.y_end = glm::min((int)ceilf(body.centre.y + radius), fluid->height);
+
+		if (body.x_begin < body.x_end && body.y_begin < body.y_end)
+		{
+			this->bodies.push_back(body);
+		}
+	}
+
+	//each band clears its own rows and draws every body that crosses them, so no two threads
+	//write the same cell and overlapping bodies come out the same as they would on one thread.
+	//only the cells a body was drawn on last frame are cleared, solids set through SetCellType stay
+	//and no body is drawn over them
+	bool band_changed[FluidWorkers::MAX_THREADS] = {};
+	int body_count = (int)this->bodies.size();
+
+	fluid->workers->ParallelRows(fluid->height, [&](int y_begin, int y_end, int band)
+	{
+		for (int y = y_begin; y < y_end; ++y)
+		{
+			int row = y * fluid->pitch;
+			unsigned char* types = fluid->cell_types + row;
+			int* row_owners = this->owners.data() + row;
+
+			for (int x = 0; x < fluid->width; ++x)
+			{
+				if (row_owners[x] >= 0)
+				{
+					types[x] = CELL_FLUID;
+					row_owners[x] = -1;
+					band_changed[band] = true;
+				}
+			}
+
+			for (int b = 0; b < body_count; ++b)
+			{
+				const CoupledBody& body = this->bodies[b];
+				if (y < body.y_begin || y >= body.y_end)
+				{
+					continue;
+				}
+
+				for (int x = body.x_begin; x < body.x_end; ++x)
+				{
+					//inflow and outflow cells, and solids that aren't a body's
+					if ((types[x] & (CELL_INFLOW | CELL_OUTFLOW)) || ((types[x] & CELL_SOLID) && row_owners[x] < 0))
+					{
+						continue;
+					}
+
+					glm::vec2 offset = glm::vec2((float)x + 0.5f, (float)y + 0.5f) - body.centre;
+					if (!BodyContains(body, offset))
+					{
+						continue;
+					}
+
+					//the body's velocity at the cell, linear plus the spin about its centre
+					glm::vec2 velocity = body.velocity + body.angular_velocity * fluid->cell_dist * glm::vec2(-offset.y, offset.x);
+
+					types[x] = CELL_SOLID;
+					fluid->obstacle_velocity_x[row + x] = velocity.x;
+					fluid->obstacle_velocity_y[row + x] = velocity.y;
+					row_owners[x] = b;
+					band_changed[band] = true;
+				}
+			}
+		}
+	});
+
+	for (int band = 0; band < FluidWorkers::MAX_THREADS; ++band)
+	{
+		if (band_changed[band])
+		{
+			fluid->cell_types_changed = true;
+		}
+	}
+}
+
+void FluidCoupling::ApplyForces(float dt, int steps)
+{
+	if (steps <= 0)
+	{
+		return;
+	}
+
+	DIYFluid* fluid = this->fluid;
+	const float* p = fluid->front_cells.pressure;
+	float cell_size = this->mapping.cell_size;
+
+	//the solve's pressure is in fluid units and already has dt and the density taken out of it,
+	//see ApplyPressure. back to physics units, then times the length of the face it acts on
+	float unit_scale = cell_size / fluid->cell_dist;
+	float force_scale = this->density * unit_scale * unit_scale * cell_size / dt * steps;
+
+	const int step_x[4] = { -1, 1, 0, 0 };
+	const int step_y[4] = { 0, 0, -1, 1 };
+
+	//one body per row, they only read the fluid and each writes to its own body
+	fluid->workers->ParallelRows((int)this->bodies.size(), [&](int b_begin, int b_end, int /*band*/)
+	{
+		for (int b = b_begin; b < b_end; ++b)
+		{
+			const CoupledBody& body = this->bodies[b];
+			if (this->scene->bodies.isStatic(body.index))
+			{
+				continue;
+			}
+
+			for (int y = body.y_begin; y < body.y_end; ++y)
+			{
+				for (int x = body.x_begin; x < body.x_end; ++x)
+				{
+					if (this->owners[x + y * fluid->pitch] != b)
+					{
+						continue;
+					}
+
+					//every face onto a cell the fluid is solved in, pushing back into the body
+					for (int n = 0; n < 4; ++n)
+					{
+						int nx = x + step_x[n];
+						int ny = y + step_y[n];
+						if (nx < 0 || ny < 0 || nx >= fluid->width || ny >= fluid->height)
+						{
+							continue;
+						}
+
+						int neighbour = nx + ny * fluid->pitch;
+						if (fluid->cell_types[neighbour] & CELL_FIXED_VELOCITY)
+						{
+							continue;
+						}
+
+						glm::vec2 normal = glm::vec2((float)step_x[n], (float)step_y[n]);
+						glm::vec2 face = this->mapping.origin + (glm::vec2((float)x + 0.5f, (float)y + 0.5f) + 0.5f * normal) * cell_size;
+
+						this->scene->bodies.applyForceAtPoint(body.index, -normal * p[neighbour] * force_scale, face);
+					}
+				}
+			}
+		}
+	});
+}
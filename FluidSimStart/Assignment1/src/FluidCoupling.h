@@ -0,0 +1,67 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+class DIYFluid;
+class DIYPhysicScene;
+
+//where a fluid grid sits in the physics world. cell (x, y) covers the square with its lower left
+//corner at origin + (x, y) * cell_size
+struct FluidWorldMapping
+{
+	glm::vec2 origin;
+	float cell_size;	//physics units along each side of a cell
+};
+
+//the part of the physics world under the fluid quad that main.cpp draws, the quad's +-5 under a
+//+-10 projection is +-50 under the gizmos' +-100
+FluidWorldMapping DefaultFluidMapping(const DIYFluid* fluid);
+
+//a sphere or box of the scene as Rasterize sees it, in cells rather than physics units
+struct CoupledBody
+{
+	int index;					//into the scene's bodies
+	bool is_box;
+	glm::vec2 centre;
+	glm::vec2 axis_x, axis_y;	//box's local axes, unit length
+	glm::vec2 extents;			//box's half width and height, or the sphere's radius in x
+	glm::vec2 velocity;			//in the fluid's units
+	float angular_velocity;
+	int x_begin, x_end;			//cells under its bounding circle, clipped to the grid
+	int y_begin, y_end;
+};
+
+//two way coupling between a fluid and the spheres and boxes of a physics scene. every frame,
+//Rasterize before the fluid steps, then ApplyForces after it if it ran any steps, ahead of the
+//scene's own update
+class FluidCoupling
+{
+public:
+	FluidCoupling(DIYFluid* _fluid, DIYPhysicScene* _scene, const FluidWorldMapping& _mapping);
+
+	//marks every cell whose centre is inside a body as CELL_SOLID, moving with the body's velocity
+	//at that point, after turning the cells bodies covered last frame back to fluid. inflow and
+	//outflow cells, and solids set with DIYFluid::SetCellType, are left as they are
+	void Rasterize();
+
+	//the fluid's pressure on the faces between each body's cells and the fluid around them,
+	//applied to the body through applyForceAtPoint. static bodies are skipped. dt is the length of
+	//the step that left the pressure, and steps how many fixed steps the fluid has run since the
+	//last call, the last one's force standing in for each of them. nothing is applied for 0 steps,
+	//the pressure would be one that has already been applied
+	void ApplyForces(float dt, int steps = 1);
+
+public:
+	DIYFluid* fluid;
+	DIYPhysicScene* scene;
+	FluidWorldMapping mapping;
+	//physics mass per unit area of fluid. the coupling is explicit, the pressure that pushes a body
+	//is solved with the body's velocity held fixed, so bodies much lighter than the fluid they
+	//displace overshoot when they're jolted
+	float density;
+
+	std::vector<CoupledBody> bodies;	//last Rasterize's
+	std::vector<int> owners;			//index into bodies of the body over each cell, -1 for none. a row is fluid->pitch
+};
@@ -0,0 +1,1677 @@
+#include "FluidKernels.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define FLUID_KERNELS_X86
+#endif
+
+#ifdef FLUID_KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+//msvc will emit avx2 instructions anywhere, gcc and clang need the functions marked. the avx2 set
+//also does its fp16 conversions with f16c, which every cpu with avx2 has
+#if defined(FLUID_KERNELS_X86) && !defined(_MSC_VER)
+#define FLUID_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#else
+#define FLUID_TARGET_AVX2
+#endif
+
+//every kernel set adds its lanes up in this order, so they all round the same way
+static float SumLanes(const float* lanes)
+{
+	float sum = 0;
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		sum += lanes[lane];
+	}
+	return sum;
+}
+
+//single cell versions of the kernels. the scalar set is built from these, and the
+//simd sets use them for the last few cells of a row that don't fill a register.
+//the operations are in the same order as the simd code so the results match exactly
+
+static inline float DiffuseCell(const float* v, const float* source, int i, int pitch, float inv_vdt, float denom)
+{
+	return ((((v[i + pitch] + v[i + 1]) + v[i - pitch]) + v[i - 1]) + source[i] * inv_vdt) * denom;
+}
+
+static inline float DivergenceCell(const float* vx, const float* vy, int c, int pitch, float inv_cell_dist)
+{
+	return ((vx[c + 1] - vx[c - 1]) + (vy[c + pitch] - vy[c - pitch])) * inv_cell_dist;
+}
+
+static inline float PressureCell(const float* p, const float* divergence, int c, int pitch, float h2)
+{
+	return ((((p[c + pitch] + p[c - pitch]) + p[c - 1]) + p[c + 1]) - divergence[c] * h2) * 0.25f;
+}
+
+//red-black SOR versions, these relax the cell in place and return the jacobi step it took
+static inline float DiffuseSORCell(float* v, const float* source, int i, int pitch, float inv_vdt, float denom, float omega)
+{
+	float step = DiffuseCell(v, source, i, pitch, inv_vdt, denom) - v[i];
+	v[i] = v[i] + omega * step;
+	return step;
+}
+
+static inline float PressureSORCell(float* p, const float* divergence, int c, int pitch, float h2, float omega)
+{
+	float step = PressureCell(p, divergence, c, pitch, h2) - p[c];
+	p[c] = p[c] + omega * step;
+	return step;
+}
+
+static inline void ApplyPressureCell(const float* p, const float* vx, const float* vy, float* vx_out, float* vy_out,
+									 int c, int pitch, float inv_cell_dist)
+{
+	vx_out[c] = vx[c] + (p[c - 1] - p[c + 1]) * inv_cell_dist;
+	vy_out[c] = vy[c] + (p[c - pitch] - p[c + pitch]) * inv_cell_dist;
+}
+
+static inline float StaggeredDivergenceCell(const float* u, const float* v, int c, int pitch, float inv_cell_dist)
+{
+	return ((u[c + 1] - u[c]) + (v[c + pitch] - v[c])) * inv_cell_dist;
+}
+
+static inline void SubtractGradientCell(const float* p, const float* vel, float* vel_out, int c, int offset, float inv_cell_dist)
+{
+	vel_out[c] = vel[c] - (p[c] - p[c - offset]) * inv_cell_dist;
+}
+
+//7 point versions for DIYFluid3D, 'slice' floats between z slices. the extra two neighbours are
+//added after the 2d four in the same order everywhere
+
+static inline float Diffuse3DCell(const float* v, const float* source, int i, int pitch, int slice, float inv_vdt, float denom)
+{
+	return ((((((v[i + pitch] + v[i + 1]) + v[i - pitch]) + v[i - 1]) + v[i + slice]) + v[i - slice]) + source[i] * inv_vdt) * denom;
+}
+
+static inline float Divergence3DCell(const float* vx, const float* vy, const float* vz, int c, int pitch, int slice, float inv_cell_dist)
+{
+	return (((vx[c + 1] - vx[c - 1]) + (vy[c + pitch] - vy[c - pitch])) + (vz[c + slice] - vz[c - slice])) * inv_cell_dist;
+}
+
+static inline float Pressure3DCell(const float* p, const float* divergence, int c, int pitch, int slice, float h2)
+{
+	return ((((((p[c + pitch] + p[c - pitch]) + p[c - 1]) + p[c + 1]) + p[c + slice]) + p[c - slice]) - divergence[c] * h2) * (1.0f / 6.0f);
+}
+
+static inline void ApplyPressure3DCell(const float* p, const float* vx, const float* vy, const float* vz,
+									   float* vx_out, float* vy_out, float* vz_out, int c, int pitch, int slice, float inv_cell_dist)
+{
+	vx_out[c] = vx[c] + (p[c - 1] - p[c + 1]) * inv_cell_dist;
+	vy_out[c] = vy[c] + (p[c - pitch] - p[c + pitch]) * inv_cell_dist;
+	vz_out[c] = vz[c] + (p[c - slice] - p[c + slice]) * inv_cell_dist;
+}
+
+//scalar
+
+static float DiffuseRowScalar(const float* v, const float* source, float* v_out,
+							  int begin, int end, int pitch,
+							  float inv_vdt, float denom, float residual_scale)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float diffused = DiffuseCell(v, source, i + lane, pitch, inv_vdt, denom);
+			float r = (diffused - v[i + lane]) * residual_scale;
+
+			v_out[i + lane] = diffused;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = DiffuseCell(v, source, i, pitch, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static float DivergenceRowScalar(const float* vx, const float* vy, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float d = DivergenceCell(vx, vy, c + lane, pitch, inv_cell_dist);
+
+			divergence[c + lane] = d;
+			lanes[lane] += d;
+		}
+	}
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = DivergenceCell(vx, vy, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static float PressureRowScalar(const float* p, const float* divergence, float* p_out,
+							   int begin, int end, int pitch, float h2, float inv_h2)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float new_pressure = PressureCell(p, divergence, c + lane, pitch, h2);
+			float r = 4.0f * (p[c + lane] - new_pressure) * inv_h2;
+
+			p_out[c + lane] = new_pressure;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = PressureCell(p, divergence, c, pitch, h2);
+		float r = 4.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+//the simd sets relax 8 cells at a time with the other colour masked off, so the residuals of
+//cells begin + 8k + lane go in lanes[lane] and the odd lanes stay 0
+static float DiffuseSORRowScalar(float* v, const float* source, int begin, int end, int pitch,
+								 float inv_vdt, float denom, float residual_scale, float omega)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		for (int lane = 0; lane < 8; lane += 2)
+		{
+			float r = DiffuseSORCell(v, source, i + lane, pitch, inv_vdt, denom, omega) * residual_scale;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; i += 2)
+	{
+		float r = DiffuseSORCell(v, source, i, pitch, inv_vdt, denom, omega) * residual_scale;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static float PressureSORRowScalar(float* p, const float* divergence, int begin, int end, int pitch,
+								  float h2, float inv_h2, float omega)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; lane += 2)
+		{
+			float r = 4.0f * PressureSORCell(p, divergence, c + lane, pitch, h2, omega) * inv_h2;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; c += 2)
+	{
+		float r = 4.0f * PressureSORCell(p, divergence, c, pitch, h2, omega) * inv_h2;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static void ApplyPressureRowScalar(const float* p, const float* vx, const float* vy, float* vx_out, float* vy_out,
+								   int begin, int end, int pitch, float inv_cell_dist)
+{
+	for (int c = begin; c < end; ++c)
+	{
+		ApplyPressureCell(p, vx, vy, vx_out, vy_out, c, pitch, inv_cell_dist);
+	}
+}
+
+static float StaggeredDivergenceRowScalar(const float* u, const float* v, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float d = StaggeredDivergenceCell(u, v, c + lane, pitch, inv_cell_dist);
+
+			divergence[c + lane] = d;
+			lanes[lane] += d;
+		}
+	}
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = StaggeredDivergenceCell(u, v, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static void SubtractGradientRowScalar(const float* p, const float* vel, float* vel_out, int begin, int end, int offset, float inv_cell_dist)
+{
+	for (int c = begin; c < end; ++c)
+	{
+		SubtractGradientCell(p, vel, vel_out, c, offset, inv_cell_dist);
+	}
+}
+
+static float Diffuse3DRowScalar(const float* v, const float* source, float* v_out,
+								int begin, int end, int pitch, int slice,
+								float inv_vdt, float denom, float residual_scale)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float diffused = Diffuse3DCell(v, source, i + lane, pitch, slice, inv_vdt, denom);
+			float r = (diffused - v[i + lane]) * residual_scale;
+
+			v_out[i + lane] = diffused;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = Diffuse3DCell(v, source, i, pitch, slice, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static float Divergence3DRowScalar(const float* vx, const float* vy, const float* vz, float* divergence,
+								   int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float d = Divergence3DCell(vx, vy, vz, c + lane, pitch, slice, inv_cell_dist);
+
+			divergence[c + lane] = d;
+			lanes[lane] += d;
+		}
+	}
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = Divergence3DCell(vx, vy, vz, c, pitch, slice, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static float Pressure3DRowScalar(const float* p, const float* divergence, float* p_out,
+								 int begin, int end, int pitch, int slice, float h2, float inv_h2)
+{
+	float lanes[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float new_pressure = Pressure3DCell(p, divergence, c + lane, pitch, slice, h2);
+			float r = 6.0f * (p[c + lane] - new_pressure) * inv_h2;
+
+			p_out[c + lane] = new_pressure;
+			lanes[lane] += r * r;
+		}
+	}
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = Pressure3DCell(p, divergence, c, pitch, slice, h2);
+		float r = 6.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static void ApplyPressure3DRowScalar(const float* p, const float* vx, const float* vy, const float* vz,
+									 float* vx_out, float* vy_out, float* vz_out,
+									 int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	for (int c = begin; c < end; ++c)
+	{
+		ApplyPressure3DCell(p, vx, vy, vz, vx_out, vy_out, vz_out, c, pitch, slice, inv_cell_dist);
+	}
+}
+
+static inline unsigned char DyeByte(float v)
+{
+	//written so nan fails the first test, the same as max(v, 0) does in the simd versions
+	return (unsigned char)(int)(v > 0.0f ? (v < 255.0f ? v : 255.0f) : 0.0f);
+}
+
+static void DyeToRGBA8RowScalar(const float* r, const float* g, const float* b, unsigned char* rgba, int count)
+{
+	for (int c = 0; c < count; ++c)
+	{
+		rgba[c * 4 + 0] = DyeByte(r[c]);
+		rgba[c * 4 + 1] = DyeByte(g[c]);
+		rgba[c * 4 + 2] = DyeByte(b[c]);
+		rgba[c * 4 + 3] = 255;
+	}
+}
+
+//fp16 conversions done the way f16c does them, rounding to nearest even, so the sets without it
+//store the same bits. nans keep the top of their payload and come out quiet
+static inline unsigned short FloatToHalf(float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+
+	unsigned int sign = (x >> 16) & 0x8000;
+	x &= 0x7fffffff;
+
+	if (x > 0x7f800000)
+	{
+		return (unsigned short)(sign | 0x7e00 | ((x >> 13) & 0x3ff));
+	}
+	if (x >= 0x47800000)
+	{
+		return (unsigned short)(sign | 0x7c00);
+	}
+	if (x < 0x38800000)
+	{
+		//under the smallest normal half, adding 0.5 lines the bits up as a denormal and
+		//lets the fpu do the rounding
+		const unsigned int denorm_magic_bits = ((127 - 15) + (23 - 10) + 1) << 23;
+		float denorm_magic;
+		memcpy(&denorm_magic, &denorm_magic_bits, sizeof(denorm_magic));
+
+		float shifted;
+		memcpy(&shifted, &x, sizeof(shifted));
+		shifted += denorm_magic;
+
+		unsigned int shifted_bits;
+		memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+		return (unsigned short)(sign | (shifted_bits - denorm_magic_bits));
+	}
+
+	//rebias the exponent and round the 13 bits that are dropped, ties to the even mantissa
+	unsigned int mantissa_odd = (x >> 13) & 1;
+	x += ((unsigned int)(15 - 127) << 23) + 0xfff + mantissa_odd;
+	return (unsigned short)(sign | (x >> 13));
+}
+
+static inline float HalfToFloat(unsigned short h)
+{
+	unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f;
+	unsigned int mantissa = h & 0x3ff;
+	unsigned int x;
+
+	if (exponent == 0)
+	{
+		//zero or denormal, exact as a float either way
+		float f = (float)mantissa * (1.0f / 16777216.0f);
+		memcpy(&x, &f, sizeof(x));
+		x |= sign;
+	}
+	else if (exponent == 31)
+	{
+		x = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+	}
+	else
+	{
+		x = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+	}
+
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+static void FloatToHalfRowScalar(const float* in, unsigned short* out, int count)
+{
+	for (int c = 0; c < count; ++c)
+	{
+		out[c] = FloatToHalf(in[c]);
+	}
+}
+
+static void HalfToFloatRowScalar(const unsigned short* in, float* out, int count)
+{
+	for (int c = 0; c < count; ++c)
+	{
+		out[c] = HalfToFloat(in[c]);
+	}
+}
+
+//written so a nan fails the test and is skipped, the same as max(|v|, m) does in the simd versions
+static float MaxAbsRowScalar(const float* v, int count)
+{
+	float m = 0;
+	for (int c = 0; c < count; ++c)
+	{
+		float a = fabsf(v[c]);
+		m = a > m ? a : m;
+	}
+	return m;
+}
+
+#ifdef FLUID_KERNELS_X86
+
+//sse2, each step of 8 is done as two halves so the lanes line up with the other sets
+
+static inline __m128 DiffuseSSE2(const float* v, const float* source, int i, int pitch, __m128 inv_vdt, __m128 denom)
+{
+	__m128 sum = _mm_add_ps(_mm_loadu_ps(v + i + pitch), _mm_loadu_ps(v + i + 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i - pitch));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i - 1));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + i), inv_vdt));
+	return _mm_mul_ps(sum, denom);
+}
+
+static float DiffuseRowSSE2(const float* v, const float* source, float* v_out,
+							int begin, int end, int pitch,
+							float inv_vdt, float denom, float residual_scale)
+{
+	__m128 inv_vdt4 = _mm_set1_ps(inv_vdt);
+	__m128 denom4 = _mm_set1_ps(denom);
+	__m128 scale4 = _mm_set1_ps(residual_scale);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128 diffused_lo = DiffuseSSE2(v, source, i, pitch, inv_vdt4, denom4);
+		__m128 diffused_hi = DiffuseSSE2(v, source, i + 4, pitch, inv_vdt4, denom4);
+		__m128 r_lo = _mm_mul_ps(_mm_sub_ps(diffused_lo, _mm_loadu_ps(v + i)), scale4);
+		__m128 r_hi = _mm_mul_ps(_mm_sub_ps(diffused_hi, _mm_loadu_ps(v + i + 4)), scale4);
+
+		_mm_storeu_ps(v_out + i, diffused_lo);
+		_mm_storeu_ps(v_out + i + 4, diffused_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = DiffuseCell(v, source, i, pitch, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static inline __m128 DivergenceSSE2(const float* vx, const float* vy, int c, int pitch, __m128 inv_cell_dist)
+{
+	__m128 dx = _mm_sub_ps(_mm_loadu_ps(vx + c + 1), _mm_loadu_ps(vx + c - 1));
+	__m128 dy = _mm_sub_ps(_mm_loadu_ps(vy + c + pitch), _mm_loadu_ps(vy + c - pitch));
+	return _mm_mul_ps(_mm_add_ps(dx, dy), inv_cell_dist);
+}
+
+static float DivergenceRowSSE2(const float* vx, const float* vy, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 d_lo = DivergenceSSE2(vx, vy, c, pitch, inv4);
+		__m128 d_hi = DivergenceSSE2(vx, vy, c + 4, pitch, inv4);
+
+		_mm_storeu_ps(divergence + c, d_lo);
+		_mm_storeu_ps(divergence + c + 4, d_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, d_lo);
+		lanes_hi = _mm_add_ps(lanes_hi, d_hi);
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = DivergenceCell(vx, vy, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static inline __m128 PressureSSE2(const float* p, const float* divergence, int c, int pitch, __m128 h2)
+{
+	__m128 sum = _mm_add_ps(_mm_loadu_ps(p + c + pitch), _mm_loadu_ps(p + c - pitch));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c - 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c + 1));
+	sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(divergence + c), h2));
+	return _mm_mul_ps(sum, _mm_set1_ps(0.25f));
+}
+
+static float PressureRowSSE2(const float* p, const float* divergence, float* p_out,
+							 int begin, int end, int pitch, float h2, float inv_h2)
+{
+	__m128 h2_4 = _mm_set1_ps(h2);
+	__m128 inv_h2_4 = _mm_set1_ps(inv_h2);
+	__m128 four = _mm_set1_ps(4.0f);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 new_lo = PressureSSE2(p, divergence, c, pitch, h2_4);
+		__m128 new_hi = PressureSSE2(p, divergence, c + 4, pitch, h2_4);
+		__m128 r_lo = _mm_mul_ps(_mm_mul_ps(four, _mm_sub_ps(_mm_loadu_ps(p + c), new_lo)), inv_h2_4);
+		__m128 r_hi = _mm_mul_ps(_mm_mul_ps(four, _mm_sub_ps(_mm_loadu_ps(p + c + 4), new_hi)), inv_h2_4);
+
+		_mm_storeu_ps(p_out + c, new_lo);
+		_mm_storeu_ps(p_out + c + 4, new_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = PressureCell(p, divergence, c, pitch, h2);
+		float r = 4.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+//moves the even lanes of v + i 'omega' of the way to their jacobi values and writes the odd ones
+//back as they were. returns the even lanes' steps, with 0 in the odd lanes.
+//
+//SOR_LOOKAHEAD: the rows work out the jacobi values of the next 8 cells before storing the last 8.
+//the next 8's left neighbours overlap that store, and loading them straight after it stalls until
+//the store is done. the cells the even lanes read are never the ones written, so it's safe
+static inline __m128 RelaxEvenSSE2(float* v, int i, __m128 jacobi, __m128 omega)
+{
+	const __m128 even = _mm_castsi128_ps(_mm_set_epi32(0, -1, 0, -1));
+
+	__m128 old = _mm_loadu_ps(v + i);
+	__m128 step = _mm_and_ps(_mm_sub_ps(jacobi, old), even);
+	__m128 relaxed = _mm_add_ps(old, _mm_mul_ps(omega, step));
+
+	_mm_storeu_ps(v + i, _mm_or_ps(_mm_and_ps(even, relaxed), _mm_andnot_ps(even, old)));
+	return step;
+}
+
+static float DiffuseSORRowSSE2(float* v, const float* source, int begin, int end, int pitch,
+							   float inv_vdt, float denom, float residual_scale, float omega)
+{
+	__m128 inv_vdt4 = _mm_set1_ps(inv_vdt);
+	__m128 denom4 = _mm_set1_ps(denom);
+	__m128 scale4 = _mm_set1_ps(residual_scale);
+	__m128 omega4 = _mm_set1_ps(omega);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	__m128 diffused_lo = _mm_setzero_ps();
+	__m128 diffused_hi = _mm_setzero_ps();
+	int i = begin;
+
+	if (i + 8 <= end)
+	{
+		diffused_lo = DiffuseSSE2(v, source, i, pitch, inv_vdt4, denom4);
+		diffused_hi = DiffuseSSE2(v, source, i + 4, pitch, inv_vdt4, denom4);
+	}
+
+	//the next 8 cells are worked out before these are stored, see SOR_LOOKAHEAD
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128 next_lo = diffused_lo;
+		__m128 next_hi = diffused_hi;
+		if (i + 16 <= end)
+		{
+			next_lo = DiffuseSSE2(v, source, i + 8, pitch, inv_vdt4, denom4);
+			next_hi = DiffuseSSE2(v, source, i + 12, pitch, inv_vdt4, denom4);
+		}
+
+		__m128 r_lo = _mm_mul_ps(RelaxEvenSSE2(v, i, diffused_lo, omega4), scale4);
+		__m128 r_hi = _mm_mul_ps(RelaxEvenSSE2(v, i + 4, diffused_hi, omega4), scale4);
+
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+		diffused_lo = next_lo;
+		diffused_hi = next_hi;
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; i += 2)
+	{
+		float r = DiffuseSORCell(v, source, i, pitch, inv_vdt, denom, omega) * residual_scale;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static float PressureSORRowSSE2(float* p, const float* divergence, int begin, int end, int pitch,
+								float h2, float inv_h2, float omega)
+{
+	__m128 h2_4 = _mm_set1_ps(h2);
+	__m128 inv_h2_4 = _mm_set1_ps(inv_h2);
+	__m128 four = _mm_set1_ps(4.0f);
+	__m128 omega4 = _mm_set1_ps(omega);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	__m128 new_lo = _mm_setzero_ps();
+	__m128 new_hi = _mm_setzero_ps();
+	int c = begin;
+
+	if (c + 8 <= end)
+	{
+		new_lo = PressureSSE2(p, divergence, c, pitch, h2_4);
+		new_hi = PressureSSE2(p, divergence, c + 4, pitch, h2_4);
+	}
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 next_lo = new_lo;
+		__m128 next_hi = new_hi;
+		if (c + 16 <= end)
+		{
+			next_lo = PressureSSE2(p, divergence, c + 8, pitch, h2_4);
+			next_hi = PressureSSE2(p, divergence, c + 12, pitch, h2_4);
+		}
+
+		__m128 r_lo = _mm_mul_ps(_mm_mul_ps(four, RelaxEvenSSE2(p, c, new_lo, omega4)), inv_h2_4);
+		__m128 r_hi = _mm_mul_ps(_mm_mul_ps(four, RelaxEvenSSE2(p, c + 4, new_hi, omega4)), inv_h2_4);
+
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+		new_lo = next_lo;
+		new_hi = next_hi;
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; c += 2)
+	{
+		float r = 4.0f * PressureSORCell(p, divergence, c, pitch, h2, omega) * inv_h2;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static void ApplyPressureRowSSE2(const float* p, const float* vx, const float* vy, float* vx_out, float* vy_out,
+								 int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 4 <= end; c += 4)
+	{
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c - 1), _mm_loadu_ps(p + c + 1)), inv4);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c - pitch), _mm_loadu_ps(p + c + pitch)), inv4);
+
+		_mm_storeu_ps(vx_out + c, _mm_add_ps(_mm_loadu_ps(vx + c), gx));
+		_mm_storeu_ps(vy_out + c, _mm_add_ps(_mm_loadu_ps(vy + c), gy));
+	}
+
+	for (; c < end; ++c)
+	{
+		ApplyPressureCell(p, vx, vy, vx_out, vy_out, c, pitch, inv_cell_dist);
+	}
+}
+
+static inline __m128 StaggeredDivergenceSSE2(const float* u, const float* v, int c, int pitch, __m128 inv_cell_dist)
+{
+	__m128 dx = _mm_sub_ps(_mm_loadu_ps(u + c + 1), _mm_loadu_ps(u + c));
+	__m128 dy = _mm_sub_ps(_mm_loadu_ps(v + c + pitch), _mm_loadu_ps(v + c));
+	return _mm_mul_ps(_mm_add_ps(dx, dy), inv_cell_dist);
+}
+
+static float StaggeredDivergenceRowSSE2(const float* u, const float* v, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 d_lo = StaggeredDivergenceSSE2(u, v, c, pitch, inv4);
+		__m128 d_hi = StaggeredDivergenceSSE2(u, v, c + 4, pitch, inv4);
+
+		_mm_storeu_ps(divergence + c, d_lo);
+		_mm_storeu_ps(divergence + c + 4, d_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, d_lo);
+		lanes_hi = _mm_add_ps(lanes_hi, d_hi);
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = StaggeredDivergenceCell(u, v, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static void SubtractGradientRowSSE2(const float* p, const float* vel, float* vel_out, int begin, int end, int offset, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 4 <= end; c += 4)
+	{
+		__m128 gradient = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c), _mm_loadu_ps(p + c - offset)), inv4);
+		_mm_storeu_ps(vel_out + c, _mm_sub_ps(_mm_loadu_ps(vel + c), gradient));
+	}
+
+	for (; c < end; ++c)
+	{
+		SubtractGradientCell(p, vel, vel_out, c, offset, inv_cell_dist);
+	}
+}
+
+static inline __m128 Diffuse3DSSE2(const float* v, const float* source, int i, int pitch, int slice, __m128 inv_vdt, __m128 denom)
+{
+	__m128 sum = _mm_add_ps(_mm_loadu_ps(v + i + pitch), _mm_loadu_ps(v + i + 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i - pitch));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i - 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i + slice));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(v + i - slice));
+	sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + i), inv_vdt));
+	return _mm_mul_ps(sum, denom);
+}
+
+static float Diffuse3DRowSSE2(const float* v, const float* source, float* v_out,
+							  int begin, int end, int pitch, int slice,
+							  float inv_vdt, float denom, float residual_scale)
+{
+	__m128 inv_vdt4 = _mm_set1_ps(inv_vdt);
+	__m128 denom4 = _mm_set1_ps(denom);
+	__m128 scale4 = _mm_set1_ps(residual_scale);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m128 diffused_lo = Diffuse3DSSE2(v, source, i, pitch, slice, inv_vdt4, denom4);
+		__m128 diffused_hi = Diffuse3DSSE2(v, source, i + 4, pitch, slice, inv_vdt4, denom4);
+		__m128 r_lo = _mm_mul_ps(_mm_sub_ps(diffused_lo, _mm_loadu_ps(v + i)), scale4);
+		__m128 r_hi = _mm_mul_ps(_mm_sub_ps(diffused_hi, _mm_loadu_ps(v + i + 4)), scale4);
+
+		_mm_storeu_ps(v_out + i, diffused_lo);
+		_mm_storeu_ps(v_out + i + 4, diffused_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = Diffuse3DCell(v, source, i, pitch, slice, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static inline __m128 Divergence3DSSE2(const float* vx, const float* vy, const float* vz, int c, int pitch, int slice, __m128 inv_cell_dist)
+{
+	__m128 dx = _mm_sub_ps(_mm_loadu_ps(vx + c + 1), _mm_loadu_ps(vx + c - 1));
+	__m128 dy = _mm_sub_ps(_mm_loadu_ps(vy + c + pitch), _mm_loadu_ps(vy + c - pitch));
+	__m128 dz = _mm_sub_ps(_mm_loadu_ps(vz + c + slice), _mm_loadu_ps(vz + c - slice));
+	return _mm_mul_ps(_mm_add_ps(_mm_add_ps(dx, dy), dz), inv_cell_dist);
+}
+
+static float Divergence3DRowSSE2(const float* vx, const float* vy, const float* vz, float* divergence,
+								 int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 d_lo = Divergence3DSSE2(vx, vy, vz, c, pitch, slice, inv4);
+		__m128 d_hi = Divergence3DSSE2(vx, vy, vz, c + 4, pitch, slice, inv4);
+
+		_mm_storeu_ps(divergence + c, d_lo);
+		_mm_storeu_ps(divergence + c + 4, d_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, d_lo);
+		lanes_hi = _mm_add_ps(lanes_hi, d_hi);
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = Divergence3DCell(vx, vy, vz, c, pitch, slice, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static inline __m128 Pressure3DSSE2(const float* p, const float* divergence, int c, int pitch, int slice, __m128 h2)
+{
+	__m128 sum = _mm_add_ps(_mm_loadu_ps(p + c + pitch), _mm_loadu_ps(p + c - pitch));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c - 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c + 1));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c + slice));
+	sum = _mm_add_ps(sum, _mm_loadu_ps(p + c - slice));
+	sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_loadu_ps(divergence + c), h2));
+	return _mm_mul_ps(sum, _mm_set1_ps(1.0f / 6.0f));
+}
+
+static float Pressure3DRowSSE2(const float* p, const float* divergence, float* p_out,
+							   int begin, int end, int pitch, int slice, float h2, float inv_h2)
+{
+	__m128 h2_4 = _mm_set1_ps(h2);
+	__m128 inv_h2_4 = _mm_set1_ps(inv_h2);
+	__m128 six = _mm_set1_ps(6.0f);
+	__m128 lanes_lo = _mm_setzero_ps();
+	__m128 lanes_hi = _mm_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m128 new_lo = Pressure3DSSE2(p, divergence, c, pitch, slice, h2_4);
+		__m128 new_hi = Pressure3DSSE2(p, divergence, c + 4, pitch, slice, h2_4);
+		__m128 r_lo = _mm_mul_ps(_mm_mul_ps(six, _mm_sub_ps(_mm_loadu_ps(p + c), new_lo)), inv_h2_4);
+		__m128 r_hi = _mm_mul_ps(_mm_mul_ps(six, _mm_sub_ps(_mm_loadu_ps(p + c + 4), new_hi)), inv_h2_4);
+
+		_mm_storeu_ps(p_out + c, new_lo);
+		_mm_storeu_ps(p_out + c + 4, new_hi);
+		lanes_lo = _mm_add_ps(lanes_lo, _mm_mul_ps(r_lo, r_lo));
+		lanes_hi = _mm_add_ps(lanes_hi, _mm_mul_ps(r_hi, r_hi));
+	}
+
+	float lanes[8];
+	_mm_storeu_ps(lanes, lanes_lo);
+	_mm_storeu_ps(lanes + 4, lanes_hi);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = Pressure3DCell(p, divergence, c, pitch, slice, h2);
+		float r = 6.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static void ApplyPressure3DRowSSE2(const float* p, const float* vx, const float* vy, const float* vz,
+								   float* vx_out, float* vy_out, float* vz_out,
+								   int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	__m128 inv4 = _mm_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 4 <= end; c += 4)
+	{
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c - 1), _mm_loadu_ps(p + c + 1)), inv4);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c - pitch), _mm_loadu_ps(p + c + pitch)), inv4);
+		__m128 gz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + c - slice), _mm_loadu_ps(p + c + slice)), inv4);
+
+		_mm_storeu_ps(vx_out + c, _mm_add_ps(_mm_loadu_ps(vx + c), gx));
+		_mm_storeu_ps(vy_out + c, _mm_add_ps(_mm_loadu_ps(vy + c), gy));
+		_mm_storeu_ps(vz_out + c, _mm_add_ps(_mm_loadu_ps(vz + c), gz));
+	}
+
+	for (; c < end; ++c)
+	{
+		ApplyPressure3DCell(p, vx, vy, vz, vx_out, vy_out, vz_out, c, pitch, slice, inv_cell_dist);
+	}
+}
+
+//16 dye values clamped and truncated to bytes. the packs saturate too, but the clamp has to come
+//first since the float to int conversion doesn't
+static inline __m128i DyeBytesSSE2(const float* channel)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 max = _mm_set1_ps(255.0f);
+
+	__m128i i0 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(channel + 0), zero), max));
+	__m128i i1 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(channel + 4), zero), max));
+	__m128i i2 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(channel + 8), zero), max));
+	__m128i i3 = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(channel + 12), zero), max));
+
+	return _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3));
+}
+
+//interleave 16 bytes of each channel into 16 RGBA8 pixels, written as four whole 16 byte stores
+//so a write combined upload buffer gets full lines
+static inline void StoreRGBA8SSE2(__m128i r8, __m128i g8, __m128i b8, unsigned char* rgba)
+{
+	__m128i a8 = _mm_set1_epi8((char)0xff);
+
+	__m128i rg_lo = _mm_unpacklo_epi8(r8, g8);
+	__m128i rg_hi = _mm_unpackhi_epi8(r8, g8);
+	__m128i ba_lo = _mm_unpacklo_epi8(b8, a8);
+	__m128i ba_hi = _mm_unpackhi_epi8(b8, a8);
+
+	_mm_storeu_si128((__m128i*)(rgba + 0), _mm_unpacklo_epi16(rg_lo, ba_lo));
+	_mm_storeu_si128((__m128i*)(rgba + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+	_mm_storeu_si128((__m128i*)(rgba + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+	_mm_storeu_si128((__m128i*)(rgba + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+}
+
+static void DyeToRGBA8RowSSE2(const float* r, const float* g, const float* b, unsigned char* rgba, int count)
+{
+	int c = 0;
+
+	for (; c + 16 <= count; c += 16)
+	{
+		StoreRGBA8SSE2(DyeBytesSSE2(r + c), DyeBytesSSE2(g + c), DyeBytesSSE2(b + c), rgba + c * 4);
+	}
+
+	DyeToRGBA8RowScalar(r + c, g + c, b + c, rgba + c * 4, count - c);
+}
+
+//max is exact, so unlike the sums the order the lanes are combined in makes no difference
+static float MaxAbsRowSSE2(const float* v, int count)
+{
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 m0 = _mm_setzero_ps();
+	__m128 m1 = _mm_setzero_ps();
+
+	int c = 0;
+	for (; c + 8 <= count; c += 8)
+	{
+		m0 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(v + c), abs_mask), m0);
+		m1 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(v + c + 4), abs_mask), m1);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_max_ps(m0, m1));
+
+	float m = MaxAbsRowScalar(v + c, count - c);
+	for (int l = 0; l < 4; ++l)
+	{
+		m = lanes[l] > m ? lanes[l] : m;
+	}
+	return m;
+}
+
+//avx2
+
+static inline FLUID_TARGET_AVX2 __m256 DiffuseAVX2(const float* v, const float* source, int i, int pitch, __m256 inv_vdt, __m256 denom)
+{
+	__m256 sum = _mm256_add_ps(_mm256_loadu_ps(v + i + pitch), _mm256_loadu_ps(v + i + 1));
+	sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i - pitch));
+	sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i - 1));
+	sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(source + i), inv_vdt));
+	return _mm256_mul_ps(sum, denom);
+}
+
+static FLUID_TARGET_AVX2 float DiffuseRowAVX2(const float* v, const float* source, float* v_out,
+											  int begin, int end, int pitch,
+											  float inv_vdt, float denom, float residual_scale)
+{
+	__m256 inv_vdt8 = _mm256_set1_ps(inv_vdt);
+	__m256 denom8 = _mm256_set1_ps(denom);
+	__m256 scale8 = _mm256_set1_ps(residual_scale);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 diffused = DiffuseAVX2(v, source, i, pitch, inv_vdt8, denom8);
+		__m256 r = _mm256_mul_ps(_mm256_sub_ps(diffused, _mm256_loadu_ps(v + i)), scale8);
+
+		_mm256_storeu_ps(v_out + i, diffused);
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = DiffuseCell(v, source, i, pitch, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static FLUID_TARGET_AVX2 float DivergenceRowAVX2(const float* vx, const float* vy, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(vx + c + 1), _mm256_loadu_ps(vx + c - 1));
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(vy + c + pitch), _mm256_loadu_ps(vy + c - pitch));
+		__m256 d = _mm256_mul_ps(_mm256_add_ps(dx, dy), inv8);
+
+		_mm256_storeu_ps(divergence + c, d);
+		lanes8 = _mm256_add_ps(lanes8, d);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = DivergenceCell(vx, vy, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static FLUID_TARGET_AVX2 float PressureRowAVX2(const float* p, const float* divergence, float* p_out,
+											   int begin, int end, int pitch, float h2, float inv_h2)
+{
+	__m256 h2_8 = _mm256_set1_ps(h2);
+	__m256 inv_h2_8 = _mm256_set1_ps(inv_h2);
+	__m256 quarter = _mm256_set1_ps(0.25f);
+	__m256 four = _mm256_set1_ps(4.0f);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(p + c + pitch), _mm256_loadu_ps(p + c - pitch));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c - 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c + 1));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(divergence + c), h2_8));
+
+		__m256 new_pressure = _mm256_mul_ps(sum, quarter);
+		__m256 r = _mm256_mul_ps(_mm256_mul_ps(four, _mm256_sub_ps(_mm256_loadu_ps(p + c), new_pressure)), inv_h2_8);
+
+		_mm256_storeu_ps(p_out + c, new_pressure);
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = PressureCell(p, divergence, c, pitch, h2);
+		float r = 4.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static inline FLUID_TARGET_AVX2 __m256 PressureAVX2(const float* p, const float* divergence, int c, int pitch, __m256 h2, __m256 quarter)
+{
+	__m256 sum = _mm256_add_ps(_mm256_loadu_ps(p + c + pitch), _mm256_loadu_ps(p + c - pitch));
+	sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c - 1));
+	sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c + 1));
+	sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(divergence + c), h2));
+	return _mm256_mul_ps(sum, quarter);
+}
+
+static inline FLUID_TARGET_AVX2 __m256 RelaxEvenAVX2(float* v, int i, __m256 jacobi, __m256 omega)
+{
+	const __m256 even = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1));
+
+	__m256 old = _mm256_loadu_ps(v + i);
+	__m256 step = _mm256_and_ps(_mm256_sub_ps(jacobi, old), even);
+	__m256 relaxed = _mm256_add_ps(old, _mm256_mul_ps(omega, step));
+
+	_mm256_storeu_ps(v + i, _mm256_blendv_ps(old, relaxed, even));
+	return step;
+}
+
+static FLUID_TARGET_AVX2 float DiffuseSORRowAVX2(float* v, const float* source, int begin, int end, int pitch,
+												 float inv_vdt, float denom, float residual_scale, float omega)
+{
+	__m256 inv_vdt8 = _mm256_set1_ps(inv_vdt);
+	__m256 denom8 = _mm256_set1_ps(denom);
+	__m256 scale8 = _mm256_set1_ps(residual_scale);
+	__m256 omega8 = _mm256_set1_ps(omega);
+	__m256 lanes8 = _mm256_setzero_ps();
+	__m256 diffused = _mm256_setzero_ps();
+	int i = begin;
+
+	if (i + 8 <= end)
+	{
+		diffused = DiffuseAVX2(v, source, i, pitch, inv_vdt8, denom8);
+	}
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 next = diffused;
+		if (i + 16 <= end)
+		{
+			next = DiffuseAVX2(v, source, i + 8, pitch, inv_vdt8, denom8);
+		}
+
+		__m256 r = _mm256_mul_ps(RelaxEvenAVX2(v, i, diffused, omega8), scale8);
+
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+		diffused = next;
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; i += 2)
+	{
+		float r = DiffuseSORCell(v, source, i, pitch, inv_vdt, denom, omega) * residual_scale;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static FLUID_TARGET_AVX2 float PressureSORRowAVX2(float* p, const float* divergence, int begin, int end, int pitch,
+												  float h2, float inv_h2, float omega)
+{
+	__m256 h2_8 = _mm256_set1_ps(h2);
+	__m256 inv_h2_8 = _mm256_set1_ps(inv_h2);
+	__m256 quarter = _mm256_set1_ps(0.25f);
+	__m256 four = _mm256_set1_ps(4.0f);
+	__m256 omega8 = _mm256_set1_ps(omega);
+	__m256 lanes8 = _mm256_setzero_ps();
+	__m256 new_pressure = _mm256_setzero_ps();
+	int c = begin;
+
+	if (c + 8 <= end)
+	{
+		new_pressure = PressureAVX2(p, divergence, c, pitch, h2_8, quarter);
+	}
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 next = new_pressure;
+		if (c + 16 <= end)
+		{
+			next = PressureAVX2(p, divergence, c + 8, pitch, h2_8, quarter);
+		}
+
+		__m256 r = _mm256_mul_ps(_mm256_mul_ps(four, RelaxEvenAVX2(p, c, new_pressure, omega8)), inv_h2_8);
+
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+		new_pressure = next;
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; c += 2)
+	{
+		float r = 4.0f * PressureSORCell(p, divergence, c, pitch, h2, omega) * inv_h2;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static FLUID_TARGET_AVX2 void ApplyPressureRowAVX2(const float* p, const float* vx, const float* vy, float* vx_out, float* vy_out,
+												   int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 gx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c - 1), _mm256_loadu_ps(p + c + 1)), inv8);
+		__m256 gy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c - pitch), _mm256_loadu_ps(p + c + pitch)), inv8);
+
+		_mm256_storeu_ps(vx_out + c, _mm256_add_ps(_mm256_loadu_ps(vx + c), gx));
+		_mm256_storeu_ps(vy_out + c, _mm256_add_ps(_mm256_loadu_ps(vy + c), gy));
+	}
+
+	for (; c < end; ++c)
+	{
+		ApplyPressureCell(p, vx, vy, vx_out, vy_out, c, pitch, inv_cell_dist);
+	}
+}
+
+static FLUID_TARGET_AVX2 float StaggeredDivergenceRowAVX2(const float* u, const float* v, float* divergence, int begin, int end, int pitch, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(u + c + 1), _mm256_loadu_ps(u + c));
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(v + c + pitch), _mm256_loadu_ps(v + c));
+		__m256 d = _mm256_mul_ps(_mm256_add_ps(dx, dy), inv8);
+
+		_mm256_storeu_ps(divergence + c, d);
+		lanes8 = _mm256_add_ps(lanes8, d);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = StaggeredDivergenceCell(u, v, c, pitch, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static FLUID_TARGET_AVX2 void SubtractGradientRowAVX2(const float* p, const float* vel, float* vel_out, int begin, int end, int offset, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 gradient = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c), _mm256_loadu_ps(p + c - offset)), inv8);
+		_mm256_storeu_ps(vel_out + c, _mm256_sub_ps(_mm256_loadu_ps(vel + c), gradient));
+	}
+
+	for (; c < end; ++c)
+	{
+		SubtractGradientCell(p, vel, vel_out, c, offset, inv_cell_dist);
+	}
+}
+
+static FLUID_TARGET_AVX2 float Diffuse3DRowAVX2(const float* v, const float* source, float* v_out,
+												int begin, int end, int pitch, int slice,
+												float inv_vdt, float denom, float residual_scale)
+{
+	__m256 inv_vdt8 = _mm256_set1_ps(inv_vdt);
+	__m256 denom8 = _mm256_set1_ps(denom);
+	__m256 scale8 = _mm256_set1_ps(residual_scale);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(v + i + pitch), _mm256_loadu_ps(v + i + 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i - pitch));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i - 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i + slice));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(v + i - slice));
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(source + i), inv_vdt8));
+
+		__m256 diffused = _mm256_mul_ps(sum, denom8);
+		__m256 r = _mm256_mul_ps(_mm256_sub_ps(diffused, _mm256_loadu_ps(v + i)), scale8);
+
+		_mm256_storeu_ps(v_out + i, diffused);
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; i < end; ++i)
+	{
+		float diffused = Diffuse3DCell(v, source, i, pitch, slice, inv_vdt, denom);
+		float r = (diffused - v[i]) * residual_scale;
+
+		v_out[i] = diffused;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static FLUID_TARGET_AVX2 float Divergence3DRowAVX2(const float* vx, const float* vy, const float* vz, float* divergence,
+												   int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(vx + c + 1), _mm256_loadu_ps(vx + c - 1));
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(vy + c + pitch), _mm256_loadu_ps(vy + c - pitch));
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(vz + c + slice), _mm256_loadu_ps(vz + c - slice));
+		__m256 d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(dx, dy), dz), inv8);
+
+		_mm256_storeu_ps(divergence + c, d);
+		lanes8 = _mm256_add_ps(lanes8, d);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float d = Divergence3DCell(vx, vy, vz, c, pitch, slice, inv_cell_dist);
+
+		divergence[c] = d;
+		sum += d;
+	}
+	return sum;
+}
+
+static FLUID_TARGET_AVX2 float Pressure3DRowAVX2(const float* p, const float* divergence, float* p_out,
+												 int begin, int end, int pitch, int slice, float h2, float inv_h2)
+{
+	__m256 h2_8 = _mm256_set1_ps(h2);
+	__m256 inv_h2_8 = _mm256_set1_ps(inv_h2);
+	__m256 sixth = _mm256_set1_ps(1.0f / 6.0f);
+	__m256 six = _mm256_set1_ps(6.0f);
+	__m256 lanes8 = _mm256_setzero_ps();
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(p + c + pitch), _mm256_loadu_ps(p + c - pitch));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c - 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c + 1));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c + slice));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(p + c - slice));
+		sum = _mm256_sub_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(divergence + c), h2_8));
+
+		__m256 new_pressure = _mm256_mul_ps(sum, sixth);
+		__m256 r = _mm256_mul_ps(_mm256_mul_ps(six, _mm256_sub_ps(_mm256_loadu_ps(p + c), new_pressure)), inv_h2_8);
+
+		_mm256_storeu_ps(p_out + c, new_pressure);
+		lanes8 = _mm256_add_ps(lanes8, _mm256_mul_ps(r, r));
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, lanes8);
+
+	float sum_sq = SumLanes(lanes);
+	for (; c < end; ++c)
+	{
+		float new_pressure = Pressure3DCell(p, divergence, c, pitch, slice, h2);
+		float r = 6.0f * (p[c] - new_pressure) * inv_h2;
+
+		p_out[c] = new_pressure;
+		sum_sq += r * r;
+	}
+	return sum_sq;
+}
+
+static FLUID_TARGET_AVX2 void ApplyPressure3DRowAVX2(const float* p, const float* vx, const float* vy, const float* vz,
+													 float* vx_out, float* vy_out, float* vz_out,
+													 int begin, int end, int pitch, int slice, float inv_cell_dist)
+{
+	__m256 inv8 = _mm256_set1_ps(inv_cell_dist);
+	int c = begin;
+
+	for (; c + 8 <= end; c += 8)
+	{
+		__m256 gx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c - 1), _mm256_loadu_ps(p + c + 1)), inv8);
+		__m256 gy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c - pitch), _mm256_loadu_ps(p + c + pitch)), inv8);
+		__m256 gz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(p + c - slice), _mm256_loadu_ps(p + c + slice)), inv8);
+
+		_mm256_storeu_ps(vx_out + c, _mm256_add_ps(_mm256_loadu_ps(vx + c), gx));
+		_mm256_storeu_ps(vy_out + c, _mm256_add_ps(_mm256_loadu_ps(vy + c), gy));
+		_mm256_storeu_ps(vz_out + c, _mm256_add_ps(_mm256_loadu_ps(vz + c), gz));
+	}
+
+	for (; c < end; ++c)
+	{
+		ApplyPressure3DCell(p, vx, vy, vz, vx_out, vy_out, vz_out, c, pitch, slice, inv_cell_dist);
+	}
+}
+
+static inline FLUID_TARGET_AVX2 __m128i DyeBytesAVX2(const float* channel)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 max = _mm256_set1_ps(255.0f);
+
+	__m256i i0 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(channel + 0), zero), max));
+	__m256i i1 = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(channel + 8), zero), max));
+
+	//the 256 bit pack works within each 128 bit half, put the words back in order before the last pack
+	__m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(i0, i1), 0xd8);
+
+	return _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+}
+
+static FLUID_TARGET_AVX2 void DyeToRGBA8RowAVX2(const float* r, const float* g, const float* b, unsigned char* rgba, int count)
+{
+	int c = 0;
+
+	for (; c + 16 <= count; c += 16)
+	{
+		StoreRGBA8SSE2(DyeBytesAVX2(r + c), DyeBytesAVX2(g + c), DyeBytesAVX2(b + c), rgba + c * 4);
+	}
+
+	DyeToRGBA8RowScalar(r + c, g + c, b + c, rgba + c * 4, count - c);
+}
+
+static FLUID_TARGET_AVX2 void FloatToHalfRowAVX2(const float* in, unsigned short* out, int count)
+{
+	int c = 0;
+
+	for (; c + 8 <= count; c += 8)
+	{
+		_mm_storeu_si128((__m128i*)(out + c), _mm256_cvtps_ph(_mm256_loadu_ps(in + c), _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	FloatToHalfRowScalar(in + c, out + c, count - c);
+}
+
+static FLUID_TARGET_AVX2 void HalfToFloatRowAVX2(const unsigned short* in, float* out, int count)
+{
+	int c = 0;
+
+	for (; c + 8 <= count; c += 8)
+	{
+		_mm256_storeu_ps(out + c, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + c))));
+	}
+
+	HalfToFloatRowScalar(in + c, out + c, count - c);
+}
+
+static FLUID_TARGET_AVX2 float MaxAbsRowAVX2(const float* v, int count)
+{
+	__m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 m0 = _mm256_setzero_ps();
+	__m256 m1 = _mm256_setzero_ps();
+
+	int c = 0;
+	for (; c + 16 <= count; c += 16)
+	{
+		m0 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(v + c), abs_mask), m0);
+		m1 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(v + c + 8), abs_mask), m1);
+	}
+
+	float lanes[8];
+	_mm256_storeu_ps(lanes, _mm256_max_ps(m0, m1));
+
+	float m = MaxAbsRowScalar(v + c, count - c);
+	for (int l = 0; l < 8; ++l)
+	{
+		m = lanes[l] > m ? lanes[l] : m;
+	}
+	return m;
+}
+
+#endif
+
+static const FluidKernels fluid_kernel_sets[] =
+{
+	{ SIMD_SCALAR, "scalar", DiffuseRowScalar, DivergenceRowScalar, PressureRowScalar, ApplyPressureRowScalar,
+	  DiffuseSORRowScalar, PressureSORRowScalar,
+	  StaggeredDivergenceRowScalar, SubtractGradientRowScalar, DyeToRGBA8RowScalar,
+	  Diffuse3DRowScalar, Divergence3DRowScalar, Pressure3DRowScalar, ApplyPressure3DRowScalar,
+	  FloatToHalfRowScalar, HalfToFloatRowScalar, MaxAbsRowScalar },
+#ifdef FLUID_KERNELS_X86
+	{ SIMD_SSE2, "sse2", DiffuseRowSSE2, DivergenceRowSSE2, PressureRowSSE2, ApplyPressureRowSSE2,
+	  DiffuseSORRowSSE2, PressureSORRowSSE2,
+	  StaggeredDivergenceRowSSE2, SubtractGradientRowSSE2, DyeToRGBA8RowSSE2,
+	  Diffuse3DRowSSE2, Divergence3DRowSSE2, Pressure3DRowSSE2, ApplyPressure3DRowSSE2,
+	  FloatToHalfRowScalar, HalfToFloatRowScalar, MaxAbsRowSSE2 },
+	{ SIMD_AVX2, "avx2", DiffuseRowAVX2, DivergenceRowAVX2, PressureRowAVX2, ApplyPressureRowAVX2,
+	  DiffuseSORRowAVX2, PressureSORRowAVX2,
+	  StaggeredDivergenceRowAVX2, SubtractGradientRowAVX2, DyeToRGBA8RowAVX2,
+	  Diffuse3DRowAVX2, Divergence3DRowAVX2, Pressure3DRowAVX2, ApplyPressure3DRowAVX2,
+	  FloatToHalfRowAVX2, HalfToFloatRowAVX2, MaxAbsRowAVX2 },
+#endif
+};
+
+const FluidKernels* SelectFluidKernels()
+{
+	return fluid_kernel_sets + SupportedSimdLevel();
+}
+
+const FluidKernels* GetFluidKernels(FluidSimd simd)
+{
+	const FluidKernels* best = SelectFluidKernels();
+
+	if (simd > best->simd)
+	{
+		return best;
+	}
+	return fluid_kernel_sets + simd;
+}
+
+int FluidRowPitch(int width)
+{
+	return (width + FLUID_ROW_ALIGN - 1) / FLUID_ROW_ALIGN * FLUID_ROW_ALIGN;
+}
+
+//planes start on a cache line, rows within them on a simd boundary
+float* AllocFluidPlane(int pitch, int height)
+{
+	size_t bytes = sizeof(float) * pitch * height;
+	void* plane = 0;
+
+#ifdef _MSC_VER
+	plane = _aligned_malloc(bytes, 64);
+#else
+	if (posix_memalign(&plane, 64, bytes) != 0)
+	{
+		plane = 0;
+	}
+#endif
+
+	//the planes are the whole simulation, so there is nothing to fall back to
+	if (plane == 0)
+	{
+		printf("FAILED TO ALLOCATE A %d x %d FLUID PLANE\n", pitch, height);
+		abort();
+	}
+
+	memset(plane, 0, bytes);
+	return (float*)plane;
+}
+
+//halves are 2 bytes, so a float plane half as wide has the same rows
+unsigned short* AllocHalfPlane(int pitch, int height)
+{
+	return (unsigned short*)AllocFluidPlane((pitch + 1) / 2, height);
+}
+
+void FreeHalfPlane(unsigned short* plane)
+{
+	FreeFluidPlane((float*)plane);
+}
+
+void FreeFluidPlane(float* plane)
+{
+#ifdef _MSC_VER
+	_aligned_free(plane);
+#else
+	free(plane);
+#endif
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "SimdSupport.h"
+
+//vectorized row kernels for the DIYFluid stencil stages.
+//
+//each kernel covers one row of interior cells, ones whose 4 neighbours are all
+//inside the grid, so there is no clamping in them. DIYFluid runs the outer ring
+//of cells through its own clamped code. the 3d kernels are the same with 6 neighbours,
+//for DIYFluid3D.
+//
+//sums are kept in 8 lanes and added up lane 0 to 7 in every version, including
+//the scalar one, so all of them give bit-for-bit the same results
+
+//the kernel sets are the ones SimdSupport.h lists
+typedef SimdLevel FluidSimd;
+
+struct FluidKernels
+{
+	FluidSimd simd;
+	const char* name;
+
+	//jacobi sweep of the diffusion system for one velocity component over cells [begin, end),
+	//'pitch' floats between rows. returns the sum of squared residuals
+	float (*diffuse_row)(const float* v, const float* source, float* v_out,
+						 int begin, int end, int pitch,
+						 float inv_vdt, float denom, float residual_scale);
+
+	//central difference divergence for cells [begin, end). returns the sum of the divergence written
+	float (*divergence_row)(const float* vx, const float* vy, float* divergence,
+							int begin, int end, int pitch, float inv_cell_dist);
+
+	//jacobi sweep of the pressure equation over cells [begin, end).
+	//returns the sum of squared residuals
+	float (*pressure_row)(const float* p, const float* divergence, float* p_out,
+						  int begin, int end, int pitch, float h2, float inv_h2);
+
+	//subtract the pressure gradient from the velocities of cells [begin, end)
+	void (*apply_pressure_row)(const float* p, const float* vx, const float* vy, float* vx_out, float* vy_out,
+							   int begin, int end, int pitch, float inv_cell_dist);
+
+	//one colour of a red-black SOR sweep, in place. cells begin, begin + 2, ... before end are moved
+	//'omega' of the way past their jacobi value, the ones between are their neighbours and are left
+	//as they were. returns the sum of squared residuals of the cells relaxed
+	float (*diffuse_sor_row)(float* v, const float* source, int begin, int end, int pitch,
+							 float inv_vdt, float denom, float residual_scale, float omega);
+	float (*pressure_sor_row)(float* p, const float* divergence, int begin, int end, int pitch,
+							  float h2, float inv_h2, float omega);
+
+	//divergence of a staggered grid for cells [begin, end), from the u faces to the left and right of
+	//each cell and the v faces below and above it. returns the sum of the divergence written
+	float (*staggered_divergence_row)(const float* u, const float* v, float* divergence,
+									  int begin, int end, int pitch, float inv_cell_dist);
+
+	//subtract the pressure gradient across the faces [begin, end) of a staggered grid, between the
+	//cell each face belongs to and the one 'offset' floats before it, 1 for u and pitch for v
+	void (*subtract_gradient_row)(const float* p, const float* vel, float* vel_out,
+								  int begin, int end, int offset, float inv_cell_dist);
+
+	//convert 'count' cells of dye to RGBA8 pixels for upload, alpha 255. channels are clamped to
+	//[0, 255] and then truncated the way a cast would, nan comes out as 0
+	void (*dye_to_rgba8_row)(const float* r, const float* g, const float* b, unsigned char* rgba, int count);
+
+	//7 point versions of the first four for a 3d grid, 'slice' floats between z slices
+	float (*diffuse_row_3d)(const float* v, const float* source, float* v_out,
+							int begin, int end, int pitch, int slice,
+							float inv_vdt, float denom, float residual_scale);
+
+	float (*divergence_row_3d)(const float* vx, const float* vy, const float* vz, float* divergence,
+							   int begin, int end, int pitch, int slice, float inv_cell_dist);
+
+	float (*pressure_row_3d)(const float* p, const float* divergence, float* p_out,
+							 int begin, int end, int pitch, int slice, float h2, float inv_h2);
+
+	void (*apply_pressure_row_3d)(const float* p, const float* vx, const float* vy, const float* vz,
+								  float* vx_out, float* vy_out, float* vz_out,
+								  int begin, int end, int pitch, int slice, float inv_cell_dist);
+
+	//'count' floats to fp16 and back, rounding to nearest even. the avx2 set uses f16c, the others
+	//do it in integer code that comes out the same
+	void (*float_to_half_row)(const float* in, unsigned short* out, int count);
+	void (*half_to_float_row)(const unsigned short* in, float* out, int count);
+
+	//largest absolute value of 'count' floats, 0 if there are none. nans are skipped
+	float (*max_abs_row)(const float* v, int count);
+};
+
+//widest kernel set this cpu and os support
+const FluidKernels* SelectFluidKernels();
+
+//a specific kernel set, falls back to the widest supported one if simd isn't available
+const FluidKernels* GetFluidKernels(FluidSimd simd);
+
+//a zeroed plane of pitch * height floats, aligned so that every row starts on a simd
+//boundary when pitch is a multiple of FLUID_ROW_ALIGN. free it with FreeFluidPlane
+float* AllocFluidPlane(int pitch, int height);
+void FreeFluidPlane(float* plane);
+
+//the same for a plane of fp16 values, pitch * height of them. free it with FreeHalfPlane
+unsigned short* AllocHalfPlane(int pitch, int height);
+void FreeHalfPlane(unsigned short* plane);
+
+//row pitch for a plane 'width' cells wide, padded out to whole simd registers
+int FluidRowPitch(int width);
+
+static const int FLUID_ROW_ALIGN = 8;
@@ -0,0 +1,140 @@
+#include "FluidWorkers.h"
+
+FluidWorkers::FluidWorkers(int _thread_count)
+{
+	if (_thread_count <= 0)
+	{
+		_thread_count = (int)std::thread::hardware_concurrency();
+	}
+	if (_thread_count <= 0)
+	{
+		_thread_count = 1;
+	}
+	if (_thread_count > MAX_THREADS)
+	{
+		_thread_count = MAX_THREADS;
+	}
+
+	this->thread_count = _thread_count;
+	this->min_rows_per_band = 16;
+
+	this->job = nullptr;
+	this->job_rows = 0;
+	this->job_bands = 0;
+	this->bands_remaining = 0;
+	this->generation = 0;
+	this->shutting_down = false;
+
+	//band 0 belongs to whoever calls ParallelRows
+	for (int band = 1; band < this->thread_count; ++band)
+	{
+		this->threads.push_back(std::thread(&FluidWorkers::WorkerLoop, this, band));
+	}
+}
+
+FluidWorkers::~FluidWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->shutting_down = true;
+	}
+	this->start_condition.notify_all();
+
+	for (size_t i = 0; i < this->threads.size(); ++i)
+	{
+		this->threads[i].join();
+	}
+}
+
+int FluidWorkers::BandCount(int row_count)
+{
+	int bands = row_count / this->min_rows_per_band;
+
+	if (bands > this->thread_count)
+	{
+		bands = this->thread_count;
+	}
+	if (bands < 1)
+	{
+		bands = 1;
+	}
+
+	return bands;
+}
+
+void FluidWorkers::ParallelRows(int row_count, const std::function<void(int, int, int)>& _job)
+{
+	int bands = BandCount(row_count);
+
+	if (bands == 1)
+	{
+		_job(0, row_count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->job = &_job;
+		this->job_rows = row_count;
+		this->job_bands = bands;
+		this->bands_remaining = bands - 1;
+		this->generation++;
+	}
+	this->start_condition.notify_all();
+
+	_job(0, row_count / bands, 0);
+
+	std::unique_lock<std::mutex> lock(this->mutex);
+	while (this->bands_remaining > 0)
+	{
+		this->done_condition.wait(lock);
+	}
+	this->job = nullptr;
+}
+
+void FluidWorkers::WorkerLoop(int band)
+{
+	unsigned int seen_generation = 0;
+
+	for (;;)
+	{
+		const std::function<void(int, int, int)>* my_job;
+		int rows, bands;
+
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			while (!this->shutting_down && this->generation == seen_generation)
+			{
+				this->start_condition.wait(lock);
+			}
+
+			if (this->shutting_down)
+			{
+				return;
+			}
+
+			seen_generation = this->generation;
+			my_job = this->job;
+			rows = this->job_rows;
+			bands = this->job_bands;
+		}
+
+		//jobs with fewer bands than threads leave the extra threads idle
+		if (band >= bands)
+		{
+			continue;
+		}
+
+		int y_begin = rows * band / bands;
+		int y_end = rows * (band + 1) / bands;
+
+		(*my_job)(y_begin, y_end, band);
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->bands_remaining--;
+		if (this->bands_remaining == 0)
+		{
+			this->done_condition.notify_one();
+		}
+	}
+}
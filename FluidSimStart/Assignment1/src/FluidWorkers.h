@@ -0,0 +1,45 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+//persistent pool of threads that DIYFluid splits its stages across.
+//the calling thread always works on band 0, so a pool of 1 runs everything inline
+class FluidWorkers
+{
+public:
+	FluidWorkers(int _thread_count);
+	~FluidWorkers();
+
+	//split [0, row_count) into contiguous bands, one per thread, and run job(y_begin, y_end, band)
+	//on each of them. returns once every band has finished, so consecutive calls act as a barrier
+	void ParallelRows(int row_count, const std::function<void(int, int, int)>& job);
+
+	//how many bands ParallelRows will use for this many rows
+	int BandCount(int row_count);
+
+	static const int MAX_THREADS = 64;
+
+public:
+	int thread_count;
+	int min_rows_per_band;	//small grids aren't worth waking threads for
+
+private:
+	void WorkerLoop(int band);
+
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+
+	const std::function<void(int, int, int)>* job;
+	int job_rows;
+	int job_bands;
+	int bands_remaining;
+	unsigned int generation;
+	bool shutting_down;
+};
@@ -0,0 +1,85 @@
+#include "SimdSupport.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_SUPPORT_X86
+#endif
+
+#ifdef SIMD_SUPPORT_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+static void Cpuid(int leaf, int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, 0, a, b, c, d);
+	regs[0] = (int)a;
+	regs[1] = (int)b;
+	regs[2] = (int)c;
+	regs[3] = (int)d;
+#endif
+}
+
+//ymm registers are only usable if the os saves them on a context switch
+static bool OSSavesYMM()
+{
+#ifdef _MSC_VER
+	return (_xgetbv(0) & 6) == 6;
+#else
+	unsigned int lo, hi;
+	__asm__ volatile ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (lo & 6) == 6;
+#endif
+}
+
+static SimdLevel DetectSimdLevel()
+{
+	int regs[4];
+
+	Cpuid(0, regs);
+	int max_leaf = regs[0];
+
+	Cpuid(1, regs);
+	bool sse2 = (regs[3] & (1 << 26)) != 0;
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	bool f16c = (regs[2] & (1 << 29)) != 0;
+
+	bool avx2 = false;
+	if (max_leaf >= 7 && osxsave && avx && f16c && OSSavesYMM())
+	{
+		Cpuid(7, regs);
+		avx2 = (regs[1] & (1 << 5)) != 0;
+	}
+
+	if (avx2)
+	{
+		return SIMD_AVX2;
+	}
+	if (sse2)
+	{
+		return SIMD_SSE2;
+	}
+	return SIMD_SCALAR;
+}
+
+#else
+
+static SimdLevel DetectSimdLevel()
+{
+	return SIMD_SCALAR;
+}
+
+#endif
+
+SimdLevel SupportedSimdLevel()
+{
+	static const SimdLevel supported = DetectSimdLevel();
+	return supported;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+//the instruction sets the simd kernels come in, FluidKernels and DIYBodyKernels alike, widest last
+enum SimdLevel
+{
+	SIMD_SCALAR = 0,
+	SIMD_SSE2 = 1,
+	SIMD_AVX2 = 2,
+};
+
+//widest level this cpu and os support. avx2 is only reported alongside f16c, which every cpu
+//with avx2 has and the fluid's fp16 conversions use. cpuid is read once, on the first call
+SimdLevel SupportedSimdLevel();
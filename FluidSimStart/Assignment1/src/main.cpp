@@ -7,6 +7,7 @@
 #include "DIYPhysicsEngine.h"
 
 #include "DIYFluid.h"
+#include "FluidCoupling.h"
 
 void DIYPhysicsRocketSetup();
 void upDate2DPhysics(float delta);
@@ -16,7 +17,7 @@ void onUpdateRocket(float deltaTime);
 void SpringPhysicsTutorial();
 
 DIYPhysicScene* physicsScene;
-SphereClass* rocket;
+DIYBodyHandle rocket;
 GLFWwindow* window;
 
 int main()
@@ -61,6 +62,7 @@ int main()
 	float prevTime = 0;
 
 	DIYFluid fluid = DIYFluid(64,64,0.1f,0.1f);
+	FluidCoupling coupling = FluidCoupling(&fluid, physicsScene, DefaultFluidMapping(&fluid));
 
 	while (glfwWindowShouldClose(window) == false && glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
 	{
@@ -76,7 +78,11 @@ int main()
 
 		Gizmos::clear();
 		//upDate2DPhysics(deltaTime);
-		fluid.UpdateFluid(deltaTime);
+		coupling.Rasterize();
+		//the fluid runs fixed steps out of the frame time, the pressure it leaves is from the last substep.
+		//frames shorter than a step may not run any, and then there is no new pressure to apply
+		fluid.AdvanceFluid(deltaTime);
+		coupling.ApplyForces(fluid.step_dt, fluid.frame_steps);
 
 		int width = 0, height = 0;
 		glfwGetWindowSize(glfwGetCurrentContext(), &width, &height);
@@ -127,7 +133,8 @@ glm::vec2 GetWorldMouse()
 
 void upDate2DPhysics(float delta)
 {
-    BoxClass* box1 = (BoxClass*)physicsScene->actors[0];
+    BoxClass* box1 = (BoxClass*)physicsScene->bodies.objects[0];
+    DIYBodyHandle box1_handle = box1->handle;
 
     static glm::vec2 cm_to_anchor = glm::vec2();
     static bool grabbed = false;
@@ -138,9 +145,9 @@ void upDate2DPhysics(float delta)
         {
             if (box1->isPointOver(GetWorldMouse())) // added this check
             {
-                cm_to_anchor = GetWorldMouse() - box1->position;
-                float sin_theta = sinf(-box1->rotation2D);
-                float cos_theta = cosf(-box1->rotation2D);
+                cm_to_anchor = GetWorldMouse() - physicsScene->getPosition(box1_handle);
+                float sin_theta = sinf(-physicsScene->getRotation(box1_handle));
+                float cos_theta = cosf(-physicsScene->getRotation(box1_handle));
                 cm_to_anchor = glm::vec2(cos_theta * cm_to_anchor.x - sin_theta * cm_to_anchor.y,
                                          sin_theta * cm_to_anchor.x + cos_theta * cm_to_anchor.y);
                 grabbed = true;
@@ -149,15 +156,15 @@ void upDate2DPhysics(float delta)
         else //added the else
         {
             //compute the anchor point
-            float sin_theta = sinf(box1->rotation2D);
-            float cos_theta = cosf(box1->rotation2D);
+            float sin_theta = sinf(physicsScene->getRotation(box1_handle));
+            float cos_theta = cosf(physicsScene->getRotation(box1_handle));
             glm::vec2 rot_local_pos = glm::vec2(cos_theta * cm_to_anchor.x - sin_theta * cm_to_anchor.y,
                                                 sin_theta * cm_to_anchor.x + cos_theta * cm_to_anchor.y);
 
-            glm::vec2 anchor = box1->position + rot_local_pos;
+            glm::vec2 anchor = physicsScene->getPosition(box1_handle) + rot_local_pos;
 
             //add force at anchor point towards the mouse
-            box1->applyForceAtPoint(GetWorldMouse() - anchor, anchor);
+            physicsScene->applyForceAtPoint(box1_handle, GetWorldMouse() - anchor, anchor);
             Gizmos::add2DLine(anchor, GetWorldMouse(), glm::vec4(0, 1, 1, 1));
         }
     }
@@ -178,8 +185,7 @@ void DIYPhysicsRocketSetup()
 	physicsScene->collisionEnabled = false;
 	physicsScene->gravity = glm::vec2(0, -.2);
 	physicsScene->timeStep = .016f;
-	rocket = new SphereClass(glm::vec2(-40, 0), glm::vec2(0, 0), 6.0f, 5, glm::vec4(1, 0, 0, 1));
-	physicsScene->addActor(rocket);
+	rocket = physicsScene->addSphere(glm::vec2(-40, 0), glm::vec2(0, 0), 6.0f, 5, glm::vec4(1, 0, 0, 1));
 }
 
 void DIYPhysicsCollisionTutorial()
@@ -190,29 +196,22 @@ void DIYPhysicsCollisionTutorial()
     physicsScene->timeStep = .016f;
 	physicsScene->gravity = glm::vec2(0, -15);
     
-    SphereClass* sphere1 = new SphereClass(glm::vec2(20, 20), glm::vec2(0, 0), 6.0f, 2, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(sphere1);
-    sphere1->velocity = glm::vec2(10, 0);
+    DIYBodyHandle sphere1 = physicsScene->addSphere(glm::vec2(20, 20), glm::vec2(0, 0), 6.0f, 2, glm::vec4(1, 0, 0, 1));
+    physicsScene->setVelocity(sphere1, glm::vec2(10, 0));
    
-    SphereClass* sphere2 = new SphereClass(glm::vec2(-40, 20), glm::vec2(0, 0), 6.0f, 2, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(sphere2);
-    sphere2->velocity = glm::vec2(15, 0);
+    DIYBodyHandle sphere2 = physicsScene->addSphere(glm::vec2(-40, 20), glm::vec2(0, 0), 6.0f, 2, glm::vec4(1, 0, 0, 1));
+    physicsScene->setVelocity(sphere2, glm::vec2(15, 0));
 
-    SphereClass* sphere3 = new SphereClass(glm::vec2(-35, 10), glm::vec2(0, 0), 4.0f, 4, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(sphere3);
+    physicsScene->addSphere(glm::vec2(-35, 10), glm::vec2(0, 0), 4.0f, 4, glm::vec4(1, 0, 0, 1));
 
-    SphereClass* sphere4 = new SphereClass(glm::vec2(0, 10), glm::vec2(0, 0), 7.0f, 7, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(sphere4);
+    physicsScene->addSphere(glm::vec2(0, 10), glm::vec2(0, 0), 7.0f, 7, glm::vec4(1, 0, 0, 1));
 
-    SphereClass* sphere5= new SphereClass(glm::vec2(2, 3), glm::vec2(0, 0), 7.0f, 7, glm::vec4(1, 0, 0, 1));
-    sphere5->is_static = true;
-    physicsScene->addActor(sphere5);
+    DIYBodyHandle sphere5 = physicsScene->addSphere(glm::vec2(2, 3), glm::vec2(0, 0), 7.0f, 7, glm::vec4(1, 0, 0, 1));
+    physicsScene->setStatic(sphere5, true);
 
-    SphereClass* circle = new SphereClass(glm::vec2(0, 20), glm::vec2(0, 0), 10, 1, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(circle);
+    physicsScene->addSphere(glm::vec2(0, 20), glm::vec2(0, 0), 10, 1, glm::vec4(1, 0, 0, 1));
                        
-   /* BoxClass* box = new BoxClass(glm::vec2(-0, 20), glm::vec2(0, 0), 0, 1, 5, 6, glm::vec4(1, 0, 0, 1));
-    physicsScene->addActor(box); */
+   /* physicsScene->addBox(glm::vec2(-0, 20), glm::vec2(0, 0), 0, 1, 5, 6, glm::vec4(1, 0, 0, 1)); */
 
     PlaneClass* plane = new PlaneClass(glm::normalize(glm::vec2(1, 1)), -25);
     physicsScene->addActor(plane);
@@ -230,16 +229,14 @@ void SpringPhysicsTutorial()
     physicsScene->timeStep = .016f;
     physicsScene->gravity = glm::vec2(0, -10);
 
-    SphereClass* top_sphere = new SphereClass(glm::vec2(0, 40), glm::vec2(), 2, 2, glm::vec4(1, 1, 0, 1));
-    top_sphere->is_static = true;
-    physicsScene->addActor(top_sphere);
+    DIYBodyHandle top_sphere = physicsScene->addSphere(glm::vec2(0, 40), glm::vec2(), 2, 2, glm::vec4(1, 1, 0, 1));
+    physicsScene->setStatic(top_sphere, true);
 
-    SphereClass* collision_sphere = new SphereClass(glm::vec2(10, 25), glm::vec2(), 6,6, glm::vec4(1, 1, 0, 1));
-    collision_sphere->is_static = true;
-    physicsScene->addActor(collision_sphere);
+    DIYBodyHandle collision_sphere = physicsScene->addSphere(glm::vec2(10, 25), glm::vec2(), 6,6, glm::vec4(1, 1, 0, 1));
+    physicsScene->setStatic(collision_sphere, true);
 
     const int CHAIN_LEN = 20;
-    SphereClass* chain[CHAIN_LEN];
+    DIYBodyHandle chain[CHAIN_LEN];
     SpringJoint* joints[CHAIN_LEN];
 
     float seperation = 2.5f;
@@ -247,8 +244,7 @@ void SpringPhysicsTutorial()
     for (int i = 0; i < CHAIN_LEN; ++i)
     {
         float distance = seperation * (i + 1);
-        chain[i] = new SphereClass(glm::vec2(distance, 40), glm::vec2(), 1.0f, 2, glm::vec4(1, 1, 0, 1));
-        physicsScene->addActor(chain[i]);
+        chain[i] = physicsScene->addSphere(glm::vec2(distance, 40), glm::vec2(), 1.0f, 2, glm::vec4(1, 1, 0, 1));
     }
 
     float rest_dist = seperation;// sqrtf(seperation*seperation + seperation*seperation);
@@ -267,7 +263,7 @@ void SpringPhysicsTutorial()
 
 void onUpdateRocket(float deltaTime)
 {
-	if (rocket != nullptr)
+	if (physicsScene->bodyIndex(rocket) >= 0)
 	{
 		static float fireCounter = 0;
 		fireCounter -= deltaTime;
@@ -275,14 +271,14 @@ void onUpdateRocket(float deltaTime)
 		{
 			float exhaustMass = .1f;
 			fireCounter = 0.25;
-			SphereClass *exhaust;
-			glm::vec2 position = rocket->position;
-			if (rocket->mass > exhaustMass)
+			DIYBodyHandle exhaust;
+			glm::vec2 position = physicsScene->getPosition(rocket);
+			if (physicsScene->getMass(rocket) > exhaustMass)
 			{
-				rocket->mass -= exhaustMass;
-				exhaust = new SphereClass(position, glm::vec2(0, 0), 1, exhaustMass, glm::vec4(0, 1, 0, 1));
-				physicsScene->addActor(exhaust);
-				exhaust->applyForceToActor(rocket, glm::vec2(1, 1));
+				physicsScene->setMass(rocket, physicsScene->getMass(rocket) - exhaustMass);
+				exhaust = physicsScene->addSphere(position, glm::vec2(0, 0), 1, exhaustMass, glm::vec4(0, 1, 0, 1));
+				physicsScene->applyForce(rocket, glm::vec2(1, 1));
+				physicsScene->applyForce(exhaust, -glm::vec2(1, 1));
 			}
 		}
 	}
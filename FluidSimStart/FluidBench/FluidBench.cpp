@@ -0,0 +1,255 @@
+//Headless benchmark for DIYFluid.
+//Steps the solver on a range of grid sizes without a window or GL context
+//and prints the average time per step of each UpdateFluid stage.
+//
+//usage: FluidBench [max_size] [steps] [solver] [threads] [simd] [advection] [layout] [confinement] [tiles] [dims] [dye]
+//    max_size - largest grid edge to run, sizes double from 64, or from 16 in 3d (default 4096)
+//    steps    - steps per size, by default scaled so every size does similar work
+//    solver   - jacobi (default), sor for red-black SOR sweeps, tiled for cache blocked jacobi, multigrid,
+//               or pcg for incomplete cholesky preconditioned conjugate gradient
+//    threads  - worker threads per fluid, 0 (default) for one per hardware thread
+//    simd     - scalar, sse2 or avx2 stencil kernels, the widest supported by default
+//    advection - semi (default) for semi-lagrangian or maccormack
+//    layout   - collocated (default) or staggered
+//    confinement - vorticity confinement strength, 0 (default) for none
+//    tiles    - dense (default), or sparse to only run the stages on active tiles
+//    dims     - 2 (default), or 3 for DIYFluid3D on cubes. it only has jacobi solves, semi-lagrangian
+//               advection and the collocated layout, so only threads and simd apply to it
+//    dye      - float (default), or half to store the dye as fp16
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "DIYFluid.h"
+#include "DIYFluid3D.h"
+
+static const char* stage_header_format = "%6s %6s %10s %10s %10s %10s %10s %10s %10s %10s %10s %8s %8s %8s\n";
+
+static void Bench3D(int max_size, int fixed_steps, int thread_count, const FluidKernels* kernels)
+{
+	const float dt = 1.0f / 60.0f;
+
+	printf(stage_header_format,
+		"size", "steps", "advect", "diffuse", "diverge", "pressure", "apply_p", "boundary", "forces", "tiles", "total", "d_iters", "p_iters", "live");
+
+	for (int size = 16; size <= max_size; size *= 2)
+	{
+		int cell_count = size * size * size;
+
+		int steps = fixed_steps;
+		if (steps <= 0)
+		{
+			steps = glm::max(3, (1 << 24) / cell_count);
+		}
+
+		DIYFluid3D fluid(size, size, size, 0.1f, 0.1f, thread_count);
+		fluid.SetSimd(kernels->simd);
+
+		//one warm up step so first touch page faults aren't counted
+		fluid.UpdateFluid(dt);
+
+		FluidStageTimings total = {};
+		int diffuse_iterations = 0;
+		int pressure_iterations = 0;
+
+		for (int step = 0; step < steps; ++step)
+		{
+			fluid.UpdateFluid(dt);
+
+			total.advect_ms += fluid.timings.advect_ms;
+			total.diffuse_ms += fluid.timings.diffuse_ms;
+			total.divergence_ms += fluid.timings.divergence_ms;
+			total.pressure_ms += fluid.timings.pressure_ms;
+			total.apply_pressure_ms += fluid.timings.apply_pressure_ms;
+			total.boundary_ms += fluid.timings.boundary_ms;
+			total.forces_ms += fluid.timings.forces_ms;
+
+			diffuse_iterations += fluid.diffuse_iterations_used;
+			pressure_iterations += fluid.pressure_iterations_used;
+		}
+
+		double inv_steps = 1.0 / steps;
+		double step_ms = (total.advect_ms + total.diffuse_ms + total.divergence_ms +
+			total.pressure_ms + total.apply_pressure_ms + total.boundary_ms + total.forces_ms) * inv_steps;
+
+		printf("%6d %6d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %8.1f %8.1f %7.1f%%\n",
+			size, steps,
+			total.advect_ms * inv_steps,
+			total.diffuse_ms * inv_steps,
+			total.divergence_ms * inv_steps,
+			total.pressure_ms * inv_steps,
+			total.apply_pressure_ms * inv_steps,
+			total.boundary_ms * inv_steps,
+			total.forces_ms * inv_steps,
+			0.0,
+			step_ms,
+			diffuse_iterations * inv_steps,
+			pressure_iterations * inv_steps,
+			100.0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int max_size = 4096;
+	int fixed_steps = 0;
+
+	if (argc > 1)
+	{
+		max_size = atoi(argv[1]);
+	}
+	if (argc > 2)
+	{
+		fixed_steps = atoi(argv[2]);
+	}
+
+	PressureSolver solver = PRESSURE_JACOBI;
+	FluidSmoother smoother = SMOOTH_JACOBI;
+	if (argc > 3 && strcmp(argv[3], "multigrid") == 0)
+	{
+		solver = PRESSURE_MULTIGRID;
+	}
+	if (argc > 3 && strcmp(argv[3], "pcg") == 0)
+	{
+		solver = PRESSURE_PCG;
+	}
+	if (argc > 3 && strcmp(argv[3], "sor") == 0)
+	{
+		smoother = SMOOTH_RED_BLACK_SOR;
+	}
+	if (argc > 3 && strcmp(argv[3], "tiled") == 0)
+	{
+		smoother = SMOOTH_TILED_JACOBI;
+	}
+
+	int thread_count = 0;
+	if (argc > 4)
+	{
+		thread_count = atoi(argv[4]);
+	}
+
+	const FluidKernels* kernels = SelectFluidKernels();
+	if (argc > 5)
+	{
+		if (strcmp(argv[5], "scalar") == 0)
+		{
+			kernels = GetFluidKernels(SIMD_SCALAR);
+		}
+		else if (strcmp(argv[5], "sse2") == 0)
+		{
+			kernels = GetFluidKernels(SIMD_SSE2);
+		}
+		else if (strcmp(argv[5], "avx2") == 0)
+		{
+			kernels = GetFluidKernels(SIMD_AVX2);
+		}
+	}
+
+	FluidAdvection advection = ADVECT_SEMI_LAGRANGIAN;
+	if (argc > 6 && strcmp(argv[6], "maccormack") == 0)
+	{
+		advection = ADVECT_MACCORMACK;
+	}
+
+	FluidGridLayout layout = GRID_COLLOCATED;
+	if (argc > 7 && strcmp(argv[7], "staggered") == 0)
+	{
+		layout = GRID_STAGGERED;
+	}
+
+	float confinement = 0;
+	if (argc > 8)
+	{
+		confinement = (float)atof(argv[8]);
+	}
+
+	bool sparse = argc > 9 && strcmp(argv[9], "sparse") == 0;
+
+	FluidDyeFormat dye_format = DYE_FLOAT32;
+	if (argc > 11 && strcmp(argv[11], "half") == 0)
+	{
+		dye_format = DYE_FLOAT16;
+	}
+
+	printf("stencil kernels: %s\n", kernels->name);
+
+	if (argc > 10 && atoi(argv[10]) == 3)
+	{
+		Bench3D(max_size, fixed_steps, thread_count, kernels);
+		return 0;
+	}
+
+	const float dt = 1.0f / 60.0f;
+
+	printf(stage_header_format,
+		"size", "steps", "advect", "diffuse", "diverge", "pressure", "apply_p", "boundary", "forces", "tiles", "total", "d_iters", "p_iters", "live");
+
+	for (int size = 64; size <= max_size; size *= 2)
+	{
+		int cell_count = size * size;
+
+		int steps = fixed_steps;
+		if (steps <= 0)
+		{
+			steps = glm::max(3, (1 << 24) / cell_count);
+		}
+
+		DIYFluid fluid(size, size, 0.1f, 0.1f, thread_count);
+		fluid.pressure_solver = solver;
+		fluid.smoother = smoother;
+		fluid.SetSimd(kernels->simd);
+		fluid.advection = advection;
+		fluid.layout = layout;
+		fluid.vorticity_confinement = confinement;
+		fluid.sparse_tiles = sparse;
+		fluid.dye_format = dye_format;
+
+		//one warm up step so first touch page faults aren't counted
+		fluid.UpdateFluid(dt);
+
+		FluidStageTimings total = {};
+		int diffuse_iterations = 0;
+		int pressure_iterations = 0;
+		double live_tiles = 0;
+
+		for (int step = 0; step < steps; ++step)
+		{
+			fluid.UpdateFluid(dt);
+
+			total.advect_ms += fluid.timings.advect_ms;
+			total.diffuse_ms += fluid.timings.diffuse_ms;
+			total.divergence_ms += fluid.timings.divergence_ms;
+			total.pressure_ms += fluid.timings.pressure_ms;
+			total.apply_pressure_ms += fluid.timings.apply_pressure_ms;
+			total.boundary_ms += fluid.timings.boundary_ms;
+			total.forces_ms += fluid.timings.forces_ms;
+			total.tiles_ms += fluid.timings.tiles_ms;
+
+			diffuse_iterations += fluid.diffuse_iterations_used;
+			pressure_iterations += fluid.pressure_iterations_used;
+			live_tiles += (double)fluid.live_tile_count / (fluid.tiles_x * fluid.tiles_y);
+		}
+
+		double inv_steps = 1.0 / steps;
+		double step_ms = (total.advect_ms + total.diffuse_ms + total.divergence_ms +
+			total.pressure_ms + total.apply_pressure_ms + total.boundary_ms + total.forces_ms + total.tiles_ms) * inv_steps;
+
+		printf("%6d %6d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %8.1f %8.1f %7.1f%%\n",
+			size, steps,
+			total.advect_ms * inv_steps,
+			total.diffuse_ms * inv_steps,
+			total.divergence_ms * inv_steps,
+			total.pressure_ms * inv_steps,
+			total.apply_pressure_ms * inv_steps,
+			total.boundary_ms * inv_steps,
+			total.forces_ms * inv_steps,
+			total.tiles_ms * inv_steps,
+			step_ms,
+			diffuse_iterations * inv_steps,
+			pressure_iterations * inv_steps,
+			sparse ? 100.0 * live_tiles * inv_steps : 100.0);
+	}
+
+	return 0;
+}